@@ -31,7 +31,7 @@
 
 using namespace os;
 
-Thread::Thread() : running(false), threadId(NULL)
+Thread::Thread() : running(false), joinable(false), threadId(NULL)
 {
   mutex = new Mutex;
 
@@ -83,12 +83,18 @@ void Thread::start()
 #endif
 
   running = true;
+  joinable = true;
 }
 
 void Thread::wait()
 {
-  if (!isRunning())
-    return;
+  // The thread might have finished already, but it still needs to be
+  // joined to release its resources
+  {
+    AutoMutex a(mutex);
+    if (!joinable)
+      return;
+  }
 
 #ifdef WIN32
   DWORD ret;
@@ -103,6 +109,9 @@ void Thread::wait()
   if (ret != 0)
     throw rdr::SystemException("Failed to join thread", ret);
 #endif
+
+  AutoMutex a(mutex);
+  joinable = false;
 }
 
 bool Thread::isRunning()
@@ -20,6 +20,7 @@
 #include <config.h>
 #endif
 
+#include <assert.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
@@ -54,30 +55,55 @@
 using namespace rdr;
 
 enum { DEFAULT_BUF_SIZE = 8192,
-       MIN_BULK_SIZE = 1024 };
+       MIN_BULK_SIZE = 1024,
+       MAX_SPARE_BLOCKS = 2 };
+
+struct FdInStream::Block {
+  U8* data;
+  int size;
+  int refs;
+  FdInStream* owner;
+};
 
 FdInStream::FdInStream(int fd_, int timeoutms_, int bufSize_,
                        bool closeWhenDone_)
   : fd(fd_), closeWhenDone(closeWhenDone_),
     timeoutms(timeoutms_), blockCallback(0),
     timing(false), timeWaitedIn100us(5), timedKbits(0),
-    bufSize(bufSize_ ? bufSize_ : DEFAULT_BUF_SIZE), offset(0)
+    bufSize(bufSize_ ? bufSize_ : DEFAULT_BUF_SIZE), offset(0),
+    captureStart(NULL)
 {
-  ptr = end = start = new U8[bufSize];
+  block = getBlock(bufSize);
+  ptr = end = start = block->data;
 }
 
 FdInStream::FdInStream(int fd_, FdInStreamBlockCallback* blockCallback_,
                        int bufSize_)
   : fd(fd_), timeoutms(0), blockCallback(blockCallback_),
     timing(false), timeWaitedIn100us(5), timedKbits(0),
-    bufSize(bufSize_ ? bufSize_ : DEFAULT_BUF_SIZE), offset(0)
+    bufSize(bufSize_ ? bufSize_ : DEFAULT_BUF_SIZE), offset(0),
+    captureStart(NULL)
 {
-  ptr = end = start = new U8[bufSize];
+  block = getBlock(bufSize);
+  ptr = end = start = block->data;
 }
 
 FdInStream::~FdInStream()
 {
-  delete [] start;
+  std::list<Block*>::iterator iter;
+
+  retireBlock(block);
+
+  // Anything still captured is freed once it is released
+  for (iter = blocks.begin(); iter != blocks.end(); ++iter) {
+    if ((*iter)->refs == 0) {
+      delete [] (*iter)->data;
+      delete *iter;
+    } else {
+      (*iter)->owner = NULL;
+    }
+  }
+
   if (closeWhenDone) close(fd);
 }
 
@@ -99,7 +125,9 @@ int FdInStream::pos()
 
 void FdInStream::readBytes(void* data, int length)
 {
-  if (length < MIN_BULK_SIZE) {
+  // Reading directly in to the caller's memory would bypass the
+  // capture
+  if ((length < MIN_BULK_SIZE) || (captureStart != NULL)) {
     InStream::readBytes(data, length);
     return;
   }
@@ -123,20 +151,84 @@ void FdInStream::readBytes(void* data, int length)
 }
 
 
+void FdInStream::startCapture()
+{
+  captureStart = ptr;
+}
+
+FdInStream::Block* FdInStream::endCapture(const U8** data, int* length)
+{
+  assert(captureStart != NULL);
+
+  *data = captureStart;
+  *length = ptr - captureStart;
+
+  captureStart = NULL;
+
+  block->refs++;
+  return block;
+}
+
+void FdInStream::releaseCapture(Block* block)
+{
+  block->refs--;
+  if (block->refs > 0)
+    return;
+
+  if (block->owner == NULL) {
+    delete [] block->data;
+    delete block;
+    return;
+  }
+
+  block->owner->trimBlocks();
+}
+
 int FdInStream::overrun(int itemSize, int nItems, bool wait)
 {
+  const U8* keep;
+  int kept, size;
+
   if (itemSize > bufSize)
     throw Exception("FdInStream overrun: max itemSize exceeded");
 
-  if (end - ptr != 0)
-    memmove(start, ptr, end - ptr);
+  // Captured data has to stay in the buffer, and in one piece
+  keep = (captureStart != NULL) ? captureStart : ptr;
+  kept = end - keep;
 
-  offset += ptr - start;
-  end -= ptr - start;
-  ptr = start;
+  // Make sure there is room for reasonably large reads when the
+  // captured data starts filling up the buffer
+  size = bufSize;
+  if (captureStart != NULL) {
+    while (kept > size / 2)
+      size *= 2;
+  }
+
+  // Data that has been handed out by endCapture() must not be
+  // overwritten, so we have to move to a different block
+  if ((size != bufSize) || (block->refs > 1)) {
+    Block* newBlock;
+
+    newBlock = getBlock(size);
+    memcpy(newBlock->data, keep, kept);
+
+    retireBlock(block);
+    block = newBlock;
+  } else if (keep != start) {
+    memmove(start, keep, kept);
+  }
+
+  offset += keep - start;
+  ptr = block->data + (ptr - keep);
+  end = block->data + kept;
+  if (captureStart != NULL)
+    captureStart = block->data;
+
+  start = block->data;
+  bufSize = block->size;
 
   int bytes_to_read;
-  while (end < start + itemSize) {
+  while (end < ptr + itemSize) {
     bytes_to_read = start + bufSize - end;
     if (!timing) {
       // When not timing, we must be careful not to read too much
@@ -158,6 +250,62 @@ int FdInStream::overrun(int itemSize, int nItems, bool wait)
   return nItems;
 }
 
+FdInStream::Block* FdInStream::getBlock(int size)
+{
+  std::list<Block*>::iterator iter;
+  Block* newBlock;
+
+  for (iter = blocks.begin(); iter != blocks.end(); ++iter) {
+    if (((*iter)->refs == 0) && ((*iter)->size >= size)) {
+      newBlock = *iter;
+      blocks.erase(iter);
+      newBlock->refs = 1;
+      return newBlock;
+    }
+  }
+
+  newBlock = new Block;
+  newBlock->data = new U8[size];
+  newBlock->size = size;
+  newBlock->refs = 1;
+  newBlock->owner = this;
+
+  return newBlock;
+}
+
+void FdInStream::retireBlock(Block* block)
+{
+  blocks.push_back(block);
+  releaseCapture(block);
+}
+
+// trimBlocks() frees unused blocks once we have more than enough of
+// them to cover the captures that are typically in use
+void FdInStream::trimBlocks()
+{
+  std::list<Block*>::iterator iter;
+  int spare;
+
+  spare = 0;
+  iter = blocks.begin();
+  while (iter != blocks.end()) {
+    if ((*iter)->refs != 0) {
+      ++iter;
+      continue;
+    }
+
+    spare++;
+    if (spare <= MAX_SPARE_BLOCKS) {
+      ++iter;
+      continue;
+    }
+
+    delete [] (*iter)->data;
+    delete *iter;
+    iter = blocks.erase(iter);
+  }
+}
+
 //
 // readWithTimeoutOrCallback() reads up to the given length in bytes from the
 // file descriptor into a buffer.  If the wait argument is false, then zero is
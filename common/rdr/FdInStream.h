@@ -23,6 +23,8 @@
 #ifndef __RDR_FDINSTREAM_H__
 #define __RDR_FDINSTREAM_H__
 
+#include <list>
+
 #include <rdr/InStream.h>
 
 namespace rdr {
@@ -53,12 +55,29 @@ namespace rdr {
     unsigned int kbitsPerSecond();
     unsigned int timeWaited() { return timeWaitedIn100us; }
 
+    // Capturing makes sure everything read between startCapture() and
+    // endCapture() ends up in one piece in the buffer, and then keeps
+    // it there so it can be used without first being copied somewhere
+    // else. The buffer is grown as needed. The returned block must be
+    // given back using releaseCapture() on the same thread that reads
+    // the stream, but that can happen after the stream is gone.
+
+    struct Block;
+
+    void startCapture();
+    Block* endCapture(const U8** data, int* length);
+    static void releaseCapture(Block* block);
+
   protected:
     int overrun(int itemSize, int nItems, bool wait);
 
   private:
     int readWithTimeoutOrCallback(void* buf, int len, bool wait=true);
 
+    Block* getBlock(int size);
+    void retireBlock(Block* block);
+    void trimBlocks();
+
     int fd;
     bool closeWhenDone;
     int timeoutms;
@@ -71,6 +90,13 @@ namespace rdr {
     int bufSize;
     int offset;
     U8* start;
+
+    Block* block;
+    const U8* captureStart;
+
+    // Earlier blocks, either still in use by a capture or kept around
+    // to be reused
+    std::list<Block*> blocks;
   };
 
 } // end of namespace rdr
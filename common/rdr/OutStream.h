@@ -103,7 +103,7 @@ namespace rdr {
 
     // copyBytes() efficiently transfers data between streams
 
-    void copyBytes(InStream* is, int length) {
+    virtual void copyBytes(InStream* is, int length) {
       while (length > 0) {
         int n = check(1, length);
         is->readBytes(ptr, n);
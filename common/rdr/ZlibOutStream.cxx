@@ -95,6 +95,14 @@ void ZlibOutStream::flush()
   ptr = start;
 }
 
+void ZlibOutStream::reset()
+{
+  ptr = start;
+
+  if (deflateReset(zs) != Z_OK)
+    throw Exception("ZlibOutStream: deflateReset failed");
+}
+
 int ZlibOutStream::overrun(int itemSize, int nItems)
 {
 #ifdef ZLIBOUT_DEBUG
@@ -43,6 +43,11 @@ namespace rdr {
     void flush();
     int length();
 
+    // reset() throws away the compression history, so that the data
+    // that follows can be decompressed on its own. Anything written
+    // since the last flush() is lost.
+    void reset();
+
   private:
 
     int overrun(int itemSize, int nItems);
@@ -0,0 +1,193 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_ZSTD
+
+#include <rdr/ZstdOutStream.h>
+#include <rdr/Exception.h>
+
+#include <zstd.h>
+
+using namespace rdr;
+
+enum { DEFAULT_BUF_SIZE = 16384 };
+
+ZstdOutStream::ZstdOutStream(OutStream* os, int bufSize_, int compressLevel)
+  : underlying(os), compressionLevel(compressLevel), newLevel(compressLevel),
+    bufSize(bufSize_ ? bufSize_ : DEFAULT_BUF_SIZE), offset(0),
+    inFrame(false)
+{
+  size_t rc;
+
+  cs = ZSTD_createCCtx();
+  if (cs == NULL)
+    throw Exception("ZstdOutStream: ZSTD_createCCtx failed");
+
+  rc = ZSTD_CCtx_setParameter(cs, ZSTD_c_compressionLevel, compressLevel);
+  if (ZSTD_isError(rc)) {
+    ZSTD_freeCCtx(cs);
+    throw Exception("ZstdOutStream: invalid compression level %d",
+                    compressLevel);
+  }
+
+  ptr = start = new U8[bufSize];
+  end = start + bufSize;
+}
+
+ZstdOutStream::~ZstdOutStream()
+{
+  try {
+    flush();
+  } catch (Exception&) {
+  }
+  delete [] start;
+  ZSTD_freeCCtx(cs);
+}
+
+void ZstdOutStream::setUnderlying(OutStream* os)
+{
+  underlying = os;
+}
+
+void ZstdOutStream::setCompressionLevel(int level)
+{
+  if (level < ZSTD_minCLevel() || level > ZSTD_maxCLevel())
+    level = ZSTD_CLEVEL_DEFAULT;
+
+  newLevel = level;
+}
+
+void ZstdOutStream::setWorkers(int workers)
+{
+  ZSTD_CCtx_setParameter(cs, ZSTD_c_nbWorkers, workers);
+}
+
+int ZstdOutStream::length()
+{
+  return offset + ptr - start;
+}
+
+void ZstdOutStream::flush()
+{
+  checkCompressionLevel();
+
+  // Force out everything from the encoder
+  compress(ZSTD_e_flush);
+}
+
+void ZstdOutStream::reset()
+{
+  size_t rc;
+
+  ptr = start;
+
+  rc = ZSTD_CCtx_reset(cs, ZSTD_reset_session_only);
+  if (ZSTD_isError(rc))
+    throw Exception("ZstdOutStream: ZSTD_CCtx_reset failed");
+
+  inFrame = false;
+}
+
+int ZstdOutStream::overrun(int itemSize, int nItems)
+{
+  if (itemSize > bufSize)
+    throw Exception("ZstdOutStream overrun: max itemSize exceeded");
+
+  checkCompressionLevel();
+
+  while (end - ptr < itemSize)
+    compress(ZSTD_e_continue);
+
+  if (itemSize * nItems > end - ptr)
+    nItems = (end - ptr) / itemSize;
+
+  return nItems;
+}
+
+// compress() hands everything in our buffer over to the encoder. For
+// anything but ZSTD_e_continue it also makes sure that everything has
+// made it to the underlying stream.
+
+void ZstdOutStream::compress(int directive)
+{
+  ZSTD_inBuffer in;
+  ZSTD_outBuffer out;
+  size_t rc;
+
+  if (!underlying)
+    throw Exception("ZstdOutStream: underlying OutStream has not been set");
+
+  in.src = start;
+  in.size = ptr - start;
+  in.pos = 0;
+
+  if ((directive == ZSTD_e_continue) && (in.size == 0))
+    return;
+
+  do {
+    underlying->check(1);
+    out.dst = underlying->getptr();
+    out.size = underlying->getend() - underlying->getptr();
+    out.pos = 0;
+
+    rc = ZSTD_compressStream2(cs, &out, &in, (ZSTD_EndDirective)directive);
+    if (ZSTD_isError(rc))
+      throw Exception("ZstdOutStream: compression failed: %s",
+                      ZSTD_getErrorName(rc));
+
+    underlying->setptr(underlying->getptr() + out.pos);
+
+    if (directive == ZSTD_e_continue) {
+      if (in.pos == in.size)
+        break;
+    } else {
+      if (rc == 0)
+        break;
+    }
+  } while (true);
+
+  inFrame = (directive != ZSTD_e_end);
+
+  offset += ptr - start;
+  ptr = start;
+}
+
+void ZstdOutStream::checkCompressionLevel()
+{
+  size_t rc;
+
+  if (newLevel == compressionLevel)
+    return;
+
+  // Most parameters, including the level, can only be changed at the
+  // start of a frame
+  if (inFrame)
+    compress(ZSTD_e_end);
+
+  rc = ZSTD_CCtx_setParameter(cs, ZSTD_c_compressionLevel, newLevel);
+  if (ZSTD_isError(rc))
+    throw Exception("ZstdOutStream: invalid compression level %d", newLevel);
+
+  compressionLevel = newLevel;
+}
+
+#endif
@@ -0,0 +1,78 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// ZstdOutStream streams to a compressed data stream (underlying),
+// compressing with Zstandard on the fly.
+//
+
+#ifndef __RDR_ZSTDOUTSTREAM_H__
+#define __RDR_ZSTDOUTSTREAM_H__
+
+#ifdef HAVE_ZSTD
+
+#include <rdr/OutStream.h>
+
+struct ZSTD_CCtx_s;
+
+namespace rdr {
+
+  class ZstdOutStream : public OutStream {
+
+  public:
+
+    ZstdOutStream(OutStream* os=0, int bufSize=0, int compressionLevel=3);
+    virtual ~ZstdOutStream();
+
+    void setUnderlying(OutStream* os);
+    // A change of compression level ends the current frame, and with
+    // that the compression history
+    void setCompressionLevel(int level);
+    // setWorkers() lets Zstandard compress on extra threads. It must be
+    // called before anything is written, and is silently ignored if the
+    // library lacks support for threads.
+    void setWorkers(int workers);
+    void flush();
+    int length();
+
+    // reset() throws away the compression history, so that the data
+    // that follows can be decompressed on its own. Anything written
+    // since the last flush() is lost.
+    void reset();
+
+  private:
+
+    int overrun(int itemSize, int nItems);
+    void compress(int directive);
+    void checkCompressionLevel();
+
+    OutStream* underlying;
+    int compressionLevel;
+    int newLevel;
+    int bufSize;
+    int offset;
+    bool inFrame;
+    ZSTD_CCtx_s* cs;
+    U8* start;
+  };
+
+} // end of namespace rdr
+
+#endif
+
+#endif
@@ -27,6 +27,7 @@
 #include <rfb/Security.h>
 #include <rfb/SecurityClient.h>
 #include <rfb/CConnection.h>
+#include <rfb/SharedMemory.h>
 #include <rfb/util.h>
 
 #include <rfb/LogWriter.h>
@@ -42,7 +43,7 @@ CConnection::CConnection()
   : csecurity(0), is(0), os(0), reader_(0), writer_(0),
     shared(false),
     state_(RFBSTATE_UNINITIALISED), useProtocol3_3(false),
-    framebuffer(NULL), decoder(this)
+    framebuffer(NULL), decoder(this), shm(NULL)
 {
 }
 
@@ -55,6 +56,7 @@ CConnection::~CConnection()
   reader_ = 0;
   delete writer_;
   writer_ = 0;
+  delete shm;
 }
 
 void CConnection::setStreams(rdr::InStream* is_, rdr::OutStream* os_)
@@ -302,11 +304,40 @@ void CConnection::securityCompleted()
   writer_->writeClientInit(shared);
 }
 
+void CConnection::setupSharedMemory()
+{
+  // The old segment can stay as long as the framebuffer still fits
+  if ((shm != NULL) &&
+      (shm->width() >= cp.width) && (shm->height() >= cp.height))
+    return;
+
+  delete shm;
+  shm = NULL;
+  cp.sharedMemory = NULL;
+
+  try {
+    shm = new SharedMemory(cp.width, cp.height);
+  } catch (rdr::Exception& e) {
+    vlog.error("Unable to create shared memory framebuffer: %s", e.str());
+    return;
+  }
+
+  cp.sharedMemory = shm;
+
+  vlog.debug("Created shared memory segment %d for %dx%d framebuffer",
+             shm->getId(), cp.width, cp.height);
+
+  writer()->writeSetSharedMemory(shm->getId(), shm->getKey());
+}
+
 void CConnection::setDesktopSize(int w, int h)
 {
   decoder.flush();
 
   CMsgHandler::setDesktopSize(w,h);
+
+  if (shm != NULL)
+    setupSharedMemory();
 }
 
 void CConnection::setExtendedDesktopSize(unsigned reason,
@@ -317,6 +348,16 @@ void CConnection::setExtendedDesktopSize(unsigned reason,
   decoder.flush();
 
   CMsgHandler::setExtendedDesktopSize(reason, result, w, h, layout);
+
+  if (shm != NULL)
+    setupSharedMemory();
+}
+
+void CConnection::supportsSharedMemory()
+{
+  CMsgHandler::supportsSharedMemory();
+
+  setupSharedMemory();
 }
 
 void CConnection::readAndDecodeRect(const Rect& r, int encoding,
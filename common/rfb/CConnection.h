@@ -35,6 +35,7 @@ namespace rfb {
   class CMsgWriter;
   class CSecurity;
   class IdentityVerifier;
+  class SharedMemory;
 
   class CConnection : public CMsgHandler {
   public:
@@ -100,6 +101,8 @@ namespace rfb {
                                         int w, int h,
                                         const ScreenSet& layout);
 
+    virtual void supportsSharedMemory();
+
     virtual void readAndDecodeRect(const Rect& r, int encoding,
                                    ModifiablePixelBuffer* pb);
 
@@ -175,6 +178,7 @@ namespace rfb {
     void throwAuthFailureException();
     void throwConnFailedException();
     void securityCompleted();
+    void setupSharedMemory();
 
     rdr::InStream* is;
     rdr::OutStream* os;
@@ -190,6 +194,8 @@ namespace rfb {
 
     ModifiablePixelBuffer* framebuffer;
     DecodeManager decoder;
+
+    SharedMemory* shm;
   };
 }
 #endif
@@ -80,6 +80,10 @@ void CMsgHandler::supportsQEMUKeyEvent()
   cp.supportsQEMUKeyEvent = true;
 }
 
+void CMsgHandler::supportsSharedMemory()
+{
+}
+
 void CMsgHandler::framebufferUpdateStart()
 {
 }
@@ -26,17 +26,24 @@
 #include <rfb/util.h>
 #include <rfb/CMsgHandler.h>
 #include <rfb/CMsgReader.h>
+#include <rfb/Cursor.h>
 
 using namespace rfb;
 
 CMsgReader::CMsgReader(CMsgHandler* handler_, rdr::InStream* is_)
   : imageBufIdealSize(0), handler(handler_), is(is_),
-    nUpdateRectsLeft(0)
+    nUpdateRectsLeft(0), cursorCacheClock(0)
 {
+  for (int i = 0; i < cursorCacheMaxEntries; i++) {
+    cursorCache[i] = NULL;
+    cursorCacheUsed[i] = 0;
+  }
 }
 
 CMsgReader::~CMsgReader()
 {
+  for (int i = 0; i < cursorCacheMaxEntries; i++)
+    delete cursorCache[i];
 }
 
 void CMsgReader::readServerInit()
@@ -100,6 +107,9 @@ void CMsgReader::readMsg()
     case pseudoEncodingCursorWithAlpha:
       readSetCursorWithAlpha(w, h, Point(x,y));
       break;
+    case pseudoEncodingCursorCache:
+      readCursorCache(w, h, Point(x,y));
+      break;
     case pseudoEncodingDesktopName:
       readSetDesktopName(x, y, w, h);
       break;
@@ -114,6 +124,9 @@ void CMsgReader::readMsg()
     case pseudoEncodingQEMUKeyEvent:
       handler->supportsQEMUKeyEvent();
       break;
+    case pseudoEncodingSharedMemory:
+      handler->supportsSharedMemory();
+      break;
     default:
       readRect(Rect(x, y, x+w, y+h), encoding);
       break;
@@ -261,7 +274,7 @@ void CMsgReader::readSetXCursor(int width, int height, const Point& hotspot)
     }
   }
 
-  handler->setCursor(width, height, hotspot, buf);
+  setCursor(width, height, hotspot, buf);
 }
 
 void CMsgReader::readSetCursor(int width, int height, const Point& hotspot)
@@ -302,7 +315,7 @@ void CMsgReader::readSetCursor(int width, int height, const Point& hotspot)
     }
   }
 
-  handler->setCursor(width, height, hotspot, buf);
+  setCursor(width, height, hotspot, buf);
 }
 
 void CMsgReader::readSetCursorWithAlpha(int width, int height, const Point& hotspot)
@@ -347,8 +360,47 @@ void CMsgReader::readSetCursorWithAlpha(int width, int height, const Point& hots
 
   pb.commitBufferRW(pb.getRect());
 
-  handler->setCursor(width, height, hotspot,
-                     pb.getBuffer(pb.getRect(), &stride));
+  setCursor(width, height, hotspot, pb.getBuffer(pb.getRect(), &stride));
+}
+
+void CMsgReader::readCursorCache(int width, int height, const Point& hotspot)
+{
+  int slot;
+  const Cursor* cursor;
+
+  slot = is->readU8();
+  if (slot >= cursorCacheMaxEntries)
+    throw Exception("Invalid cursor cache slot");
+
+  cursor = cursorCache[slot];
+  if ((cursor == NULL) || (cursor->width() != width) ||
+      (cursor->height() != height) || !cursor->hotspot().equals(hotspot))
+    throw Exception("Cursor cache out of sync");
+
+  // The server marks the slot as used when it sends the rect
+  cursorCacheUsed[slot] = ++cursorCacheClock;
+
+  handler->setCursor(width, height, hotspot, cursor->getBuffer());
+}
+
+void CMsgReader::setCursor(int width, int height, const Point& hotspot,
+                           const rdr::U8* data)
+{
+  int slot;
+
+  // The server keeps track of our cache by doing the same thing for
+  // every cursor it sends
+  slot = 0;
+  for (int i = 1; i < cursorCacheMaxEntries; i++) {
+    if (cursorCacheUsed[i] < cursorCacheUsed[slot])
+      slot = i;
+  }
+
+  delete cursorCache[slot];
+  cursorCache[slot] = new Cursor(width, height, hotspot, data);
+  cursorCacheUsed[slot] = ++cursorCacheClock;
+
+  handler->setCursor(width, height, hotspot, data);
 }
 
 void CMsgReader::readSetDesktopName(int x, int y, int w, int h)
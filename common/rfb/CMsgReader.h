@@ -27,12 +27,14 @@
 #include <rdr/types.h>
 
 #include <rfb/Rect.h>
+#include <rfb/cursorCacheTypes.h>
 #include <rfb/encodings.h>
 
 namespace rdr { class InStream; }
 
 namespace rfb {
   class CMsgHandler;
+  class Cursor;
   struct Rect;
 
   class CMsgReader {
@@ -63,6 +65,7 @@ namespace rfb {
     void readSetXCursor(int width, int height, const Point& hotspot);
     void readSetCursor(int width, int height, const Point& hotspot);
     void readSetCursorWithAlpha(int width, int height, const Point& hotspot);
+    void readCursorCache(int width, int height, const Point& hotspot);
     void readSetDesktopName(int x, int y, int w, int h);
     void readExtendedDesktopSize(int x, int y, int w, int h);
     void readLEDState();
@@ -72,6 +75,16 @@ namespace rfb {
     int nUpdateRectsLeft;
 
     static const int maxCursorSize = 256;
+
+  private:
+    // setCursor() passes on a new cursor to the handler and also puts
+    // it in the cursor cache
+    void setCursor(int width, int height, const Point& hotspot,
+                   const rdr::U8* data);
+
+    Cursor* cursorCache[cursorCacheMaxEntries];
+    unsigned cursorCacheUsed[cursorCacheMaxEntries];
+    unsigned cursorCacheClock;
   };
 }
 #endif
@@ -27,6 +27,7 @@
 #include <rfb/Rect.h>
 #include <rfb/ConnParams.h>
 #include <rfb/Decoder.h>
+#include <rfb/SharedMemory.h>
 #include <rfb/CMsgWriter.h>
 
 using namespace rfb;
@@ -85,6 +86,12 @@ void CMsgWriter::writeSetEncodings(int preferredEncoding, bool useCopyRect)
     encodings[nEncodings++] = pseudoEncodingDesktopName;
   if (cp->supportsLEDState)
     encodings[nEncodings++] = pseudoEncodingLEDState;
+  if (cp->supportsSharedMemory)
+    encodings[nEncodings++] = pseudoEncodingSharedMemory;
+  if (cp->supportsTileCache)
+    encodings[nEncodings++] = pseudoEncodingTileCache;
+  if (cp->supportsCursorCache)
+    encodings[nEncodings++] = pseudoEncodingCursorCache;
 
   encodings[nEncodings++] = pseudoEncodingLastRect;
   encodings[nEncodings++] = pseudoEncodingContinuousUpdates;
@@ -102,9 +109,13 @@ void CMsgWriter::writeSetEncodings(int preferredEncoding, bool useCopyRect)
   /*
    * Prefer encodings in this order:
    *
-   *   Tight, ZRLE, Hextile, *
+   *   TightZstd, Tight, ZRLE, Hextile, *
    */
 
+  if ((preferredEncoding != encodingTightZstd) &&
+      Decoder::supported(encodingTightZstd))
+    encodings[nEncodings++] = encodingTightZstd;
+
   if ((preferredEncoding != encodingTight) &&
       Decoder::supported(encodingTight))
     encodings[nEncodings++] = encodingTight;
@@ -121,11 +132,18 @@ void CMsgWriter::writeSetEncodings(int preferredEncoding, bool useCopyRect)
   for (int i = encodingMax; i >= 0; i--) {
     switch (i) {
     case encodingCopyRect:
+    case encodingTightZstd:
     case encodingTight:
     case encodingZRLE:
     case encodingHextile:
       /* These have already been sent earlier */
       break;
+    case encodingSharedMemory:
+      /* Only used once a segment has been set up */
+      break;
+    case encodingTileCache:
+      /* Covered by the pseudo-encoding */
+      break;
     default:
       if ((i != preferredEncoding) && Decoder::supported(i))
         encodings[nEncodings++] = i;
@@ -217,6 +235,20 @@ void CMsgWriter::writeFence(rdr::U32 flags, unsigned len, const char data[])
   endMsg();
 }
 
+void CMsgWriter::writeSetSharedMemory(int shmid, const rdr::U8* key)
+{
+  if (!cp->supportsSharedMemory)
+    throw Exception("Server does not support shared memory");
+
+  startMsg(msgTypeSetSharedMemory);
+  os->pad(3);
+
+  os->writeU32(shmid);
+  os->writeBytes(key, SharedMemory::keyLength);
+
+  endMsg();
+}
+
 void CMsgWriter::writeKeyEvent(rdr::U32 keysym, rdr::U32 keycode, bool down)
 {
   if (!cp->supportsQEMUKeyEvent || !keycode) {
@@ -52,6 +52,8 @@ namespace rfb {
 
     void writeFence(rdr::U32 flags, unsigned len, const char data[]);
 
+    void writeSetSharedMemory(int shmid, const rdr::U8* key);
+
     void writeKeyEvent(rdr::U32 keysym, rdr::U32 keycode, bool down);
     void writePointerEvent(const Point& pos, int buttonMask);
     void writeClientCutText(const char* str, rdr::U32 len);
@@ -17,19 +17,25 @@
  */
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
 #include <vector>
 #include <rdr/types.h>
 #include <rfb/Exception.h>
 #include <rfb/LogWriter.h>
+#include <rfb/TileCompare.h>
 #include <rfb/ComparingUpdateTracker.h>
 
 using namespace rfb;
 
 static LogWriter vlog("ComparingUpdateTracker");
 
-ComparingUpdateTracker::ComparingUpdateTracker(PixelBuffer* buffer)
+ComparingUpdateTracker::ComparingUpdateTracker(PixelBuffer* buffer,
+                                               bool useHashes_,
+                                               bool detectScroll_)
   : fb(buffer), oldFb(fb->getPF(), 0, 0), firstCompare(true),
-    enabled(true), totalPixels(0), missedPixels(0)
+    enabled(true), useHashes(useHashes_), widthBlocks(0), heightBlocks(0),
+    detectScroll(detectScroll_), scrollMisses(0), scrollSkipped(0),
+    totalPixels(0), missedPixels(0), scrolledPixels(0)
 {
     changed.assign_union(fb->getRect());
 }
@@ -41,6 +47,32 @@ ComparingUpdateTracker::~ComparingUpdateTracker()
 
 #define BLOCK_SIZE 64
 
+// Scroll detection only looks at rects at least this big, and only
+// reports moves of at least this many lines
+#define SCROLL_MIN_SIZE 64
+#define SCROLL_MIN_LINES 16
+
+// The number of pixels across the middle of a rect used to find
+// candidate offsets
+#define SCROLL_BAND 256
+
+// Only this many of the largest changed rects are examined
+#define SCROLL_MAX_RECTS 4
+
+// After this many compares without finding a scroll (e.g. video), only
+// every SCROLL_RETRY_INTERVAL compare looks for one
+#define SCROLL_MISS_LIMIT 8
+#define SCROLL_RETRY_INTERVAL 16
+
+// Markers in ComparingUpdateTracker::scrollTable
+#define SCROLL_LINE_EMPTY -2
+#define SCROLL_LINE_REPEATED -1
+
+static bool largerArea(const Rect& a, const Rect& b)
+{
+  return a.area() > b.area();
+}
+
 bool ComparingUpdateTracker::compare()
 {
   std::vector<Rect> rects;
@@ -49,6 +81,23 @@ bool ComparingUpdateTracker::compare()
   if (!enabled)
     return false;
 
+  if (firstCompare && useHashes) {
+    // NB: We leave the change region untouched on this iteration,
+    // since in effect the entire framebuffer has changed.
+    widthBlocks = (fb->width() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    heightBlocks = (fb->height() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    blockHashes.resize(widthBlocks * heightBlocks);
+    blockValid.assign(widthBlocks * heightBlocks, false);
+
+    Region dummy;
+    hashRect(fb->getRect(), &dummy);
+
+    firstCompare = false;
+
+    return false;
+  }
+
   if (firstCompare) {
     // NB: We leave the change region untouched on this iteration,
     // since in effect the entire framebuffer has changed.
@@ -66,15 +115,98 @@ bool ComparingUpdateTracker::compare()
     return false;
   }
 
-  copied.get_rects(&rects, copy_delta.x<=0, copy_delta.y<=0);
-  for (i = rects.begin(); i != rects.end(); i++)
-    oldFb.copyRect(*i, copy_delta);
+  Region newChanged;
+  bool scrolled = false;
+
+  // Only a single copy can be tracked, so there is no point looking
+  // for scrolls if something else has already been copied
+  if (detectScroll && !useHashes && copy_enabled && copied.is_empty()) {
+    std::vector<Rect> candidates;
+    Rect bestDest;
+    Point bestDelta;
+
+    changed.get_rects(&rects);
+    for (i = rects.begin(); i != rects.end(); i++) {
+      Rect r = i->intersect(fb->getRect());
+      if ((r.width() >= SCROLL_MIN_SIZE) && (r.height() >= SCROLL_MIN_SIZE))
+        candidates.push_back(r);
+    }
 
-  changed.get_rects(&rects);
+    if (candidates.size() > SCROLL_MAX_RECTS) {
+      std::partial_sort(candidates.begin(),
+                        candidates.begin() + SCROLL_MAX_RECTS,
+                        candidates.end(), largerArea);
+      candidates.resize(SCROLL_MAX_RECTS);
+    }
 
-  Region newChanged;
-  for (i = rects.begin(); i != rects.end(); i++)
-    compareRect(*i, &newChanged);
+    // Back off if nothing has scrolled for a while
+    if (!candidates.empty() && (scrollMisses >= SCROLL_MISS_LIMIT)) {
+      if (++scrollSkipped < SCROLL_RETRY_INTERVAL)
+        candidates.clear();
+      else
+        scrollSkipped = 0;
+    }
+
+    for (i = candidates.begin(); i != candidates.end(); i++) {
+      Rect dest;
+      Point delta;
+
+      if (!findScroll(*i, &dest, &delta))
+        continue;
+
+      if (dest.area() > bestDest.area()) {
+        bestDest = dest;
+        bestDelta = delta;
+      }
+    }
+
+    if (!candidates.empty()) {
+      if (bestDest.is_empty())
+        scrollMisses++;
+      else
+        scrollMisses = scrollSkipped = 0;
+    }
+
+    if (!bestDest.is_empty()) {
+      vlog.debug("Detected move of %dx%d by %d,%d", bestDest.width(),
+                 bestDest.height(), bestDelta.x, bestDelta.y);
+
+      // The copy is applied to oldFb below, which makes the moved
+      // area compare as unchanged
+      copied.reset(bestDest);
+      copy_delta = bestDelta;
+
+      scrolledPixels += bestDest.area();
+      scrolled = true;
+    }
+  }
+
+  if (useHashes) {
+    // We can't move hashes around, so just make sure anything that
+    // was copied to gets rehashed the next time it changes
+    copied.get_rects(&rects);
+    for (i = rects.begin(); i != rects.end(); i++) {
+      Rect r = i->intersect(fb->getRect());
+      for (int by = r.tl.y / BLOCK_SIZE;
+           by < (r.br.y + BLOCK_SIZE - 1) / BLOCK_SIZE; by++) {
+        for (int bx = r.tl.x / BLOCK_SIZE;
+             bx < (r.br.x + BLOCK_SIZE - 1) / BLOCK_SIZE; bx++)
+          blockValid[by * widthBlocks + bx] = false;
+      }
+    }
+
+    changed.get_rects(&rects);
+    for (i = rects.begin(); i != rects.end(); i++)
+      hashRect(*i, &newChanged);
+  } else {
+    copied.get_rects(&rects, copy_delta.x<=0, copy_delta.y<=0);
+    for (i = rects.begin(); i != rects.end(); i++)
+      oldFb.copyRect(*i, copy_delta);
+
+    changed.get_rects(&rects);
+    for (i = rects.begin(); i != rects.end(); i++)
+      compareRect(*i, &newChanged);
+  }
 
   changed.get_rects(&rects);
   for (i = rects.begin(); i != rects.end(); i++)
@@ -83,7 +215,7 @@ bool ComparingUpdateTracker::compare()
   for (i = rects.begin(); i != rects.end(); i++)
     missedPixels += i->area();
 
-  if (changed.equals(newChanged))
+  if (changed.equals(newChanged) && !scrolled)
     return false;
 
   changed = newChanged;
@@ -122,6 +254,9 @@ void ComparingUpdateTracker::compareRect(const Rect& r, Region* newChanged)
 
   std::vector<Rect> changedBlocks;
 
+  int nBlocks = (r.width() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  std::vector<rdr::U32> mask(tileMaskSize(r.width(), BLOCK_SIZE));
+
   for (int blockTop = r.tl.y; blockTop < r.br.y; blockTop += BLOCK_SIZE)
   {
     // Get a strip of the source buffer
@@ -130,39 +265,47 @@ void ComparingUpdateTracker::compareRect(const Rect& r, Region* newChanged)
     const rdr::U8* newBlockPtr = fb->getBuffer(pos, &fbStride);
     int newStrideBytes = fbStride * bytesPerPixel;
 
-    rdr::U8* oldBlockPtr = oldData;
     int blockBottom = __rfbmin(blockTop+BLOCK_SIZE, r.br.y);
 
-    for (int blockLeft = r.tl.x; blockLeft < r.br.x; blockLeft += BLOCK_SIZE)
-    {
-      const rdr::U8* newPtr = newBlockPtr;
-      rdr::U8* oldPtr = oldBlockPtr;
+    // Compare the strip a scanline at a time, stopping early if every
+    // block has already changed
+    const rdr::U8* newPtr = newBlockPtr;
+    rdr::U8* oldPtr = oldData;
+    int nChanged = 0;
 
-      int blockRight = __rfbmin(blockLeft+BLOCK_SIZE, r.br.x);
-      int blockWidthInBytes = (blockRight-blockLeft) * bytesPerPixel;
+    std::fill(mask.begin(), mask.end(), 0);
 
-      for (int y = blockTop; y < blockBottom; y++)
+    for (int y = blockTop; (y < blockBottom) && (nChanged < nBlocks); y++)
+    {
+      nChanged += compareTiles(oldPtr, newPtr, r.width(), bytesPerPixel,
+                               BLOCK_SIZE, &mask[0]);
+      newPtr += newStrideBytes;
+      oldPtr += oldStrideBytes;
+    }
+
+    if (nChanged > 0) {
+      for (int block = 0; block < nBlocks; block++)
       {
-        if (memcmp(oldPtr, newPtr, blockWidthInBytes) != 0)
+        if (!tileMaskTest(&mask[0], block))
+          continue;
+
+        int blockLeft = r.tl.x + block * BLOCK_SIZE;
+        int blockRight = __rfbmin(blockLeft+BLOCK_SIZE, r.br.x);
+        int blockWidthInBytes = (blockRight-blockLeft) * bytesPerPixel;
+
+        // A block has changed - copy it to the oldFb
+        changedBlocks.push_back(Rect(blockLeft, blockTop,
+                                     blockRight, blockBottom));
+
+        newPtr = newBlockPtr + block * BLOCK_SIZE * bytesPerPixel;
+        oldPtr = oldData + block * BLOCK_SIZE * bytesPerPixel;
+        for (int y = blockTop; y < blockBottom; y++)
         {
-          // A block has changed - copy the remainder to the oldFb
-          changedBlocks.push_back(Rect(blockLeft, blockTop,
-                                       blockRight, blockBottom));
-          for (int y2 = y; y2 < blockBottom; y2++)
-          {
-            memcpy(oldPtr, newPtr, blockWidthInBytes);
-            newPtr += newStrideBytes;
-            oldPtr += oldStrideBytes;
-          }
-          break;
+          memcpy(oldPtr, newPtr, blockWidthInBytes);
+          newPtr += newStrideBytes;
+          oldPtr += oldStrideBytes;
         }
-
-        newPtr += newStrideBytes;
-        oldPtr += oldStrideBytes;
       }
-
-      oldBlockPtr += blockWidthInBytes;
-      newBlockPtr += blockWidthInBytes;
     }
 
     oldData += oldStrideBytes * BLOCK_SIZE;
@@ -177,6 +320,289 @@ void ComparingUpdateTracker::compareRect(const Rect& r, Region* newChanged)
   }
 }
 
+// hashRect() rehashes every block touched by the given rect and adds
+// those whose hash no longer matches. Blocks are aligned to the
+// framebuffer rather than to the rect, so that every rect maps on to
+// the same set of hashes.
+void ComparingUpdateTracker::hashRect(const Rect& r, Region* newChanged)
+{
+  Rect safe;
+
+  safe = r.intersect(fb->getRect());
+  if (safe.is_empty())
+    return;
+
+  std::vector<Rect> changedBlocks;
+
+  for (int by = safe.tl.y / BLOCK_SIZE;
+       by < (safe.br.y + BLOCK_SIZE - 1) / BLOCK_SIZE; by++) {
+    for (int bx = safe.tl.x / BLOCK_SIZE;
+         bx < (safe.br.x + BLOCK_SIZE - 1) / BLOCK_SIZE; bx++) {
+      Rect block(bx * BLOCK_SIZE, by * BLOCK_SIZE,
+                 __rfbmin((bx + 1) * BLOCK_SIZE, fb->width()),
+                 __rfbmin((by + 1) * BLOCK_SIZE, fb->height()));
+      int index = by * widthBlocks + bx;
+      rdr::U64 hash;
+
+      hash = hashBlock(block);
+      if (blockValid[index] && (blockHashes[index] == hash))
+        continue;
+
+      blockHashes[index] = hash;
+      blockValid[index] = true;
+
+      changedBlocks.push_back(block);
+    }
+  }
+
+  if (!changedBlocks.empty()) {
+    Region temp;
+    temp.setOrderedRects(changedBlocks);
+    newChanged->assign_union(temp);
+  }
+}
+
+rdr::U64 ComparingUpdateTracker::hashBlock(const Rect& r)
+{
+  int stride;
+  const rdr::U8* data = fb->getBuffer(r, &stride);
+
+  return hashTile(data, r.width(), r.height(), stride, fb->getPF().bpp/8);
+}
+
+// findScroll() checks if the contents of the given rect has been moved
+// vertically or horizontally within it. Each line of a band through
+// the middle of the rect is hashed, both in the old and in the new
+// framebuffer, and every line that can be found at a different
+// position votes for that offset. The most popular offset is then
+// verified against the actual pixels.
+bool ComparingUpdateTracker::findScroll(const Rect& r, Rect* dest,
+                                        Point* delta)
+{
+  int bytesPerPixel = fb->getPF().bpp/8;
+
+  if ((r.width() < SCROLL_MIN_SIZE) || (r.height() < SCROLL_MIN_SIZE))
+    return false;
+
+  for (int vertical = 1; vertical >= 0; vertical--) {
+    Rect band;
+    int lines;
+    std::vector<rdr::U64> oldHashes, newHashes;
+    const rdr::U8 *oldData, *newData;
+    int oldStride, newStride;
+
+    size_t tableMask;
+    int offset, bestVotes;
+
+    if (vertical) {
+      int bandWidth = __rfbmin(r.width(), SCROLL_BAND);
+      band.setXYWH(r.tl.x + (r.width() - bandWidth) / 2, r.tl.y,
+                   bandWidth, r.height());
+      lines = band.height();
+    } else {
+      int bandHeight = __rfbmin(r.height(), SCROLL_BAND);
+      band.setXYWH(r.tl.x, r.tl.y + (r.height() - bandHeight) / 2,
+                   r.width(), bandHeight);
+      lines = band.width();
+    }
+
+    oldData = oldFb.getBuffer(band, &oldStride);
+    newData = fb->getBuffer(band, &newStride);
+
+    oldHashes.resize(lines);
+    newHashes.resize(lines);
+
+    for (int line = 0; line < lines; line++) {
+      if (vertical) {
+        oldHashes[line] = hashTile(oldData + line * oldStride * bytesPerPixel,
+                                   band.width(), 1, oldStride, bytesPerPixel);
+        newHashes[line] = hashTile(newData + line * newStride * bytesPerPixel,
+                                   band.width(), 1, newStride, bytesPerPixel);
+      } else {
+        oldHashes[line] = hashTile(oldData + line * bytesPerPixel,
+                                   1, band.height(), oldStride, bytesPerPixel);
+        newHashes[line] = hashTile(newData + line * bytesPerPixel,
+                                   1, band.height(), newStride, bytesPerPixel);
+      }
+    }
+
+    // The old lines go in an open addressing hash table that is at
+    // most half full
+    tableMask = 1;
+    while (tableMask < (size_t)lines * 2)
+      tableMask <<= 1;
+    if (scrollTable.size() < tableMask)
+      scrollTable.resize(tableMask);
+    tableMask--;
+
+    for (size_t slot = 0; slot <= tableMask; slot++)
+      scrollTable[slot].line = SCROLL_LINE_EMPTY;
+
+    // Lines that occur more than once (e.g. blank ones) say nothing
+    // about where they came from
+    for (int line = 0; line < lines; line++) {
+      ScrollLine* entry = findScrollLine(oldHashes[line], tableMask);
+      if (entry->line == SCROLL_LINE_EMPTY) {
+        entry->hash = oldHashes[line];
+        entry->line = line;
+      } else {
+        entry->line = SCROLL_LINE_REPEATED;
+      }
+    }
+
+    scrollVotes.assign(lines * 2, 0);
+
+    for (int line = 0; line < lines; line++) {
+      const ScrollLine* entry;
+
+      if (newHashes[line] == oldHashes[line])
+        continue;
+
+      entry = findScrollLine(newHashes[line], tableMask);
+      if (entry->line < 0)
+        continue;
+
+      scrollVotes[line - entry->line + lines]++;
+    }
+
+    offset = 0;
+    bestVotes = 0;
+    for (int i = 0; i < lines * 2; i++) {
+      if (scrollVotes[i] > bestVotes) {
+        offset = i - lines;
+        bestVotes = scrollVotes[i];
+      }
+    }
+
+    if (bestVotes < SCROLL_MIN_LINES)
+      continue;
+
+    if (vertical)
+      *delta = Point(0, offset);
+    else
+      *delta = Point(offset, 0);
+
+    if (verifyScroll(r, band, *delta, dest))
+      return true;
+  }
+
+  return false;
+}
+
+// findScrollLine() returns the entry in scrollTable that has the given
+// hash, or the empty entry where it should be inserted.
+ComparingUpdateTracker::ScrollLine*
+ComparingUpdateTracker::findScrollLine(rdr::U64 hash, size_t tableMask)
+{
+  size_t slot;
+
+  slot = (size_t)(hash ^ (hash >> 32)) & tableMask;
+  while ((scrollTable[slot].line != SCROLL_LINE_EMPTY) &&
+         (scrollTable[slot].hash != hash))
+    slot = (slot + 1) & tableMask;
+
+  return &scrollTable[slot];
+}
+
+// verifyScroll() checks the offset found using the given band. The
+// longest run of lines along the band that match the old pixels they
+// would have come from is found first, and that run is then extended
+// sideways for as long as the pixels keep matching.
+bool ComparingUpdateTracker::verifyScroll(const Rect& r, const Rect& band,
+                                          const Point& delta, Rect* dest)
+{
+  Rect area, seed;
+  int start, bestStart, bestLength;
+
+  area = r.intersect(r.translate(delta));
+  seed = area.intersect(band);
+  if (seed.is_empty())
+    return false;
+
+  start = bestStart = bestLength = 0;
+
+  if (delta.x == 0) {
+    for (int y = 0; y < area.height(); y++) {
+      Rect line(seed.tl.x, area.tl.y + y, seed.br.x, area.tl.y + y + 1);
+      if (!moved(line, delta))
+        start = y + 1;
+      else if (y + 1 - start > bestLength) {
+        bestStart = start;
+        bestLength = y + 1 - start;
+      }
+    }
+
+    if (bestLength < SCROLL_MIN_LINES)
+      return false;
+
+    *dest = Rect(seed.tl.x, area.tl.y + bestStart,
+                 seed.br.x, area.tl.y + bestStart + bestLength);
+
+    while ((dest->tl.x > area.tl.x) &&
+           moved(Rect(dest->tl.x - 1, dest->tl.y,
+                      dest->tl.x, dest->br.y), delta))
+      dest->tl.x--;
+    while ((dest->br.x < area.br.x) &&
+           moved(Rect(dest->br.x, dest->tl.y,
+                      dest->br.x + 1, dest->br.y), delta))
+      dest->br.x++;
+  } else {
+    for (int x = 0; x < area.width(); x++) {
+      Rect line(area.tl.x + x, seed.tl.y, area.tl.x + x + 1, seed.br.y);
+      if (!moved(line, delta))
+        start = x + 1;
+      else if (x + 1 - start > bestLength) {
+        bestStart = start;
+        bestLength = x + 1 - start;
+      }
+    }
+
+    if (bestLength < SCROLL_MIN_LINES)
+      return false;
+
+    *dest = Rect(area.tl.x + bestStart, seed.tl.y,
+                 area.tl.x + bestStart + bestLength, seed.br.y);
+
+    while ((dest->tl.y > area.tl.y) &&
+           moved(Rect(dest->tl.x, dest->tl.y - 1,
+                      dest->br.x, dest->tl.y), delta))
+      dest->tl.y--;
+    while ((dest->br.y < area.br.y) &&
+           moved(Rect(dest->tl.x, dest->br.y,
+                      dest->br.x, dest->br.y + 1), delta))
+      dest->br.y++;
+  }
+
+  if (dest->area() < BLOCK_SIZE * BLOCK_SIZE)
+    return false;
+
+  return true;
+}
+
+// moved() returns true if the new pixels in the given rect are exactly
+// the old pixels at the given offset
+bool ComparingUpdateTracker::moved(const Rect& r, const Point& delta)
+{
+  int bytesPerPixel = fb->getPF().bpp/8;
+  const rdr::U8 *oldData, *newData;
+  int oldStride, newStride;
+  int rowBytes;
+
+  oldData = oldFb.getBuffer(r.translate(delta.negate()), &oldStride);
+  newData = fb->getBuffer(r, &newStride);
+
+  rowBytes = r.width() * bytesPerPixel;
+
+  for (int y = 0; y < r.height(); y++) {
+    if (memcmp(oldData, newData, rowBytes) != 0)
+      return false;
+    oldData += oldStride * bytesPerPixel;
+    newData += newStride * bytesPerPixel;
+  }
+
+  return true;
+}
+
 void ComparingUpdateTracker::logStats()
 {
   double ratio;
@@ -190,5 +616,10 @@ void ComparingUpdateTracker::logStats()
   vlog.info("%s in / %s out", a, b);
   vlog.info("(1:%g ratio)", ratio);
 
-  totalPixels = missedPixels = 0;
+  if (scrolledPixels != 0) {
+    siPrefix(scrolledPixels, "pixels", a, sizeof(a));
+    vlog.info("%s moved", a);
+  }
+
+  totalPixels = missedPixels = scrolledPixels = 0;
 }
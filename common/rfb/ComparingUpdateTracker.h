@@ -19,13 +19,22 @@
 #ifndef __RFB_COMPARINGUPDATETRACKER_H__
 #define __RFB_COMPARINGUPDATETRACKER_H__
 
+#include <vector>
+
 #include <rfb/UpdateTracker.h>
 
 namespace rfb {
 
   class ComparingUpdateTracker : public SimpleUpdateTracker {
   public:
-    ComparingUpdateTracker(PixelBuffer* buffer);
+    // If useHashes is set then only a hash of each block of the
+    // framebuffer is kept, rather than a full copy of it. The changes
+    // found are then rounded out to whole blocks.
+    // If detectScroll is set then large changed rects are also checked
+    // for content that has moved, which is then reported as copied
+    // rather than changed. This needs the full copy of the framebuffer.
+    ComparingUpdateTracker(PixelBuffer* buffer, bool useHashes=false,
+                           bool detectScroll=false);
     ~ComparingUpdateTracker();
 
     // compare() does the comparison and reduces its changed and copied regions
@@ -45,12 +54,39 @@ namespace rfb {
 
   private:
     void compareRect(const Rect& r, Region* newchanged);
+    void hashRect(const Rect& r, Region* newChanged);
+    rdr::U64 hashBlock(const Rect& r);
+    bool findScroll(const Rect& r, Rect* dest, Point* delta);
+    bool verifyScroll(const Rect& r, const Rect& band, const Point& delta,
+                      Rect* dest);
+    bool moved(const Rect& r, const Point& delta);
     PixelBuffer* fb;
     ManagedPixelBuffer oldFb;
     bool firstCompare;
     bool enabled;
 
-    rdr::U32 totalPixels, missedPixels;
+    bool useHashes;
+    int widthBlocks, heightBlocks;
+    std::vector<rdr::U64> blockHashes;
+    std::vector<bool> blockValid;
+
+    bool detectScroll;
+
+    // Scratch space for findScroll(), kept to avoid reallocating it
+    // for every rect
+    struct ScrollLine {
+      rdr::U64 hash;
+      int line;
+    };
+    std::vector<ScrollLine> scrollTable;
+    std::vector<int> scrollVotes;
+    ScrollLine* findScrollLine(rdr::U64 hash, size_t tableMask);
+
+    // Compares in a row that found nothing to scroll, and compares
+    // skipped since looking last
+    int scrollMisses, scrollSkipped;
+
+    rdr::U32 totalPixels, missedPixels, scrolledPixels;
   };
 
 }
@@ -36,10 +36,13 @@ ConnParams::ConnParams()
     supportsDesktopResize(false), supportsExtendedDesktopSize(false),
     supportsDesktopRename(false), supportsLastRect(false),
     supportsLEDState(false), supportsQEMUKeyEvent(false),
+    supportsSharedMemory(false), supportsTileCache(false),
+    supportsCursorCache(false),
     supportsSetDesktopSize(false), supportsFence(false),
     supportsContinuousUpdates(false),
     compressLevel(2), qualityLevel(-1), fineQualityLevel(-1),
-    subsampling(subsampleUndefined), name_(0), verStrPos(0),
+    subsampling(subsampleUndefined), sharedMemory(NULL),
+    name_(0), verStrPos(0),
     ledState_(ledUnknown)
 {
   setName("");
@@ -111,6 +114,9 @@ void ConnParams::setEncodings(int nEncodings, const rdr::S32* encodings)
   supportsLocalXCursor = false;
   supportsLastRect = false;
   supportsQEMUKeyEvent = false;
+  supportsSharedMemory = false;
+  supportsTileCache = false;
+  supportsCursorCache = false;
   compressLevel = -1;
   qualityLevel = -1;
   fineQualityLevel = -1;
@@ -151,6 +157,15 @@ void ConnParams::setEncodings(int nEncodings, const rdr::S32* encodings)
     case pseudoEncodingQEMUKeyEvent:
       supportsQEMUKeyEvent = true;
       break;
+    case pseudoEncodingSharedMemory:
+      supportsSharedMemory = true;
+      break;
+    case pseudoEncodingTileCache:
+      supportsTileCache = true;
+      break;
+    case pseudoEncodingCursorCache:
+      supportsCursorCache = true;
+      break;
     case pseudoEncodingFence:
       supportsFence = true;
       break;
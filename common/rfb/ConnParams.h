@@ -34,6 +34,8 @@ namespace rdr { class InStream; }
 
 namespace rfb {
 
+  class SharedMemory;
+
   const int subsampleUndefined = -1;
   const int subsampleNone = 0;
   const int subsampleGray = 1;
@@ -98,6 +100,9 @@ namespace rfb {
     bool supportsLastRect;
     bool supportsLEDState;
     bool supportsQEMUKeyEvent;
+    bool supportsSharedMemory;
+    bool supportsTileCache;
+    bool supportsCursorCache;
 
     bool supportsSetDesktopSize;
     bool supportsFence;
@@ -108,6 +113,10 @@ namespace rfb {
     int fineQualityLevel;
     int subsampling;
 
+    // The shared memory segment the viewer has created for the server
+    // to write in to, if any. Not owned by ConnParams.
+    SharedMemory* sharedMemory;
+
   private:
 
     PixelFormat pf_;
@@ -56,7 +56,8 @@ void CopyRectDecoder::getAffectedRegion(const Rect& rect,
 
 void CopyRectDecoder::decodeRect(const Rect& r, const void* buffer,
                                  size_t buflen, const ConnParams& cp,
-                                 ModifiablePixelBuffer* pb)
+                                 ModifiablePixelBuffer* pb,
+                                 DecoderContext* ctx)
 {
   rdr::MemInStream is(buffer, buflen);
   int srcX = is.readU16();
@@ -33,7 +33,8 @@ namespace rfb {
                                    Region* region);
     virtual void decodeRect(const Rect& r, const void* buffer,
                             size_t buflen, const ConnParams& cp,
-                            ModifiablePixelBuffer* pb);
+                            ModifiablePixelBuffer* pb,
+                            DecoderContext* ctx);
   };
 }
 #endif
@@ -20,6 +20,7 @@
 #include <string.h>
 
 #include <rfb/CConnection.h>
+#include <rfb/Configuration.h>
 #include <rfb/DecodeManager.h>
 #include <rfb/Decoder.h>
 #include <rfb/Region.h>
@@ -35,13 +36,46 @@ using namespace rfb;
 
 static LogWriter vlog("DecodeManager");
 
+static IntParameter decoderThreads("DecoderThreads",
+                                   "Number of threads to decode with, or 0 "
+                                   "for one for each CPU core",
+                                   0, 0, 256);
+
+// SkipOutStream throws away everything written to it, and skips over
+// whatever it is asked to copy. It is used when the data is captured
+// directly from the stream's buffer instead.
+
+class SkipOutStream : public rdr::OutStream {
+public:
+  SkipOutStream() { ptr = buf; end = buf + sizeof(buf); }
+
+  virtual int length() { return 0; }
+
+  virtual void copyBytes(rdr::InStream* is, int length) {
+    is->skip(length);
+  }
+
+protected:
+  virtual int overrun(int itemSize, int nItems) {
+    ptr = buf;
+    if (itemSize * nItems > end - ptr)
+      nItems = (end - ptr) / itemSize;
+    return nItems;
+  }
+
+private:
+  rdr::U8 buf[256];
+};
+
 DecodeManager::DecodeManager(CConnection *conn) :
-  conn(conn), threadException(NULL)
+  conn(conn), nextThread(0), threadException(NULL)
 {
   size_t cpuCount;
 
   memset(decoders, 0, sizeof(decoders));
 
+  skipStream = new SkipOutStream();
+
   queueMutex = new os::Mutex();
   producerCond = new os::Condition(queueMutex);
   consumerCond = new os::Condition(queueMutex);
@@ -52,36 +86,50 @@ DecodeManager::DecodeManager(CConnection *conn) :
     cpuCount = 1;
   } else {
     vlog.info("Detected %d CPU core(s)", (int)cpuCount);
-    // No point creating more threads than this, they'll just end up
-    // wasting CPU fighting for locks
-    if (cpuCount > 4)
-      cpuCount = 4;
-    // The overhead of threading is small, but not small enough to
-    // ignore on single CPU systems
-    if (cpuCount == 1)
-      vlog.info("Decoding data on main thread");
-    else
-      vlog.info("Creating %d decoder thread(s)", (int)cpuCount);
   }
 
+  if (decoderThreads != 0)
+    cpuCount = decoderThreads;
+
+  // The overhead of threading is small, but not small enough to
+  // ignore on single CPU systems
+  if (cpuCount == 1)
+    vlog.info("Decoding data on main thread");
+  else
+    vlog.info("Creating %d decoder thread(s)", (int)cpuCount);
+
   if (cpuCount == 1) {
     // Threads are not used on single CPU machines
-    freeBuffers.push_back(new rdr::MemOutStream());
+    entries.push_back(new QueueEntry);
     return;
   }
 
-  while (cpuCount--) {
-    // Twice as many possible entries in the queue as there
-    // are worker threads to make sure they don't stall
-    freeBuffers.push_back(new rdr::MemOutStream());
-    freeBuffers.push_back(new rdr::MemOutStream());
+  // Twice as many possible entries in the queue as there
+  // are worker threads to make sure they don't stall
+  entries.resize(cpuCount * 2);
+  for (size_t i = 0; i < entries.size(); i++) {
+    entries[i] = new QueueEntry;
+    freeEntries.push_back(entries[i]);
+  }
 
+  while (cpuCount--)
     threads.push_back(new DecodeThread(this));
-  }
+
+  // The threads look at each other's queues, so they can only be
+  // started once all of them exist
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i]->start();
 }
 
 DecodeManager::~DecodeManager()
 {
+  // Same thing here, every thread must be gone before any of them
+  // can be deleted
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i]->stop();
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i]->wait();
+
   while (!threads.empty()) {
     delete threads.back();
     threads.pop_back();
@@ -89,15 +137,18 @@ DecodeManager::~DecodeManager()
 
   delete threadException;
 
-  while (!freeBuffers.empty()) {
-    delete freeBuffers.back();
-    freeBuffers.pop_back();
+  while (!entries.empty()) {
+    releaseEntryData(entries.back());
+    delete entries.back();
+    entries.pop_back();
   }
 
   delete consumerCond;
   delete producerCond;
   delete queueMutex;
 
+  delete skipStream;
+
   for (size_t i = 0; i < sizeof(decoders)/sizeof(decoders[0]); i++)
     delete decoders[i];
 }
@@ -106,10 +157,12 @@ void DecodeManager::decodeRect(const Rect& r, int encoding,
                                ModifiablePixelBuffer* pb)
 {
   Decoder *decoder;
-  rdr::MemOutStream *bufferStream;
 
   QueueEntry *entry;
 
+  std::vector<QueueEntry*> pending, conflicts;
+  std::vector<QueueEntry*>::const_iterator iter;
+
   assert(pb != NULL);
 
   if (!Decoder::supported(encoding)) {
@@ -130,23 +183,34 @@ void DecodeManager::decodeRect(const Rect& r, int encoding,
   // Fast path for single CPU machines to avoid the context
   // switching overhead
   if (threads.empty()) {
-    bufferStream = freeBuffers.front();
-    bufferStream->clear();
-    decoder->readRect(r, conn->getInStream(), conn->cp, bufferStream);
-    decoder->decodeRect(r, bufferStream->data(), bufferStream->length(),
-                        conn->cp, pb);
+    entry = entries.front();
+    readEntryData(entry, r, decoder);
+    try {
+      decoder->decodeRect(r, entry->data, entry->length, conn->cp, pb,
+                          &context);
+    } catch (...) {
+      releaseEntryData(entry);
+      throw;
+    }
+    releaseEntryData(entry);
     return;
   }
 
-  // Wait for an available memory buffer
+  // Wait for an available entry
   queueMutex->lock();
 
-  while (freeBuffers.empty())
+  while (freeEntries.empty())
     producerCond->wait();
 
-  // Don't pop the buffer in case we throw an exception
+  releaseFreeEntries();
+
+  // Don't pop the entry in case we throw an exception
   // whilst reading
-  bufferStream = freeBuffers.front();
+  entry = freeEntries.front();
+
+  // Take a copy of everything that is still in progress, so we can
+  // look for conflicts without holding up the threads
+  pending.assign(workQueue.begin(), workQueue.end());
 
   queueMutex->unlock();
 
@@ -154,35 +218,50 @@ void DecodeManager::decodeRect(const Rect& r, int encoding,
   throwThreadException();
 
   // Read the rect
-  bufferStream->clear();
-  decoder->readRect(r, conn->getInStream(), conn->cp, bufferStream);
+  readEntryData(entry, r, decoder);
 
-  // Then try to put it on the queue
-  entry = new QueueEntry;
-
-  entry->active = false;
   entry->rect = r;
   entry->encoding = encoding;
   entry->decoder = decoder;
   entry->cp = &conn->cp;
   entry->pb = pb;
-  entry->bufferStream = bufferStream;
 
-  decoder->getAffectedRegion(r, bufferStream->data(),
-                             bufferStream->length(), conn->cp,
+  entry->affectedRegion.clear();
+  decoder->getAffectedRegion(r, entry->data, entry->length, conn->cp,
                              &entry->affectedRegion);
 
+  // Entries are only reused by us, so the ones we copied stay valid
+  // even if the threads finish them in the mean time
+  for (iter = pending.begin(); iter != pending.end(); ++iter) {
+    if (doEntriesConflict(*iter, entry))
+      conflicts.push_back(*iter);
+  }
+
   queueMutex->lock();
 
-  // The workers add buffers to the end so it's safe to assume
-  // the front is still the same buffer
-  freeBuffers.pop_front();
+  // The workers add entries to the end so it's safe to assume
+  // the front is still the same entry
+  freeEntries.pop_front();
+
+  entry->dependencies = 0;
+  entry->dependents.clear();
+  entry->done = false;
+
+  for (iter = conflicts.begin(); iter != conflicts.end(); ++iter) {
+    if ((*iter)->done)
+      continue;
+    (*iter)->dependents.push_back(entry);
+    entry->dependencies++;
+  }
 
   workQueue.push_back(entry);
 
-  // We only put a single entry on the queue so waking a single
-  // thread is sufficient
-  consumerCond->signal();
+  // Spread the new work over the threads, anyone idle will steal
+  // it if the chosen thread is busy
+  if (entry->dependencies == 0) {
+    scheduleEntry(entry, threads[nextThread]);
+    nextThread = (nextThread + 1) % threads.size();
+  }
 
   queueMutex->unlock();
 }
@@ -194,11 +273,147 @@ void DecodeManager::flush()
   while (!workQueue.empty())
     producerCond->wait();
 
+  // Don't keep the stream's buffers pinned while we wait for the
+  // next update
+  releaseFreeEntries();
+
   queueMutex->unlock();
 
   throwThreadException();
 }
 
+// readEntryData() reads the data for a rect from the stream. If the
+// stream supports it, the data is left in the stream's buffer to avoid
+// copying every rect an extra time.
+void DecodeManager::readEntryData(QueueEntry* entry, const Rect& r,
+                                  Decoder* decoder)
+{
+  rdr::FdInStream* fis;
+  const rdr::U8* data;
+  int length;
+
+  fis = dynamic_cast<rdr::FdInStream*>(conn->getInStream());
+  if (fis == NULL) {
+    entry->bufferStream.clear();
+    decoder->readRect(r, conn->getInStream(), conn->cp,
+                      &entry->bufferStream);
+    entry->data = (const rdr::U8*)entry->bufferStream.data();
+    entry->length = entry->bufferStream.length();
+    return;
+  }
+
+  fis->startCapture();
+  try {
+    decoder->readRect(r, fis, conn->cp, skipStream);
+  } catch (...) {
+    rdr::FdInStream::releaseCapture(fis->endCapture(&data, &length));
+    throw;
+  }
+
+  entry->capture = fis->endCapture(&data, &length);
+  entry->data = data;
+  entry->length = length;
+}
+
+// releaseEntryData() gives back the stream's buffer if the entry was
+// using it. Captures must only be handled by the main thread.
+void DecodeManager::releaseEntryData(QueueEntry* entry)
+{
+  if (entry->capture == NULL)
+    return;
+
+  rdr::FdInStream::releaseCapture(entry->capture);
+  entry->capture = NULL;
+}
+
+// releaseFreeEntries() releases the data of all entries that the
+// threads are done with. Must be called with queueMutex held.
+void DecodeManager::releaseFreeEntries()
+{
+  std::list<QueueEntry*>::const_iterator iter;
+
+  for (iter = freeEntries.begin(); iter != freeEntries.end(); ++iter)
+    releaseEntryData(*iter);
+}
+
+// doEntriesConflict() returns true if the second entry, which arrived
+// after the first one, cannot be decoded until the first one is done.
+bool DecodeManager::doEntriesConflict(QueueEntry* first,
+                                      QueueEntry* second)
+{
+  if (first->encoding == second->encoding) {
+    // An ordered decoder must handle the rects in the order given
+    if (second->decoder->flags & DecoderOrdered)
+      return true;
+
+    // For a partially ordered decoder we must ask the decoder
+    if ((second->decoder->flags & DecoderPartiallyOrdered) &&
+        second->decoder->doRectsConflict(second->rect,
+                                         second->data,
+                                         second->length,
+                                         first->rect,
+                                         first->data,
+                                         first->length,
+                                         *second->cp))
+      return true;
+  }
+
+  // Check overlap with the earlier rectangle
+  return !first->affectedRegion.intersect(second->affectedRegion).is_empty();
+}
+
+// scheduleEntry() hands an entry that has no more dependencies over
+// to a thread. Must be called with queueMutex held.
+void DecodeManager::scheduleEntry(QueueEntry* entry, DecodeThread* thread)
+{
+  thread->push(entry);
+
+  // Waking a single thread is sufficient as it will steal the entry
+  // if it isn't the one we gave it to
+  consumerCond->signal();
+}
+
+// finishEntry() releases everything waiting for an entry and returns
+// it to the pool. Must be called with queueMutex held.
+void DecodeManager::finishEntry(QueueEntry* entry, DecodeThread* thread)
+{
+  std::vector<QueueEntry*>::const_iterator iter;
+
+  entry->done = true;
+
+  // The thread that finished the entry is likely to have the relevant
+  // data cached, so give it the entries that are now ready
+  for (iter = entry->dependents.begin();
+       iter != entry->dependents.end();
+       ++iter) {
+    (*iter)->dependencies--;
+    if ((*iter)->dependencies == 0)
+      scheduleEntry(*iter, thread);
+  }
+
+  entry->dependents.clear();
+
+  workQueue.remove(entry);
+  freeEntries.push_back(entry);
+
+  // Wake the main thread in case it is waiting for an entry
+  producerCond->signal();
+}
+
+// hasReadyEntries() returns true if any thread has something that can
+// be decoded right away. Must be called with queueMutex held.
+bool DecodeManager::hasReadyEntries()
+{
+  std::vector<DecodeThread*>::const_iterator iter;
+
+  for (iter = threads.begin(); iter != threads.end(); ++iter) {
+    if (!(*iter)->isEmpty())
+      return true;
+  }
+
+  return false;
+}
+
 void DecodeManager::setThreadException(const rdr::Exception& e)
 {
   os::AutoMutex a(queueMutex);
@@ -230,13 +445,15 @@ DecodeManager::DecodeThread::DecodeThread(DecodeManager* manager)
 
   stopRequested = false;
 
-  start();
+  readyMutex = new os::Mutex();
 }
 
 DecodeManager::DecodeThread::~DecodeThread()
 {
   stop();
   wait();
+
+  delete readyMutex;
 }
 
 void DecodeManager::DecodeThread::stop()
@@ -252,31 +469,74 @@ void DecodeManager::DecodeThread::stop()
   manager->consumerCond->broadcast();
 }
 
-void DecodeManager::DecodeThread::worker()
+void DecodeManager::DecodeThread::push(DecodeManager::QueueEntry* entry)
 {
-  manager->queueMutex->lock();
+  os::AutoMutex a(readyMutex);
+  readyQueue.push_back(entry);
+}
+
+DecodeManager::QueueEntry* DecodeManager::DecodeThread::pop()
+{
+  DecodeManager::QueueEntry* entry;
+
+  os::AutoMutex a(readyMutex);
+
+  if (readyQueue.empty())
+    return NULL;
+
+  entry = readyQueue.front();
+  readyQueue.pop_front();
+
+  return entry;
+}
+
+DecodeManager::QueueEntry* DecodeManager::DecodeThread::steal()
+{
+  DecodeManager::QueueEntry* entry;
+
+  os::AutoMutex a(readyMutex);
+
+  if (readyQueue.empty())
+    return NULL;
+
+  entry = readyQueue.back();
+  readyQueue.pop_back();
 
-  while (!stopRequested) {
+  return entry;
+}
+
+bool DecodeManager::DecodeThread::isEmpty()
+{
+  os::AutoMutex a(readyMutex);
+  return readyQueue.empty();
+}
+
+void DecodeManager::DecodeThread::worker()
+{
+  while (true) {
     DecodeManager::QueueEntry *entry;
 
-    // Look for an available entry in the work queue
+    // Look for an available entry in the work queues
     entry = findEntry();
     if (entry == NULL) {
-      // Wait and try again
-      manager->consumerCond->wait();
-      continue;
-    }
+      os::AutoMutex a(manager->queueMutex);
 
-    // This is ours now
-    entry->active = true;
+      if (stopRequested)
+        break;
 
-    manager->queueMutex->unlock();
+      // Everything is scheduled with queueMutex held, so nothing can
+      // slip by between the check and the wait
+      if (!manager->hasReadyEntries())
+        manager->consumerCond->wait();
+
+      continue;
+    }
 
     // Do the actual decoding
     try {
-      entry->decoder->decodeRect(entry->rect, entry->bufferStream->data(),
-                                 entry->bufferStream->length(),
-                                 *entry->cp, entry->pb);
+      entry->decoder->decodeRect(entry->rect, entry->data,
+                                 entry->length, *entry->cp, entry->pb,
+                                 &context);
     } catch (rdr::Exception& e) {
       manager->setThreadException(e);
     } catch(...) {
@@ -284,81 +544,31 @@ void DecodeManager::DecodeThread::worker()
     }
 
     manager->queueMutex->lock();
-
-    // Remove the entry from the queue and give back the memory buffer
-    manager->freeBuffers.push_back(entry->bufferStream);
-    manager->workQueue.remove(entry);
-    delete entry;
-
-    // Wake the main thread in case it is waiting for a memory buffer
-    manager->producerCond->signal();
-    // This rect might have been blocking multiple other rects, so
-    // wake up every worker thread
-    if (manager->workQueue.size() > 1)
-      manager->consumerCond->broadcast();
+    manager->finishEntry(entry, this);
+    manager->queueMutex->unlock();
   }
-
-  manager->queueMutex->unlock();
 }
 
 DecodeManager::QueueEntry* DecodeManager::DecodeThread::findEntry()
 {
-  std::list<DecodeManager::QueueEntry*>::iterator iter;
-  Region lockedRegion;
-
-  if (manager->workQueue.empty())
-    return NULL;
+  std::vector<DecodeThread*>::const_iterator iter;
+  DecodeManager::QueueEntry* entry;
 
-  if (!manager->workQueue.front()->active)
-    return manager->workQueue.front();
+  entry = pop();
+  if (entry != NULL)
+    return entry;
 
-  for (iter = manager->workQueue.begin();
-       iter != manager->workQueue.end();
+  // Nothing of our own, so see if someone else has more than they
+  // can handle
+  for (iter = manager->threads.begin();
+       iter != manager->threads.end();
        ++iter) {
-    DecodeManager::QueueEntry* entry;
-
-    std::list<DecodeManager::QueueEntry*>::iterator iter2;
-
-    entry = *iter;
-
-    // Another thread working on this?
-    if (entry->active)
-      goto next;
-
-    // If this is an ordered decoder then make sure this is the first
-    // rectangle in the queue for that decoder
-    if (entry->decoder->flags & DecoderOrdered) {
-      for (iter2 = manager->workQueue.begin(); iter2 != iter; ++iter2) {
-        if (entry->encoding == (*iter2)->encoding)
-          goto next;
-      }
-    }
-
-    // For a partially ordered decoder we must ask the decoder for each
-    // pair of rectangles.
-    if (entry->decoder->flags & DecoderPartiallyOrdered) {
-      for (iter2 = manager->workQueue.begin(); iter2 != iter; ++iter2) {
-        if (entry->encoding != (*iter2)->encoding)
-          continue;
-        if (entry->decoder->doRectsConflict(entry->rect,
-                                            entry->bufferStream->data(),
-                                            entry->bufferStream->length(),
-                                            (*iter2)->rect,
-                                            (*iter2)->bufferStream->data(),
-                                            (*iter2)->bufferStream->length(),
-                                            *entry->cp))
-          goto next;
-      }
-    }
-
-    // Check overlap with earlier rectangles
-    if (!lockedRegion.intersect(entry->affectedRegion).is_empty())
-      goto next;
-
-    return entry;
+    if (*iter == this)
+      continue;
 
-next:
-    lockedRegion.assign_union(entry->affectedRegion);
+    entry = (*iter)->steal();
+    if (entry != NULL)
+      return entry;
   }
 
   return NULL;
@@ -19,10 +19,16 @@
 #ifndef __RFB_DECODEMANAGER_H__
 #define __RFB_DECODEMANAGER_H__
 
+#include <deque>
 #include <list>
+#include <vector>
 
 #include <os/Thread.h>
 
+#include <rdr/FdInStream.h>
+#include <rdr/MemOutStream.h>
+
+#include <rfb/DecoderContext.h>
 #include <rfb/Region.h>
 #include <rfb/encodings.h>
 
@@ -33,7 +39,7 @@ namespace os {
 
 namespace rdr {
   struct Exception;
-  class MemOutStream;
+  class OutStream;
 }
 
 namespace rfb {
@@ -60,18 +66,53 @@ namespace rfb {
     CConnection *conn;
     Decoder *decoders[encodingMax+1];
 
+    // Used when decoding directly on the main thread
+    DecoderContext context;
+
+    // The entries are reused, so each keeps its own buffer around
+    // between rects
     struct QueueEntry {
-      bool active;
+      QueueEntry() : capture(NULL) {}
+
       Rect rect;
       int encoding;
       Decoder* decoder;
       const ConnParams* cp;
       ModifiablePixelBuffer* pb;
-      rdr::MemOutStream* bufferStream;
       Region affectedRegion;
+
+      // The data is either part of the stream's buffer, or a copy of
+      // it when the stream doesn't support capturing
+      const rdr::U8* data;
+      size_t length;
+      rdr::FdInStream::Block* capture;
+      rdr::MemOutStream bufferStream;
+
+      // Earlier rects that have to be decoded before this one, and
+      // later rects that are waiting for this one
+      int dependencies;
+      std::vector<QueueEntry*> dependents;
+      bool done;
     };
 
-    std::list<rdr::MemOutStream*> freeBuffers;
+    void readEntryData(QueueEntry* entry, const Rect& r,
+                       Decoder* decoder);
+    void releaseEntryData(QueueEntry* entry);
+    void releaseFreeEntries();
+
+    bool doEntriesConflict(QueueEntry* first,
+                           QueueEntry* second);
+
+    class DecodeThread;
+
+    void scheduleEntry(QueueEntry* entry, DecodeThread* thread);
+    void finishEntry(QueueEntry* entry, DecodeThread* thread);
+    bool hasReadyEntries();
+
+    rdr::OutStream* skipStream;
+
+    std::vector<QueueEntry*> entries;
+    std::list<QueueEntry*> freeEntries;
     std::list<QueueEntry*> workQueue;
 
     os::Mutex* queueMutex;
@@ -86,6 +127,14 @@ namespace rfb {
 
       void stop();
 
+      // Rects that are ready to be decoded. The thread takes from the
+      // front of its own queue, and other threads steal from the back
+      // when they run out of work.
+      void push(DecodeManager::QueueEntry* entry);
+      DecodeManager::QueueEntry* pop();
+      DecodeManager::QueueEntry* steal();
+      bool isEmpty();
+
     protected:
       void worker();
       DecodeManager::QueueEntry* findEntry();
@@ -94,9 +143,15 @@ namespace rfb {
       DecodeManager* manager;
 
       bool stopRequested;
+
+      DecoderContext context;
+
+      os::Mutex* readyMutex;
+      std::deque<DecodeManager::QueueEntry*> readyQueue;
     };
 
-    std::list<DecodeThread*> threads;
+    std::vector<DecodeThread*> threads;
+    size_t nextThread;
     rdr::Exception *threadException;
   };
 }
@@ -26,6 +26,10 @@
 #include <rfb/HextileDecoder.h>
 #include <rfb/ZRLEDecoder.h>
 #include <rfb/TightDecoder.h>
+#include <rfb/TightZstdDecoder.h>
+#include <rfb/LZ4Decoder.h>
+#include <rfb/SharedMemoryDecoder.h>
+#include <rfb/TileCacheDecoder.h>
 
 using namespace rfb;
 
@@ -61,7 +65,20 @@ bool Decoder::supported(int encoding)
   case encodingHextile:
   case encodingZRLE:
   case encodingTight:
+  case encodingTileCache:
     return true;
+#ifndef WIN32
+  case encodingSharedMemory:
+    return true;
+#endif
+#ifdef HAVE_ZSTD
+  case encodingTightZstd:
+    return true;
+#endif
+#ifdef HAVE_LZ4
+  case encodingLZ4:
+    return true;
+#endif
   default:
     return false;
   }
@@ -82,6 +99,18 @@ Decoder* Decoder::createDecoder(int encoding)
     return new ZRLEDecoder();
   case encodingTight:
     return new TightDecoder();
+  case encodingSharedMemory:
+    return new SharedMemoryDecoder();
+  case encodingTileCache:
+    return new TileCacheDecoder();
+#ifdef HAVE_ZSTD
+  case encodingTightZstd:
+    return new TightZstdDecoder();
+#endif
+#ifdef HAVE_LZ4
+  case encodingLZ4:
+    return new LZ4Decoder();
+#endif
   default:
     return NULL;
   }
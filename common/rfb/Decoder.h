@@ -26,6 +26,7 @@ namespace rdr {
 
 namespace rfb {
   class ConnParams;
+  class DecoderContext;
   class ModifiablePixelBuffer;
   class Region;
 
@@ -49,9 +50,10 @@ namespace rfb {
     // These functions are the main interface to an individual decoder
 
     // readRect() transfers data for the given rectangle from the
-    // InStream to the OutStream, possibly changing it along the way to
-    // make it easier to decode. This function will always be called in
-    // a serial manner on the main thread.
+    // InStream to the OutStream. The data must not be changed along the
+    // way, as the DecodeManager might skip the copy and use the data
+    // directly from the InStream's buffer. This function will always
+    // be called in a serial manner on the main thread.
     virtual void readRect(const Rect& r, rdr::InStream* is,
                           const ConnParams& cp, rdr::OutStream* os)=0;
 
@@ -80,10 +82,13 @@ namespace rfb {
     // decodeRect() decodes the given rectangle with data from the
     // given buffer, onto the ModifiablePixelBuffer. The PixelFormat of
     // the PixelBuffer might not match the ConnParams and it is up to
-    // the decoder to do any necessary conversion.
+    // the decoder to do any necessary conversion. The DecoderContext
+    // belongs to the calling thread and can be used for anything that
+    // does not need to survive until the next rect.
     virtual void decodeRect(const Rect& r, const void* buffer,
                             size_t buflen, const ConnParams& cp,
-                            ModifiablePixelBuffer* pb)=0;
+                            ModifiablePixelBuffer* pb,
+                            DecoderContext* ctx)=0;
 
   public:
     static bool supported(int encoding);
@@ -0,0 +1,64 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <assert.h>
+
+#include <rfb/DecoderContext.h>
+#include <rfb/JpegDecompressor.h>
+
+using namespace rfb;
+
+DecoderContext::DecoderContext() : jpeg(NULL)
+{
+  for (int i = 0; i < scratchCount; i++) {
+    scratch[i] = NULL;
+    scratchSize[i] = 0;
+  }
+}
+
+DecoderContext::~DecoderContext()
+{
+  delete jpeg;
+
+  for (int i = 0; i < scratchCount; i++)
+    delete [] scratch[i];
+}
+
+JpegDecompressor* DecoderContext::getJpegDecompressor()
+{
+  // Created on first use as most sessions never see a JPEG rect
+  if (jpeg == NULL)
+    jpeg = new JpegDecompressor();
+  return jpeg;
+}
+
+rdr::U8* DecoderContext::getScratch(ScratchBuffer which, size_t size)
+{
+  assert((which >= 0) && (which < scratchCount));
+
+  if (size > scratchSize[which]) {
+    delete [] scratch[which];
+    scratch[which] = NULL;
+    scratchSize[which] = 0;
+
+    scratch[which] = new rdr::U8[size];
+    scratchSize[which] = size;
+  }
+
+  return scratch[which];
+}
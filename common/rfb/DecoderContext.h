@@ -0,0 +1,70 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// DecoderContext - resources private to one decoding thread
+//
+// Decoders are shared between all the threads of a DecodeManager, so
+// anything that is expensive to set up for every rect, but does not
+// carry state from one rect to the next, lives here instead. Each
+// thread has its own context and hands it to every decodeRect() call.
+//
+
+#ifndef __RFB_DECODERCONTEXT_H__
+#define __RFB_DECODERCONTEXT_H__
+
+#include <stddef.h>
+
+#include <rdr/types.h>
+
+namespace rfb {
+
+  class JpegDecompressor;
+
+  class DecoderContext {
+  public:
+    DecoderContext();
+    ~DecoderContext();
+
+    JpegDecompressor* getJpegDecompressor();
+
+    enum ScratchBuffer {
+      // Decompressed data before it is turned in to pixels
+      scratchData,
+      // Pixels that have to be converted before being put in the
+      // framebuffer
+      scratchPixels,
+
+      scratchCount
+    };
+
+    // getScratch() returns a buffer of at least the given size. The
+    // contents are undefined and only valid until the next call for
+    // the same buffer.
+    rdr::U8* getScratch(ScratchBuffer which, size_t size);
+
+  private:
+    JpegDecompressor* jpeg;
+
+    rdr::U8* scratch[scratchCount];
+    size_t scratchSize[scratchCount];
+  };
+
+}
+
+#endif
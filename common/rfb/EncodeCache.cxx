@@ -0,0 +1,207 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <rfb/EncodeCache.h>
+#include <rfb/LogWriter.h>
+#include <rfb/util.h>
+
+using namespace rfb;
+
+static LogWriter vlog("EncodeCache");
+
+// Stop storing things once a single frame has used this much memory
+static const size_t MaxFrameBytes = 64 * 1024 * 1024;
+
+// Clients that have not encoded anything for this many frames no longer
+// count as sharing their settings
+static const unsigned MaxIdleFrames = 60;
+
+bool EncodeCache::Settings::operator==(const Settings& other) const
+{
+  return pf.equal(other.pf) && (encoders == other.encoders) &&
+         (compressLevel == other.compressLevel) &&
+         (qualityLevel == other.qualityLevel) &&
+         (fineQualityLevel == other.fineQualityLevel) &&
+         (subsampling == other.subsampling) &&
+         (allowLossy == other.allowLossy);
+}
+
+bool EncodeCache::Key::operator<(const Key& other) const
+{
+  if (pb != other.pb)
+    return pb < other.pb;
+  if (rect.tl.y != other.rect.tl.y)
+    return rect.tl.y < other.rect.tl.y;
+  if (rect.tl.x != other.rect.tl.x)
+    return rect.tl.x < other.rect.tl.x;
+  if (rect.br.y != other.rect.br.y)
+    return rect.br.y < other.rect.br.y;
+  return rect.br.x < other.rect.br.x;
+}
+
+EncodeCache::EncodeCache()
+  : active(false), frameBytes(0), frames(0), stores(0), hits(0),
+    storedBytes(0), sharedBytes(0)
+{
+}
+
+EncodeCache::~EncodeCache()
+{
+}
+
+void EncodeCache::startFrame()
+{
+  groups.clear();
+  frameBytes = 0;
+  active = true;
+  frames++;
+}
+
+void EncodeCache::endFrame()
+{
+  groups.clear();
+  frameBytes = 0;
+  active = false;
+}
+
+bool EncodeCache::setClientSettings(const void* client,
+                                    const Settings& settings)
+{
+  std::map<const void*, Client>::iterator iter, next;
+  bool shared;
+
+  clients[client].settings = settings;
+  clients[client].lastFrame = frames;
+
+  shared = false;
+  for (iter = clients.begin(); iter != clients.end(); iter = next) {
+    next = iter;
+    ++next;
+
+    if (frames - iter->second.lastFrame > MaxIdleFrames) {
+      clients.erase(iter);
+      continue;
+    }
+
+    if ((iter->first != client) && (iter->second.settings == settings))
+      shared = true;
+  }
+
+  return shared;
+}
+
+void EncodeCache::removeClient(const void* client)
+{
+  clients.erase(client);
+}
+
+const rdr::U8* EncodeCache::lookup(const Settings& settings,
+                                   const PixelBuffer* pb, const Rect& rect,
+                                   int* type, size_t* length)
+{
+  Group* group;
+  Key key;
+  std::map<Key, Entry>::const_iterator iter;
+
+  if (!active)
+    return NULL;
+
+  group = findGroup(settings);
+  if (group == NULL)
+    return NULL;
+
+  key.pb = pb;
+  key.rect = rect;
+
+  iter = group->entries.find(key);
+  if (iter == group->entries.end())
+    return NULL;
+
+  hits++;
+  sharedBytes += iter->second.data.size();
+
+  *type = iter->second.type;
+  *length = iter->second.data.size();
+
+  return &iter->second.data[0];
+}
+
+void EncodeCache::store(const Settings& settings, const PixelBuffer* pb,
+                        const Rect& rect, int type,
+                        const rdr::U8* data, size_t length)
+{
+  Group* group;
+  Key key;
+  Entry* entry;
+
+  if (!active)
+    return;
+
+  if ((length == 0) || (frameBytes + length > MaxFrameBytes))
+    return;
+
+  group = findGroup(settings);
+  if (group == NULL) {
+    groups.push_back(Group());
+    group = &groups.back();
+    group->settings = settings;
+  }
+
+  key.pb = pb;
+  key.rect = rect;
+
+  entry = &group->entries[key];
+  entry->type = type;
+  entry->data.assign(data, data + length);
+
+  frameBytes += length;
+
+  stores++;
+  storedBytes += length;
+}
+
+void EncodeCache::logStats()
+{
+  char a[1024], b[1024];
+
+  if (hits == 0)
+    return;
+
+  vlog.info("Shared frames: %u", frames);
+
+  siPrefix(stores, "rects", a, sizeof(a));
+  iecPrefix(storedBytes, "B", b, sizeof(b));
+  vlog.info("  Encoded: %s, %s", a, b);
+
+  siPrefix(hits, "rects", a, sizeof(a));
+  iecPrefix(sharedBytes, "B", b, sizeof(b));
+  vlog.info("  Reused: %s, %s", a, b);
+}
+
+EncodeCache::Group* EncodeCache::findGroup(const Settings& settings)
+{
+  std::list<Group>::iterator iter;
+
+  // There are only a handful of clients, so a linear search is fine
+  for (iter = groups.begin(); iter != groups.end(); ++iter) {
+    if (iter->settings == settings)
+      return &*iter;
+  }
+
+  return NULL;
+}
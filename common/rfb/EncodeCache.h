@@ -0,0 +1,130 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// EncodeCache - encoded rects shared between the clients of a server
+//
+// Clients that use the same pixel format and encoding settings end up
+// encoding the same rects of every frame. The first client to encode a
+// rect stores the result here, and the other clients can then send the
+// same bytes. Entries are only valid for a single frame, i.e. while the
+// framebuffer is known to stay the same, and only output that does not
+// depend on earlier rects on the connection can be stored.
+//
+
+#ifndef __RFB_ENCODECACHE_H__
+#define __RFB_ENCODECACHE_H__
+
+#include <stddef.h>
+
+#include <list>
+#include <map>
+#include <vector>
+
+#include <rdr/types.h>
+#include <rfb/PixelFormat.h>
+#include <rfb/Rect.h>
+
+namespace rfb {
+
+  class PixelBuffer;
+
+  class EncodeCache {
+  public:
+    EncodeCache();
+    ~EncodeCache();
+
+    // Everything besides the pixels that affects the encoded data
+    struct Settings {
+      PixelFormat pf;
+      std::vector<int> encoders;
+      int compressLevel;
+      int qualityLevel;
+      int fineQualityLevel;
+      int subsampling;
+      bool allowLossy;
+
+      bool operator==(const Settings& other) const;
+    };
+
+    // startFrame() and endFrame() surround the period where the
+    // framebuffer is guaranteed not to change. Nothing is cached
+    // outside of it.
+    void startFrame();
+    void endFrame();
+
+    bool isActive() const { return active; }
+
+    // Clients register the settings they would share with, and are
+    // told if any other client currently has the same settings. Output
+    // that can be shared compresses worse, so it is only worth it if
+    // someone else can use it. A registration lapses if the client
+    // has not renewed it for a while, e.g. because it stopped
+    // requesting updates.
+    bool setClientSettings(const void* client, const Settings& settings);
+    void removeClient(const void* client);
+
+    // lookup() returns the data previously stored for the rect of the
+    // given PixelBuffer, and the type of encoder used, or NULL if no
+    // client has encoded it with these settings in this frame.
+    const rdr::U8* lookup(const Settings& settings, const PixelBuffer* pb,
+                          const Rect& rect, int* type, size_t* length);
+    void store(const Settings& settings, const PixelBuffer* pb,
+               const Rect& rect, int type,
+               const rdr::U8* data, size_t length);
+
+    void logStats();
+
+  private:
+    struct Key {
+      const PixelBuffer* pb;
+      Rect rect;
+
+      bool operator<(const Key& other) const;
+    };
+
+    struct Entry {
+      int type;
+      std::vector<rdr::U8> data;
+    };
+
+    struct Group {
+      Settings settings;
+      std::map<Key, Entry> entries;
+    };
+
+    struct Client {
+      Settings settings;
+      unsigned lastFrame;
+    };
+
+    Group* findGroup(const Settings& settings);
+
+    bool active;
+    std::list<Group> groups;
+    std::map<const void*, Client> clients;
+    size_t frameBytes;
+
+    unsigned frames;
+    unsigned long long stores, hits;
+    unsigned long long storedBytes, sharedBytes;
+  };
+
+}
+
+#endif
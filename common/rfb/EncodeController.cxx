@@ -0,0 +1,224 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <string.h>
+
+#include <rfb/EncodeController.h>
+#include <rfb/LogWriter.h>
+
+using namespace rfb;
+
+static LogWriter vlog("EncodeController");
+
+// Smaller updates are dominated by fixed overhead and would just skew
+// the estimates
+static const unsigned long long MinPixels = 16384;
+
+// Number of measurements before we trust the estimates for a mode
+static const unsigned MinSamples = 3;
+
+// How often (in updates) to try a mode we know too little about, and
+// one that we have good estimates for but are not using
+static const unsigned ShortProbeInterval = 10;
+static const unsigned ProbeInterval = 100;
+
+// How much faster another mode must look before we switch to it
+static const double SwitchFactor = 0.8;
+
+// Weight of a new measurement in the running estimates
+static const double SampleWeight = 0.25;
+
+EncodeController::EncodeController()
+  : current(modeNormal), updates(0), switches(0), probes(0)
+{
+  memset(modes, 0, sizeof(modes));
+  modes[modeNormal].available = true;
+}
+
+EncodeController::~EncodeController()
+{
+}
+
+const char* EncodeController::modeName(Mode mode)
+{
+  switch (mode) {
+  case modeNormal:
+    return "Normal";
+  case modeFastCompress:
+    return "Fast compression";
+  case modeLowQuality:
+    return "Low quality";
+  case modeLZ4:
+    return "LZ4";
+  case modeMax:
+    break;
+  }
+
+  return "Unknown Mode";
+}
+
+void EncodeController::setAvailable(Mode mode, bool available)
+{
+  if (mode == modeNormal)
+    return;
+
+  modes[mode].available = available;
+}
+
+EncodeController::Mode EncodeController::selectMode(size_t bandwidth)
+{
+  Mode best, probe;
+  double currentCost, bestCost;
+
+  updates++;
+
+  if (!modes[current].available)
+    current = modeNormal;
+
+  modes[current].lastProbe = updates;
+
+  // Only try something else once we know what we are comparing to
+  if (modes[current].samples >= MinSamples) {
+    probe = findStaleMode();
+    if (probe != modeMax) {
+      modes[probe].lastProbe = updates;
+      modes[probe].updates++;
+      probes++;
+      return probe;
+    }
+  }
+
+  currentCost = predictCost(current, bandwidth);
+
+  best = current;
+  bestCost = currentCost * SwitchFactor;
+  for (int i = 0; i < modeMax; i++) {
+    double cost;
+
+    if (!modes[i].available || (modes[i].samples < MinSamples))
+      continue;
+    if (i == current)
+      continue;
+
+    cost = predictCost((Mode)i, bandwidth);
+    if (cost < bestCost) {
+      best = (Mode)i;
+      bestCost = cost;
+    }
+  }
+
+  if (best != current) {
+    vlog.debug("Switching from %s to %s mode (%g vs %g us/pixel at %d kbit/s)",
+               modeName(current), modeName(best),
+               currentCost, predictCost(best, bandwidth),
+               (int)(bandwidth * 8 / 1000));
+    current = best;
+    switches++;
+  }
+
+  modes[current].updates++;
+
+  return current;
+}
+
+void EncodeController::recordUpdate(Mode mode, unsigned long long pixels,
+                                    unsigned long long bytes,
+                                    unsigned time)
+{
+  ModeInfo* info;
+  double timePerPixel, bytesPerPixel;
+
+  if (pixels < MinPixels)
+    return;
+
+  info = &modes[mode];
+
+  timePerPixel = (double)time / pixels;
+  bytesPerPixel = (double)bytes / pixels;
+
+  if (info->samples == 0) {
+    info->timePerPixel = timePerPixel;
+    info->bytesPerPixel = bytesPerPixel;
+  } else {
+    info->timePerPixel += (timePerPixel - info->timePerPixel) * SampleWeight;
+    info->bytesPerPixel += (bytesPerPixel - info->bytesPerPixel) * SampleWeight;
+  }
+
+  info->samples++;
+}
+
+void EncodeController::logStats()
+{
+  if (updates == 0)
+    return;
+
+  vlog.info("Adaptive encoding: %u updates, %u mode switches, %u probes",
+            updates, switches, probes);
+
+  for (int i = 0; i < modeMax; i++) {
+    if (modes[i].updates == 0)
+      continue;
+
+    vlog.info("  %s: %u updates, %g us/pixel, %g bytes/pixel",
+              modeName((Mode)i), modes[i].updates,
+              modes[i].timePerPixel, modes[i].bytesPerPixel);
+  }
+}
+
+double EncodeController::predictCost(Mode mode, size_t bandwidth)
+{
+  double sendTime;
+
+  // Encoding and sending overlap, so the slower of the two is what
+  // limits the rate of updates
+  if (bandwidth == 0)
+    return modes[mode].timePerPixel;
+
+  sendTime = modes[mode].bytesPerPixel * 1000000.0 / bandwidth;
+  if (sendTime > modes[mode].timePerPixel)
+    return sendTime;
+
+  return modes[mode].timePerPixel;
+}
+
+EncodeController::Mode EncodeController::findStaleMode()
+{
+  Mode stale;
+
+  stale = modeMax;
+  for (int i = 0; i < modeMax; i++) {
+    unsigned interval;
+
+    if (!modes[i].available || (i == current))
+      continue;
+
+    if (modes[i].samples < MinSamples)
+      interval = ShortProbeInterval;
+    else
+      interval = ProbeInterval;
+
+    if (updates - modes[i].lastProbe < interval)
+      continue;
+
+    if ((stale == modeMax) ||
+        (modes[i].lastProbe < modes[stale].lastProbe))
+      stale = (Mode)i;
+  }
+
+  return stale;
+}
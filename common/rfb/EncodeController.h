@@ -0,0 +1,97 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// EncodeController - picks how to encode each update
+//
+// There are a few modes that trade CPU time against bandwidth in
+// different ways. The controller keeps a running estimate of how much
+// time and how many bytes every mode needs per pixel, and picks the one
+// that gets an update to the client the soonest given the current
+// bandwidth estimate. That is whichever is slower of encoding the
+// update and sending it, as the two overlap. Modes that have not been
+// used for a while are tried now and then to keep the estimates
+// current.
+//
+
+#ifndef __RFB_ENCODECONTROLLER_H__
+#define __RFB_ENCODECONTROLLER_H__
+
+#include <stddef.h>
+
+namespace rfb {
+
+  class EncodeController {
+  public:
+    enum Mode {
+      // The settings the client asked for
+      modeNormal,
+      // Least effort compression
+      modeFastCompress,
+      // Lower JPEG quality than the client asked for
+      modeLowQuality,
+      // Raw pixels compressed with LZ4
+      modeLZ4,
+      modeMax,
+    };
+
+    EncodeController();
+    ~EncodeController();
+
+    static const char* modeName(Mode mode);
+
+    // setAvailable() marks which modes can be used with the current
+    // client settings. modeNormal is always available.
+    void setAvailable(Mode mode, bool available);
+
+    // selectMode() returns the mode to use for the next update, given
+    // the bandwidth estimate in bytes per second.
+    Mode selectMode(size_t bandwidth);
+
+    // recordUpdate() reports the cost of an update encoded in the given
+    // mode. The time is in microseconds.
+    void recordUpdate(Mode mode, unsigned long long pixels,
+                      unsigned long long bytes, unsigned time);
+
+    void logStats();
+
+  private:
+    double predictCost(Mode mode, size_t bandwidth);
+    Mode findStaleMode();
+
+  private:
+    struct ModeInfo {
+      bool available;
+      unsigned samples;
+      unsigned lastProbe;
+      double timePerPixel;
+      double bytesPerPixel;
+      unsigned updates;
+    };
+
+    ModeInfo modes[modeMax];
+
+    Mode current;
+    unsigned updates;
+    unsigned switches;
+    unsigned probes;
+  };
+
+}
+
+#endif
@@ -19,15 +19,32 @@
  * USA.
  */
 
+#include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <set>
+
+#include <rdr/Exception.h>
+#include <rdr/MemOutStream.h>
+
+#include <os/Mutex.h>
 
 #include <rfb/EncodeManager.h>
 #include <rfb/Encoder.h>
+#include <rfb/Exception.h>
 #include <rfb/Palette.h>
 #include <rfb/SConnection.h>
 #include <rfb/SMsgWriter.h>
+#include <rfb/ServerCore.h>
+#include <rfb/SharedMemory.h>
+#include <rfb/TileCacheEncoder.h>
+#include <rfb/TileCompare.h>
+#include <rfb/tileCacheTypes.h>
 #include <rfb/UpdateTracker.h>
 #include <rfb/LogWriter.h>
+#include <rfb/util.h>
 
 #include <rfb/RawEncoder.h>
 #include <rfb/RREEncoder.h>
@@ -35,6 +52,8 @@
 #include <rfb/ZRLEEncoder.h>
 #include <rfb/TightEncoder.h>
 #include <rfb/TightJPEGEncoder.h>
+#include <rfb/TightZstdEncoder.h>
+#include <rfb/LZ4Encoder.h>
 
 using namespace rfb;
 
@@ -45,6 +64,9 @@ static LogWriter vlog("EncodeManager");
 static const int SubRectMaxArea = 65536;
 static const int SubRectMaxWidth = 2048;
 
+// JPEG slices cover whole MCU rows, even with 4:2:0 subsampling
+static const int SliceAlignment = 16;
+
 // The size in pixels of either side of each block tested when looking
 // for solid blocks.
 static const int SolidSearchBlock = 16;
@@ -61,8 +83,16 @@ enum EncoderClass {
   encoderRRE,
   encoderHextile,
   encoderTight,
+  encoderTightIndependent,
   encoderTightJPEG,
+#ifdef HAVE_ZSTD
+  encoderTightZstd,
+  encoderTightZstdIndependent,
+#endif
   encoderZRLE,
+#ifdef HAVE_LZ4
+  encoderLZ4,
+#endif
   encoderClassMax,
 };
 
@@ -83,6 +113,38 @@ struct RectInfo {
 
 };
 
+// A sub-rect handed to the worker threads. The entries are reused, so
+// each keeps its own buffers around between updates.
+struct EncodeManager::QueueEntry {
+  EncodeManager* manager;
+  bool active;
+  bool done;
+  Rect rect;
+  const PixelBuffer* pb;
+
+  // Set for slices, which are always full colour
+  bool typeKnown;
+
+  // Borrowed by the worker thread while encoding
+  std::vector<Encoder*>* encoders;
+
+  // Filled in by the worker thread
+  int type;
+  PixelBuffer* ppb;
+  struct RectInfo info;
+  bool needSlices;
+  bool encoded;
+  rdr::MemOutStream bufferStream;
+  unsigned encodeTime;
+
+  // Set instead if another client has already encoded the rect
+  const rdr::U8* sharedData;
+  size_t sharedLength;
+
+  OffsetPixelBuffer offsetPixelBuffer;
+  ManagedPixelBuffer convertedPixelBuffer;
+};
+
 static const char *encoderClassName(EncoderClass klass)
 {
   switch (klass) {
@@ -94,10 +156,22 @@ static const char *encoderClassName(EncoderClass klass)
     return "Hextile";
   case encoderTight:
     return "Tight";
+  case encoderTightIndependent:
+    return "Tight (independent)";
   case encoderTightJPEG:
     return "Tight (JPEG)";
+#ifdef HAVE_ZSTD
+  case encoderTightZstd:
+    return "TightZstd";
+  case encoderTightZstdIndependent:
+    return "TightZstd (independent)";
+#endif
   case encoderZRLE:
     return "ZRLE";
+#ifdef HAVE_LZ4
+  case encoderLZ4:
+    return "LZ4";
+#endif
   case encoderClassMax:
     break;
   }
@@ -127,23 +201,30 @@ static const char *encoderTypeName(EncoderType type)
   return "Unknown Encoder Type";
 }
 
+int EncodeManager::managerCount = 0;
+std::list<EncodeManager::EncodeThread*> EncodeManager::threads;
+std::list<EncodeManager::QueueEntry*> EncodeManager::pendingEntries;
+os::Mutex* EncodeManager::queueMutex = NULL;
+os::Condition* EncodeManager::consumerCond = NULL;
+
 EncodeManager::EncodeManager(SConnection* conn_)
-  : conn(conn_), recentChangeTimer(this)
+  : conn(conn_), recentChangeTimer(this), threadException(NULL),
+    shm(NULL), encodeCache(NULL), useEncodeCache(false),
+    highBandwidth(false), bandwidth(0),
+    encodeMode(EncodeController::modeNormal)
 {
   StatsVector::iterator iter;
 
   encoders.resize(encoderClassMax, NULL);
   activeEncoders.resize(encoderTypeMax, encoderRaw);
 
-  encoders[encoderRaw] = new RawEncoder(conn);
-  encoders[encoderRRE] = new RREEncoder(conn);
-  encoders[encoderHextile] = new HextileEncoder(conn);
-  encoders[encoderTight] = new TightEncoder(conn);
-  encoders[encoderTightJPEG] = new TightJPEGEncoder(conn);
-  encoders[encoderZRLE] = new ZRLEEncoder(conn);
+  for (int klass = 0; klass < encoderClassMax; klass++)
+    encoders[klass] = createEncoder(klass);
 
   updates = 0;
   memset(&copyStats, 0, sizeof(copyStats));
+  memset(&shmStats, 0, sizeof(shmStats));
+  memset(&cacheStats, 0, sizeof(cacheStats));
   stats.resize(encoderClassMax);
   for (iter = stats.begin();iter != stats.end();++iter) {
     StatsVector::value_type::iterator iter2;
@@ -151,6 +232,48 @@ EncodeManager::EncodeManager(SConnection* conn_)
     for (iter2 = iter->begin();iter2 != iter->end();++iter2)
       memset(&*iter2, 0, sizeof(EncoderStats));
   }
+
+  tileCache = new TileCacheEncoder(conn);
+
+  if (managerCount++ == 0)
+    startThreads();
+
+  producerCond = new os::Condition(queueMutex);
+
+  queueSize = 0;
+
+  // No more rects can be encoded at once than there are threads. Each
+  // set gets a Tight encoder with a zlib stream of its own, and there
+  // are three streams to spare, as the last one is used by the
+  // independent encoder.
+  threadEncoders.resize(threads.size() < 3 ? threads.size() : 3);
+  for (size_t i = 0; i < threadEncoders.size(); i++) {
+    threadEncoders[i].resize(encoderClassMax, NULL);
+    for (int klass = 0; klass < encoderClassMax; klass++) {
+      Encoder *encoder;
+
+      encoder = createEncoder(klass);
+      if (klass == encoderTight) {
+        ((TightEncoder*)encoder)->setStream(i);
+        threadEncoders[i][klass] = encoder;
+      } else if (encoder->flags & EncoderStateless)
+        threadEncoders[i][klass] = encoder;
+      else
+        delete encoder;
+    }
+    freeThreadEncoders.push_back(&threadEncoders[i]);
+
+    // Twice as many possible entries in the queue as there
+    // are worker threads to make sure they don't stall
+    for (int j = 0; j < 2; j++) {
+      QueueEntry* entry;
+
+      entry = new QueueEntry;
+      entry->manager = this;
+      freeEntries.push_back(entry);
+    }
+    queueSize += 2;
+  }
 }
 
 EncodeManager::~EncodeManager()
@@ -159,8 +282,33 @@ EncodeManager::~EncodeManager()
 
   logStats();
 
+  delete threadException;
+
+  while (!freeEntries.empty()) {
+    delete freeEntries.back();
+    freeEntries.pop_back();
+  }
+
+  for (size_t i = 0; i < threadEncoders.size(); i++) {
+    for (iter = threadEncoders[i].begin();
+         iter != threadEncoders[i].end(); iter++)
+      delete *iter;
+  }
+
+  delete producerCond;
+
+  if (--managerCount == 0)
+    stopThreads();
+
   for (iter = encoders.begin();iter != encoders.end();iter++)
     delete *iter;
+
+  delete tileCache;
+
+  delete shm;
+
+  if (encodeCache != NULL)
+    encodeCache->removeClient(this);
 }
 
 void EncodeManager::logStats()
@@ -198,6 +346,44 @@ void EncodeManager::logStats()
               a, ratio);
   }
 
+  if (shmStats.rects != 0) {
+    vlog.info("  %s:", "SharedMemory");
+
+    rects += shmStats.rects;
+    pixels += shmStats.pixels;
+    bytes += shmStats.bytes;
+    equivalent += shmStats.equivalent;
+
+    ratio = (double)shmStats.equivalent / shmStats.bytes;
+
+    siPrefix(shmStats.rects, "rects", a, sizeof(a));
+    siPrefix(shmStats.pixels, "pixels", b, sizeof(b));
+    vlog.info("    %s: %s, %s", "Updates", a, b);
+    iecPrefix(shmStats.bytes, "B", a, sizeof(a));
+    vlog.info("    %*s  %s (1:%g ratio)",
+              (int)strlen("Updates"), "",
+              a, ratio);
+  }
+
+  if (cacheStats.rects != 0) {
+    vlog.info("  %s:", "TileCache");
+
+    rects += cacheStats.rects;
+    pixels += cacheStats.pixels;
+    bytes += cacheStats.bytes;
+    equivalent += cacheStats.equivalent;
+
+    ratio = (double)cacheStats.equivalent / cacheStats.bytes;
+
+    siPrefix(cacheStats.rects, "rects", a, sizeof(a));
+    siPrefix(cacheStats.pixels, "pixels", b, sizeof(b));
+    vlog.info("    %s: %s, %s", "Tiles", a, b);
+    iecPrefix(cacheStats.bytes, "B", a, sizeof(a));
+    vlog.info("    %*s  %s (1:%g ratio)",
+              (int)strlen("Tiles"), "",
+              a, ratio);
+  }
+
   for (i = 0;i < stats.size();i++) {
     // Did this class do anything at all?
     for (j = 0;j < stats[i].size();j++) {
@@ -224,9 +410,9 @@ void EncodeManager::logStats()
       siPrefix(stats[i][j].pixels, "pixels", b, sizeof(b));
       vlog.info("    %s: %s, %s", encoderTypeName((EncoderType)j), a, b);
       iecPrefix(stats[i][j].bytes, "B", a, sizeof(a));
-      vlog.info("    %*s  %s (1:%g ratio)",
+      vlog.info("    %*s  %s (1:%g ratio), %g ms",
                 (int)strlen(encoderTypeName((EncoderType)j)), "",
-                a, ratio);
+                a, ratio, stats[i][j].time / 1000.0);
     }
   }
 
@@ -237,6 +423,40 @@ void EncodeManager::logStats()
   vlog.info("  Total: %s, %s", a, b);
   iecPrefix(bytes, "B", a, sizeof(a));
   vlog.info("         %s (1:%g ratio)", a, ratio);
+
+  controller.logStats();
+}
+
+Encoder* EncodeManager::createEncoder(int klass)
+{
+  switch (klass) {
+  case encoderRaw:
+    return new RawEncoder(conn);
+  case encoderRRE:
+    return new RREEncoder(conn);
+  case encoderHextile:
+    return new HextileEncoder(conn);
+  case encoderTight:
+    return new TightEncoder(conn);
+  case encoderTightIndependent:
+    return new TightEncoder(conn, true);
+  case encoderTightJPEG:
+    return new TightJPEGEncoder(conn);
+#ifdef HAVE_ZSTD
+  case encoderTightZstd:
+    return new TightZstdEncoder(conn);
+  case encoderTightZstdIndependent:
+    return new TightZstdEncoder(conn, true);
+#endif
+  case encoderZRLE:
+    return new ZRLEEncoder(conn);
+#ifdef HAVE_LZ4
+  case encoderLZ4:
+    return new LZ4Encoder(conn);
+#endif
+  }
+
+  return NULL;
 }
 
 bool EncodeManager::supported(int encoding)
@@ -247,6 +467,12 @@ bool EncodeManager::supported(int encoding)
   case encodingHextile:
   case encodingZRLE:
   case encodingTight:
+#ifdef HAVE_ZSTD
+  case encodingTightZstd:
+#endif
+#ifdef HAVE_LZ4
+  case encodingLZ4:
+#endif
     return true;
   default:
     return false;
@@ -276,11 +502,72 @@ void EncodeManager::pruneLosslessRefresh(const Region& limits)
   pendingRefreshRegion.assign_intersect(limits);
 }
 
+void EncodeManager::setSharedMemory(SharedMemory* shm_)
+{
+  delete shm;
+  shm = shm_;
+}
+
+void EncodeManager::setEncodeCache(EncodeCache* cache)
+{
+  if (encodeCache != NULL)
+    encodeCache->removeClient(this);
+  encodeCache = cache;
+}
+
+void EncodeManager::setBandwidth(size_t bandwidth)
+{
+  size_t threshold;
+
+  this->bandwidth = bandwidth;
+
+  // Server::lz4Bandwidth is in kbit/s
+  threshold = (size_t)Server::lz4Bandwidth * 1000 / 8;
+
+  if (threshold == 0) {
+    highBandwidth = false;
+    return;
+  }
+
+  // Some hysteresis to avoid flipping back and forth
+  if (!highBandwidth && (bandwidth >= threshold)) {
+    vlog.debug("Bandwidth estimate %d kbit/s, switching to fast encoding",
+               (int)(bandwidth * 8 / 1000));
+    highBandwidth = true;
+  } else if (highBandwidth && (bandwidth < threshold / 2)) {
+    vlog.debug("Bandwidth estimate %d kbit/s, switching to normal encoding",
+               (int)(bandwidth * 8 / 1000));
+    highBandwidth = false;
+  }
+}
+
 void EncodeManager::writeUpdate(const UpdateInfo& ui, const PixelBuffer* pb,
                                 const RenderedCursor* renderedCursor)
 {
+  int beforeUpdate;
+
+  encodeMode = EncodeController::modeNormal;
+  if (Server::adaptiveEncoding) {
+    updateEncodeModes();
+    encodeMode = controller.selectMode(bandwidth);
+  }
+
+  updatePixels = updateTime = updateThreadTime = 0;
+  beforeUpdate = conn->getOutStream()->length();
+
   doUpdate(true, ui.changed, ui.copied, ui.copy_delta, pb, renderedCursor);
 
+  // The time on the worker threads is spread over as many rects as
+  // we can have in progress, so this approximates how long it would
+  // take if they were all busy
+  if (Server::adaptiveEncoding) {
+    if (!threadEncoders.empty())
+      updateTime += updateThreadTime / threadEncoders.size();
+    controller.recordUpdate(encodeMode, updatePixels,
+                            conn->getOutStream()->length() - beforeUpdate,
+                            updateTime);
+  }
+
   recentlyChangedRegion.assign_union(ui.changed);
   recentlyChangedRegion.assign_union(ui.copied);
   if (!recentChangeTimer.isStarted())
@@ -291,6 +578,8 @@ void EncodeManager::writeLosslessRefresh(const Region& req, const PixelBuffer* p
                                          const RenderedCursor* renderedCursor,
                                          size_t maxUpdateSize)
 {
+  encodeMode = EncodeController::modeNormal;
+
   doUpdate(false, getLosslessRefresh(req, maxUpdateSize),
            Region(), Point(), pb, renderedCursor);
 }
@@ -321,10 +610,33 @@ void EncodeManager::doUpdate(bool allowLossy, const Region& changed_,
 
     updates++;
 
-    prepareEncoders(allowLossy);
-
     changed = changed_;
 
+    if (canUseSharedMemory()) {
+      // Copies are just as cheap to do through the segment, and doing
+      // so avoids depending on the client's framebuffer being in sync
+      // with the segment
+      changed.assign_union(copied);
+
+      if (renderedCursor != NULL) {
+        cursorRegion = changed.intersect(renderedCursor->getEffectiveRect());
+        changed.assign_subtract(renderedCursor->getEffectiveRect());
+      }
+
+      nRects = changed.numRects() + cursorRegion.numRects();
+
+      conn->writer()->writeFramebufferUpdateStart(nRects);
+
+      writeSharedMemoryRects(changed, pb);
+      writeSharedMemoryRects(cursorRegion, renderedCursor);
+
+      conn->writer()->writeFramebufferUpdateEnd();
+
+      return;
+    }
+
+    prepareEncoders(allowLossy);
+
     /*
      * We need to render the cursor seperately as it has its own
      * magical pixel buffer, so split it out from the changed region.
@@ -334,18 +646,37 @@ void EncodeManager::doUpdate(bool allowLossy, const Region& changed_,
       changed.assign_subtract(renderedCursor->getEffectiveRect());
     }
 
+    /*
+     * Tiles that the client already has are removed from the changed
+     * region, and the remaining ones are added to its cache once they
+     * have been sent.
+     */
+    cacheHits.clear();
+    cacheMisses.clear();
+    cacheLateHits.clear();
+    if (canUseTileCache())
+      findCachedTiles(&changed, pb, allowLossy);
+
     if (conn->cp.supportsLastRect)
       nRects = 0xFFFF;
     else {
       nRects = copied.numRects();
       nRects += computeNumRects(changed);
       nRects += computeNumRects(cursorRegion);
+      nRects += cacheHits.size() + cacheMisses.size() + cacheLateHits.size();
+      if (tileCache->needFlush())
+        nRects++;
     }
 
     conn->writer()->writeFramebufferUpdateStart(nRects);
 
+    if (tileCache->needFlush())
+      tileCache->writeFlush();
+
     writeCopyRects(copied, copyDelta);
 
+    writeCachedTiles(cacheHits);
+
     /*
      * We start by searching for solid rects, which are then removed
      * from the changed region.
@@ -356,6 +687,11 @@ void EncodeManager::doUpdate(bool allowLossy, const Region& changed_,
     writeRects(changed, pb);
     writeRects(cursorRegion, renderedCursor);
 
+    // Identical tiles in this update can only be referenced once the
+    // first one has been stored
+    storeCachedTiles(cacheMisses, pb);
+    writeCachedTiles(cacheLateHits);
+
     conn->writer()->writeFramebufferUpdateEnd();
 }
 
@@ -373,6 +709,23 @@ void EncodeManager::prepareEncoders(bool allowLossy)
   solid = bitmap = bitmapRLE = encoderRaw;
   indexed = indexedRLE = fullColour = encoderRaw;
 
+  compressLevel = conn->cp.compressLevel;
+  qualityLevel = conn->cp.qualityLevel;
+  fineQualityLevel = conn->cp.fineQualityLevel;
+
+  switch (encodeMode) {
+  case EncodeController::modeFastCompress:
+    compressLevel = 1;
+    break;
+  case EncodeController::modeLowQuality:
+    qualityLevel = __rfbmax(qualityLevel - 3, 0);
+    if (fineQualityLevel != -1)
+      fineQualityLevel = __rfbmax(fineQualityLevel - 30, 0);
+    break;
+  default:
+    break;
+  }
+
   allowJPEG = conn->cp.pf().bpp >= 16;
   if (!allowLossy) {
     if (encoders[encoderTightJPEG]->losslessQuality == -1)
@@ -398,6 +751,16 @@ void EncodeManager::prepareEncoders(bool allowLossy)
     indexed = indexedRLE = encoderTight;
     bitmap = bitmapRLE = encoderTight;
     break;
+#ifdef HAVE_ZSTD
+  case encodingTightZstd:
+    if (encoders[encoderTightJPEG]->isSupported() && allowJPEG)
+      fullColour = encoderTightJPEG;
+    else
+      fullColour = encoderTightZstd;
+    indexed = indexedRLE = encoderTightZstd;
+    bitmap = bitmapRLE = encoderTightZstd;
+    break;
+#endif
   case encodingZRLE:
     fullColour = encoderZRLE;
     bitmapRLE = indexedRLE = encoderZRLE;
@@ -410,6 +773,10 @@ void EncodeManager::prepareEncoders(bool allowLossy)
   if (fullColour == encoderRaw) {
     if (encoders[encoderTightJPEG]->isSupported() && allowJPEG)
       fullColour = encoderTightJPEG;
+#ifdef HAVE_ZSTD
+    else if (encoders[encoderTightZstd]->isSupported())
+      fullColour = encoderTightZstd;
+#endif
     else if (encoders[encoderZRLE]->isSupported())
       fullColour = encoderZRLE;
     else if (encoders[encoderTight]->isSupported())
@@ -419,6 +786,11 @@ void EncodeManager::prepareEncoders(bool allowLossy)
   }
 
   if (indexed == encoderRaw) {
+#ifdef HAVE_ZSTD
+    if (encoders[encoderTightZstd]->isSupported())
+      indexed = encoderTightZstd;
+    else
+#endif
     if (encoders[encoderZRLE]->isSupported())
       indexed = encoderZRLE;
     else if (encoders[encoderTight]->isSupported())
@@ -438,6 +810,10 @@ void EncodeManager::prepareEncoders(bool allowLossy)
   if (solid == encoderRaw) {
     if (encoders[encoderTight]->isSupported())
       solid = encoderTight;
+#ifdef HAVE_ZSTD
+    else if (encoders[encoderTightZstd]->isSupported())
+      solid = encoderTightZstd;
+#endif
     else if (encoders[encoderRRE]->isSupported())
       solid = encoderRRE;
     else if (encoders[encoderZRLE]->isSupported())
@@ -446,6 +822,18 @@ void EncodeManager::prepareEncoders(bool allowLossy)
       solid = encoderHextile;
   }
 
+#ifdef HAVE_LZ4
+  // On fast enough links it is the time spent encoding that limits
+  // us, so skip all the analysis and compress the pixels as they are
+  if (encoders[encoderLZ4]->isSupported() &&
+      ((preferred == encodingLZ4) ||
+       (encodeMode == EncodeController::modeLZ4) ||
+       (!Server::adaptiveEncoding && highBandwidth))) {
+    bitmap = bitmapRLE = encoderLZ4;
+    indexed = indexedRLE = fullColour = encoderLZ4;
+  }
+#endif
+
   // JPEG is the only encoder that can reduce things to grayscale
   if ((conn->cp.subsampling == subsampleGray) &&
       encoders[encoderTightJPEG]->isSupported() && allowLossy) {
@@ -460,26 +848,79 @@ void EncodeManager::prepareEncoders(bool allowLossy)
   activeEncoders[encoderIndexedRLE] = indexedRLE;
   activeEncoders[encoderFullColour] = fullColour;
 
-  for (iter = activeEncoders.begin(); iter != activeEncoders.end(); ++iter) {
-    Encoder *encoder;
+  // The normal Tight encoder continues its zlib streams from one rect
+  // to the next, so its output cannot be used by other clients
+  useEncodeCache = false;
+  if ((encodeCache != NULL) && encodeCache->isActive()) {
+    encodeCacheSettings.pf = conn->cp.pf();
+    encodeCacheSettings.encoders = activeEncoders;
+    encodeCacheSettings.compressLevel = compressLevel;
+    encodeCacheSettings.qualityLevel = qualityLevel;
+    encodeCacheSettings.fineQualityLevel = fineQualityLevel;
+    encodeCacheSettings.subsampling = conn->cp.subsampling;
+    encodeCacheSettings.allowLossy = allowLossy;
+
+    for (iter = encodeCacheSettings.encoders.begin();
+         iter != encodeCacheSettings.encoders.end(); ++iter) {
+      if (*iter == encoderTight)
+        *iter = encoderTightIndependent;
+#ifdef HAVE_ZSTD
+      if (*iter == encoderTightZstd)
+        *iter = encoderTightZstdIndependent;
+#endif
+    }
 
-    encoder = encoders[*iter];
+    // No point in losing compression unless another client has the
+    // same settings and can reuse what we encode
+    if (encodeCache->setClientSettings(this, encodeCacheSettings)) {
+      activeEncoders = encodeCacheSettings.encoders;
+      useEncodeCache = true;
+    }
+  }
 
-    encoder->setCompressLevel(conn->cp.compressLevel);
+  for (iter = activeEncoders.begin(); iter != activeEncoders.end(); ++iter) {
+    configureEncoder(encoders[*iter], allowLossy);
 
-    if (allowLossy) {
-      encoder->setQualityLevel(conn->cp.qualityLevel);
-      encoder->setFineQualityLevel(conn->cp.fineQualityLevel,
-                                   conn->cp.subsampling);
-    } else {
-      int level = __rfbmax(conn->cp.qualityLevel,
-                           encoder->losslessQuality);
-      encoder->setQualityLevel(level);
-      encoder->setFineQualityLevel(-1, subsampleUndefined);
+    for (size_t i = 0; i < threadEncoders.size(); i++) {
+      if (threadEncoders[i][*iter] != NULL)
+        configureEncoder(threadEncoders[i][*iter], allowLossy);
     }
   }
 }
 
+void EncodeManager::updateEncodeModes()
+{
+  bool lossy;
+
+  controller.setAvailable(EncodeController::modeFastCompress,
+                          (conn->cp.compressLevel == -1) ||
+                          (conn->cp.compressLevel > 1));
+
+  // Only if the client is already fine with JPEG
+  lossy = (conn->cp.qualityLevel > 0) && (conn->cp.pf().bpp >= 16) &&
+          encoders[encoderTightJPEG]->isSupported();
+  controller.setAvailable(EncodeController::modeLowQuality, lossy);
+
+#ifdef HAVE_LZ4
+  controller.setAvailable(EncodeController::modeLZ4,
+                          encoders[encoderLZ4]->isSupported());
+#endif
+}
+
+void EncodeManager::configureEncoder(Encoder* encoder, bool allowLossy)
+{
+  encoder->setCompressLevel(compressLevel);
+
+  if (allowLossy) {
+    encoder->setQualityLevel(qualityLevel);
+    encoder->setFineQualityLevel(fineQualityLevel, conn->cp.subsampling);
+  } else {
+    int level = __rfbmax(qualityLevel, encoder->losslessQuality);
+    encoder->setQualityLevel(level);
+    encoder->setFineQualityLevel(-1, subsampleUndefined);
+  }
+}
+
 Region EncodeManager::getLosslessRefresh(const Region& req,
                                          size_t maxUpdateSize)
 {
@@ -572,9 +1013,11 @@ Encoder *EncodeManager::startRect(const Rect& rect, int type)
   klass = activeEncoders[activeType];
 
   beforeLength = conn->getOutStream()->length();
+  gettimeofday(&rectStart, NULL);
 
   stats[klass][activeType].rects++;
   stats[klass][activeType].pixels += rect.area();
+  updatePixels += rect.area();
   equiv = 12 + rect.area() * (conn->cp.pf().bpp/8);
   stats[klass][activeType].equivalent += equiv;
 
@@ -595,17 +1038,26 @@ Encoder *EncodeManager::startRect(const Rect& rect, int type)
   return encoder;
 }
 
-void EncodeManager::endRect()
+// The extra time is for work done on the rect before startRect(),
+// e.g. analysing it, and the thread time for such work done on one of
+// the worker threads
+void EncodeManager::endRect(unsigned extraTime, unsigned threadTime)
 {
   int klass;
   int length;
+  unsigned time;
 
   conn->writer()->endRect();
 
   length = conn->getOutStream()->length() - beforeLength;
+  time = usSince(&rectStart) + extraTime;
 
   klass = activeEncoders[activeType];
   stats[klass][activeType].bytes += length;
+  stats[klass][activeType].time += time + threadTime;
+
+  updateTime += time;
+  updateThreadTime += threadTime;
 }
 
 void EncodeManager::writeCopyRects(const Region& copied, const Point& delta)
@@ -642,6 +1094,216 @@ void EncodeManager::writeCopyRects(const Region& copied, const Point& delta)
   pendingRefreshRegion.assign_subtract(copied);
 }
 
+bool EncodeManager::canUseSharedMemory()
+{
+  if (shm == NULL)
+    return false;
+
+  // The client replaces the segment when the framebuffer grows, so
+  // fall back to normal encodings until we hear about the new one
+  return (shm->width() >= conn->cp.width) &&
+         (shm->height() >= conn->cp.height);
+}
+
+void EncodeManager::writeSharedMemoryRects(const Region& changed,
+                                           const PixelBuffer* pb)
+{
+  std::vector<Rect> rects;
+  std::vector<Rect>::const_iterator rect;
+
+  beforeLength = conn->getOutStream()->length();
+
+  changed.get_rects(&rects);
+  for (rect = rects.begin(); rect != rects.end(); ++rect) {
+    rdr::U8* buffer;
+    int stride;
+    int equiv;
+
+    shmStats.rects++;
+    shmStats.pixels += rect->area();
+    equiv = 12 + rect->area() * (conn->cp.pf().bpp/8);
+    shmStats.equivalent += equiv;
+
+    // The data must be in place before the client hears about it
+    buffer = shm->getBuffer(*rect, conn->cp.pf(), &stride);
+    pb->getImage(conn->cp.pf(), buffer, *rect, stride);
+
+    conn->writer()->writeSharedMemoryDataRect(*rect, shm->getId());
+  }
+
+  shmStats.bytes += conn->getOutStream()->length() - beforeLength;
+
+  // Everything sent this way is lossless
+  lossyRegion.assign_subtract(changed);
+  pendingRefreshRegion.assign_subtract(changed);
+}
+
+bool EncodeManager::canUseTileCache()
+{
+  return conn->cp.supportsTileCache && rfb::Server::tileCache;
+}
+
+static bool samePixels(const Rect& a, const Rect& b, const PixelBuffer* pb)
+{
+  const rdr::U8 *dataA, *dataB;
+  int strideA, strideB, bytesPerPixel;
+
+  if ((a.width() != b.width()) || (a.height() != b.height()))
+    return false;
+
+  bytesPerPixel = pb->getPF().bpp/8;
+
+  dataA = pb->getBuffer(a, &strideA);
+  dataB = pb->getBuffer(b, &strideB);
+  for (int y = 0; y < a.height(); y++) {
+    if (memcmp(dataA, dataB, a.width() * bytesPerPixel) != 0)
+      return false;
+    dataA += strideA * bytesPerPixel;
+    dataB += strideB * bytesPerPixel;
+  }
+
+  return true;
+}
+
+void EncodeManager::findCachedTiles(Region *changed, const PixelBuffer* pb,
+                                    bool allowLossy)
+{
+  std::vector<Rect> rects;
+  std::vector<Rect>::const_iterator rect;
+  std::set<rdr::U32> seen;
+  Region cached;
+  std::map<rdr::U64, Rect> pending;
+
+  bool needFlush;
+
+  // Everything will be thrown away, so there is nothing to find
+  needFlush = tileCache->needFlush();
+
+  // Only the tiles that the changed region touches are looked at, and
+  // only whole ones get hashed
+  changed->get_rects(&rects);
+  for (rect = rects.begin(); rect != rects.end(); ++rect) {
+    int startX, startY;
+
+    startX = rect->tl.x - rect->tl.x % tileCacheTileSize;
+    startY = rect->tl.y - rect->tl.y % tileCacheTileSize;
+
+    for (int y = startY; y < rect->br.y; y += tileCacheTileSize) {
+      for (int x = startX; x < rect->br.x; x += tileCacheTileSize) {
+        Rect tile;
+        const rdr::U8* data;
+        int stride;
+        rdr::U64 key;
+        bool lossy;
+        std::map<rdr::U64, Rect>::const_iterator iter;
+
+        // A tile can span several of the region's rects
+        if (!seen.insert((rdr::U32)(y / tileCacheTileSize) << 16 |
+                         (x / tileCacheTileSize)).second)
+          continue;
+
+        tile.setXYWH(x, y, tileCacheTileSize, tileCacheTileSize);
+        tile = tile.intersect(pb->getRect());
+        if (tile.is_empty())
+          continue;
+
+        // Only whole tiles, or they would never match
+        if (!Region(tile).subtract(*changed).is_empty())
+          continue;
+
+        data = pb->getBuffer(tile, &stride);
+
+        // Solid tiles are cheaper to send as they are
+        if (checkSolidTile(tile, data, pb))
+          continue;
+
+        key = hashTile(data, tile.width(), tile.height(), stride,
+                       pb->getPF().bpp/8);
+
+        CachedTile entry = { tile, key };
+
+        // The key is only a hash, so nothing is referenced without
+        // comparing the actual pixels first
+        iter = pending.find(key);
+        if (iter != pending.end()) {
+          // A different tile with the same key can't be stored in this
+          // update, so just send it as it is
+          if (!samePixels(iter->second, tile, pb))
+            continue;
+          cacheLateHits.push_back(entry);
+          cached.assign_union(Region(tile));
+          continue;
+        }
+
+        if (!needFlush && tileCache->lookup(key, &lossy) &&
+            (allowLossy || !lossy) && tileCache->matches(key, tile, pb)) {
+          cacheHits.push_back(entry);
+          cached.assign_union(Region(tile));
+          continue;
+        }
+
+        // Storing too many tiles would evict the ones we want to
+        // reference later in this update
+        if (cacheMisses.size() >= (size_t)tileCacheMaxEntries / 2)
+          continue;
+
+        pending[key] = tile;
+        cacheMisses.push_back(entry);
+      }
+    }
+  }
+
+  changed->assign_subtract(cached);
+}
+
+void EncodeManager::writeCachedTiles(const std::vector<CachedTile>& tiles)
+{
+  std::vector<CachedTile>::const_iterator tile;
+
+  beforeLength = conn->getOutStream()->length();
+
+  for (tile = tiles.begin(); tile != tiles.end(); ++tile) {
+    bool lossy;
+
+    cacheStats.rects++;
+    cacheStats.pixels += tile->rect.area();
+    cacheStats.equivalent += 12 + tile->rect.area() * (conn->cp.pf().bpp/8);
+
+    if (!tileCache->lookup(tile->key, &lossy))
+      throw Exception("Tile cache is out of sync");
+
+    tileCache->writeReference(tile->rect, tile->key);
+
+    // The client gets whatever it had before, so keep track of it
+    // the same way as when it was first sent
+    if (lossy)
+      lossyRegion.assign_union(Region(tile->rect));
+    else
+      lossyRegion.assign_subtract(Region(tile->rect));
+    pendingRefreshRegion.assign_subtract(Region(tile->rect));
+  }
+
+  cacheStats.bytes += conn->getOutStream()->length() - beforeLength;
+}
+
+void EncodeManager::storeCachedTiles(const std::vector<CachedTile>& tiles,
+                                    const PixelBuffer* pb)
+{
+  std::vector<CachedTile>::const_iterator tile;
+
+  beforeLength = conn->getOutStream()->length();
+
+  for (tile = tiles.begin(); tile != tiles.end(); ++tile) {
+    bool lossy;
+
+    lossy = !lossyRegion.intersect(Region(tile->rect)).is_empty();
+
+    tileCache->writeStore(tile->rect, tile->key, lossy, pb);
+  }
+
+  cacheStats.bytes += conn->getOutStream()->length() - beforeLength;
+}
+
 void EncodeManager::writeSolidRects(Region *changed, const PixelBuffer* pb)
 {
   std::vector<Rect> rects;
@@ -751,7 +1413,7 @@ void EncodeManager::findSolidRect(const Rect& rect, Region *changed,
 
 void EncodeManager::writeRects(const Region& changed, const PixelBuffer* pb)
 {
-  std::vector<Rect> rects;
+  std::vector<Rect> rects, subRects;
   std::vector<Rect>::const_iterator rect;
 
   changed.get_rects(&rects);
@@ -764,7 +1426,7 @@ void EncodeManager::writeRects(const Region& changed, const PixelBuffer* pb)
 
     // No split necessary?
     if (((w*h) < SubRectMaxArea) && (w < SubRectMaxWidth)) {
-      writeSubRect(*rect, pb);
+      subRects.push_back(*rect);
       continue;
     }
 
@@ -785,10 +1447,59 @@ void EncodeManager::writeRects(const Region& changed, const PixelBuffer* pb)
         if (sr.br.x > rect->br.x)
           sr.br.x = rect->br.x;
 
-        writeSubRect(sr, pb);
+        subRects.push_back(sr);
       }
     }
   }
+
+  if (threads.empty()) {
+    for (rect = subRects.begin(); rect != subRects.end(); ++rect)
+      writeSubRect(*rect, pb);
+    return;
+  }
+
+  // The sub-rects are independent of each other, so they can be
+  // analysed and encoded in parallel and then sent in order
+  try {
+    for (rect = subRects.begin(); rect != subRects.end(); ++rect)
+      queueSubRect(*rect, pb);
+
+    flushQueue(0);
+  } catch (...) {
+    discardQueue();
+    throw;
+  }
+}
+
+static int sliceHeight(int width)
+{
+  int sh;
+
+  sh = Server::jpegSliceArea / width;
+  sh -= sh % SliceAlignment;
+  if (sh < SliceAlignment)
+    sh = SliceAlignment;
+
+  return sh;
+}
+
+// sliceRect() splits a rect in to horizontal slices of roughly
+// JPEGSliceArea pixels. Each slice becomes a separate JPEG image.
+void EncodeManager::sliceRect(const Rect& rect, std::vector<Rect>* slices)
+{
+  int sh;
+  Rect sr;
+
+  sh = sliceHeight(rect.width());
+
+  sr = rect;
+  for (sr.tl.y = rect.tl.y; sr.tl.y < rect.br.y; sr.tl.y += sh) {
+    sr.br.y = sr.tl.y + sh;
+    if (sr.br.y > rect.br.y)
+      sr.br.y = rect.br.y;
+
+    slices->push_back(sr);
+  }
 }
 
 void EncodeManager::writeSubRect(const Rect& rect, const PixelBuffer *pb)
@@ -798,6 +1509,82 @@ void EncodeManager::writeSubRect(const Rect& rect, const PixelBuffer *pb)
   Encoder *encoder;
 
   struct RectInfo info;
+  int type;
+
+  struct timeval start;
+  unsigned analyseTime;
+
+  if (writeSharedRect(rect, pb))
+    return;
+
+  gettimeofday(&start, NULL);
+
+  ppb = preparePixelBuffer(rect, pb, true);
+
+  type = selectEncoderType(rect, ppb, &info);
+
+  analyseTime = usSince(&start);
+
+  encoder = startRect(rect, type);
+
+  if (encoder->flags & EncoderUseNativePF)
+    ppb = preparePixelBuffer(rect, pb, false);
+
+  if (!useEncodeCache || !(encoder->flags & EncoderStateless)) {
+    encoder->writeRect(ppb, info.palette);
+    endRect(analyseTime);
+    return;
+  }
+
+  // Encode to the side so that other clients can have a copy
+  encodeCacheStream.clear();
+
+  encoder->setOutStream(&encodeCacheStream);
+  try {
+    encoder->writeRect(ppb, info.palette);
+  } catch (...) {
+    encoder->setOutStream(NULL);
+    throw;
+  }
+  encoder->setOutStream(NULL);
+
+  encodeCache->store(encodeCacheSettings, pb, rect, type,
+                     (const rdr::U8*)encodeCacheStream.data(),
+                     encodeCacheStream.length());
+
+  conn->getOutStream()->writeBytes(encodeCacheStream.data(),
+                                   encodeCacheStream.length());
+
+  endRect(analyseTime);
+}
+
+bool EncodeManager::writeSharedRect(const Rect& rect, const PixelBuffer *pb)
+{
+  const rdr::U8* data;
+  size_t length;
+  int type;
+
+  if (!useEncodeCache)
+    return false;
+
+  data = encodeCache->lookup(encodeCacheSettings, pb, rect,
+                             &type, &length);
+  if (data == NULL)
+    return false;
+
+  startRect(rect, type);
+  conn->getOutStream()->writeBytes(data, length);
+  endRect();
+
+  return true;
+}
+
+int EncodeManager::selectEncoderType(const Rect& rect,
+                                     const PixelBuffer *ppb,
+                                     struct RectInfo *info)
+{
+  Encoder *encoder;
+
   unsigned int divisor, maxColours;
 
   bool useRLE;
@@ -808,10 +1595,10 @@ void EncodeManager::writeSubRect(const Rect& rect, const PixelBuffer *pb)
   //        compression setting means spending less effort in building
   //        a palette. It might be that they figured the increase in
   //        zlib setting compensated for the loss.
-  if (conn->cp.compressLevel == -1)
+  if (compressLevel == -1)
     divisor = 2 * 8;
   else
-    divisor = conn->cp.compressLevel * 8;
+    divisor = compressLevel * 8;
   if (divisor < 4)
     divisor = 4;
 
@@ -819,7 +1606,7 @@ void EncodeManager::writeSubRect(const Rect& rect, const PixelBuffer *pb)
 
   // Special exception inherited from the Tight encoder
   if (activeEncoders[encoderFullColour] == encoderTightJPEG) {
-    if ((conn->cp.compressLevel != -1) && (conn->cp.compressLevel < 2))
+    if ((compressLevel != -1) && (compressLevel < 2))
       maxColours = 24;
     else
       maxColours = 96;
@@ -835,17 +1622,15 @@ void EncodeManager::writeSubRect(const Rect& rect, const PixelBuffer *pb)
   if (maxColours > encoder->maxPaletteSize)
     maxColours = encoder->maxPaletteSize;
 
-  ppb = preparePixelBuffer(rect, pb, true);
-
-  if (!analyseRect(ppb, &info, maxColours))
-    info.palette.clear();
+  if (!analyseRect(ppb, info, maxColours))
+    info->palette.clear();
 
   // Different encoders might have different RLE overhead, but
   // here we do a guess at RLE being the better choice if reduces
   // the pixel count by 50%.
-  useRLE = info.rleRuns <= (rect.area() * 2);
+  useRLE = info->rleRuns <= (rect.area() * 2);
 
-  switch (info.palette.size()) {
+  switch (info->palette.size()) {
   case 0:
     type = encoderFullColour;
     break;
@@ -865,14 +1650,294 @@ void EncodeManager::writeSubRect(const Rect& rect, const PixelBuffer *pb)
       type = encoderIndexed;
   }
 
-  encoder = startRect(rect, type);
+  return type;
+}
+
+void EncodeManager::queueSubRect(const Rect& rect, const PixelBuffer *pb)
+{
+  QueueEntry *entry;
+
+  // Make sure there is a free entry, sending off anything that has
+  // been finished in the mean time
+  flushQueue(queueSize - 1);
+
+  queueMutex->lock();
+
+  entry = freeEntries.front();
+  freeEntries.pop_front();
+
+  entry->active = false;
+  entry->done = false;
+  entry->rect = rect;
+  entry->pb = pb;
+  entry->typeKnown = false;
+  entry->needSlices = false;
+
+  entry->sharedData = NULL;
+  entry->encodeTime = 0;
+  if (useEncodeCache)
+    entry->sharedData = encodeCache->lookup(encodeCacheSettings, pb, rect,
+                                            &entry->type,
+                                            &entry->sharedLength);
+
+  // Nothing for the threads to do if we already have the data
+  if (entry->sharedData != NULL) {
+    entry->active = true;
+    entry->done = true;
+    workQueue.push_back(entry);
+    queueMutex->unlock();
+    return;
+  }
+
+  workQueue.push_back(entry);
+  pendingEntries.push_back(entry);
+
+  // We only put a single entry on the queue so waking a single
+  // thread is sufficient
+  consumerCond->signal();
+
+  queueMutex->unlock();
+}
+
+// flushQueue() sends all finished rects at the front of the queue, and
+// waits for more to finish until no more than maxPending remain.
+void EncodeManager::flushQueue(size_t maxPending)
+{
+  QueueEntry *entry;
+
+  queueMutex->lock();
+
+  while (!workQueue.empty()) {
+    entry = workQueue.front();
+
+    if (!entry->done) {
+      if (workQueue.size() <= maxPending)
+        break;
+      producerCond->wait();
+      continue;
+    }
+
+    workQueue.pop_front();
+
+    if (entry->needSlices) {
+      queueSlices(entry);
+      freeEntries.push_back(entry);
+      continue;
+    }
+
+    queueMutex->unlock();
+
+    try {
+      throwThreadException();
+      writeQueueEntry(entry);
+    } catch (...) {
+      queueMutex->lock();
+      freeEntries.push_back(entry);
+      queueMutex->unlock();
+      throw;
+    }
+
+    queueMutex->lock();
+
+    freeEntries.push_back(entry);
+  }
+
+  queueMutex->unlock();
+}
+
+// queueSlices() replaces a finished entry at the front of the queue
+// with slices of it, which the threads can then encode in parallel.
+// Must be called with the queue locked.
+void EncodeManager::queueSlices(QueueEntry* entry)
+{
+  std::vector<Rect> slices;
+  std::vector<Rect>::const_reverse_iterator slice;
+
+  sliceRect(entry->rect, &slices);
+
+  // The analysis is not repeated for the slices
+  updateThreadTime += entry->encodeTime;
+
+  // Everything behind this rect was queued after it, so the slices go
+  // in front of all of that
+  for (slice = slices.rbegin(); slice != slices.rend(); ++slice) {
+    QueueEntry* sliceEntry;
+
+    if (freeEntries.empty()) {
+      sliceEntry = new QueueEntry;
+      sliceEntry->manager = this;
+    } else {
+      sliceEntry = freeEntries.front();
+      freeEntries.pop_front();
+    }
+
+    sliceEntry->active = false;
+    sliceEntry->done = false;
+    sliceEntry->rect = *slice;
+    sliceEntry->pb = entry->pb;
+    sliceEntry->typeKnown = true;
+    sliceEntry->type = entry->type;
+    sliceEntry->needSlices = false;
+
+    sliceEntry->sharedData = NULL;
+    sliceEntry->encodeTime = 0;
+    if (useEncodeCache)
+      sliceEntry->sharedData = encodeCache->lookup(encodeCacheSettings,
+                                                   sliceEntry->pb,
+                                                   sliceEntry->rect,
+                                                   &sliceEntry->type,
+                                                   &sliceEntry->sharedLength);
+
+    workQueue.push_front(sliceEntry);
+
+    if (sliceEntry->sharedData != NULL) {
+      sliceEntry->active = true;
+      sliceEntry->done = true;
+      continue;
+    }
+
+    // The main thread is waiting for these, so they go first
+    pendingEntries.push_front(sliceEntry);
+  }
+
+  consumerCond->broadcast();
+}
+
+// discardQueue() throws away everything in the queue once the worker
+// threads are done with it. Used when something has gone wrong.
+void EncodeManager::discardQueue()
+{
+  os::AutoMutex a(queueMutex);
+
+  while (!workQueue.empty()) {
+    if (!workQueue.front()->done) {
+      producerCond->wait();
+      continue;
+    }
+
+    freeEntries.push_back(workQueue.front());
+    workQueue.pop_front();
+  }
+
+  delete threadException;
+  threadException = NULL;
+}
+
+void EncodeManager::encodeQueueEntry(QueueEntry* entry,
+                                     const std::vector<Encoder*>& threadEncoders)
+{
+  PixelBuffer *ppb;
+
+  Encoder *encoder;
+
+  struct timeval start;
+
+  gettimeofday(&start, NULL);
+
+  ppb = preparePixelBuffer(entry->rect, entry->pb, true,
+                           &entry->offsetPixelBuffer,
+                           &entry->convertedPixelBuffer);
+
+  if (entry->typeKnown) {
+    entry->info.rleRuns = 0;
+    entry->info.palette.clear();
+  } else
+    entry->type = selectEncoderType(entry->rect, ppb, &entry->info);
+  entry->ppb = ppb;
+  entry->encoded = false;
+
+  // A single large JPEG image takes long enough to hold up the whole
+  // update, so it gets split up and spread over all threads. Other
+  // types are fine as they are.
+  if (!entry->typeKnown && (entry->type == encoderFullColour) &&
+      (activeEncoders[encoderFullColour] == encoderTightJPEG) &&
+      (Server::jpegSliceArea > 0) &&
+      (entry->rect.height() > sliceHeight(entry->rect.width()))) {
+    entry->needSlices = true;
+    entry->encodeTime = usSince(&start);
+    return;
+  }
+
+  // Other encoders that keep state between rects have to be run on
+  // the main thread, in order. The Tight encoders have a zlib stream
+  // each, and get their rects in the order they will be sent.
+  encoder = threadEncoders[activeEncoders[entry->type]];
+  if (encoder == NULL) {
+    entry->encodeTime = usSince(&start);
+    return;
+  }
 
   if (encoder->flags & EncoderUseNativePF)
-    ppb = preparePixelBuffer(rect, pb, false);
+    ppb = preparePixelBuffer(entry->rect, entry->pb, false,
+                             &entry->offsetPixelBuffer,
+                             &entry->convertedPixelBuffer);
 
-  encoder->writeRect(ppb, info.palette);
+  entry->bufferStream.clear();
 
-  endRect();
+  encoder->setOutStream(&entry->bufferStream);
+  encoder->writeRect(ppb, entry->info.palette);
+
+  entry->encoded = true;
+  entry->encodeTime = usSince(&start);
+}
+
+void EncodeManager::writeQueueEntry(QueueEntry* entry)
+{
+  Encoder *encoder;
+
+  encoder = startRect(entry->rect, entry->type);
+
+  if (entry->sharedData != NULL) {
+    conn->getOutStream()->writeBytes(entry->sharedData,
+                                     entry->sharedLength);
+  } else if (entry->encoded) {
+    // Only data from encoders without state can be used by anyone
+    if (useEncodeCache && (encoder->flags & EncoderStateless))
+      encodeCache->store(encodeCacheSettings, entry->pb, entry->rect,
+                         entry->type,
+                         (const rdr::U8*)entry->bufferStream.data(),
+                         entry->bufferStream.length());
+
+    conn->getOutStream()->writeBytes(entry->bufferStream.data(),
+                                     entry->bufferStream.length());
+  } else {
+    PixelBuffer *ppb;
+
+    ppb = entry->ppb;
+    if (encoder->flags & EncoderUseNativePF)
+      ppb = preparePixelBuffer(entry->rect, entry->pb, false,
+                               &entry->offsetPixelBuffer,
+                               &entry->convertedPixelBuffer);
+
+    encoder->writeRect(ppb, entry->info.palette);
+  }
+
+  endRect(0, entry->encodeTime);
+}
+
+void EncodeManager::setThreadException(const rdr::Exception& e)
+{
+  os::AutoMutex a(queueMutex);
+
+  if (threadException != NULL)
+    return;
+
+  threadException = new rdr::Exception("Exception on worker thread: %s", e.str());
+}
+
+void EncodeManager::throwThreadException()
+{
+  os::AutoMutex a(queueMutex);
+
+  if (threadException == NULL)
+    return;
+
+  rdr::Exception e(*threadException);
+
+  delete threadException;
+  threadException = NULL;
+
+  throw e;
 }
 
 bool EncodeManager::checkSolidTile(const Rect& r, const rdr::U8* colourValue,
@@ -987,21 +2052,31 @@ void EncodeManager::extendSolidAreaByPixel(const Rect& r, const Rect& sr,
 PixelBuffer* EncodeManager::preparePixelBuffer(const Rect& rect,
                                                const PixelBuffer *pb,
                                                bool convert)
+{
+  return preparePixelBuffer(rect, pb, convert,
+                            &offsetPixelBuffer, &convertedPixelBuffer);
+}
+
+PixelBuffer* EncodeManager::preparePixelBuffer(const Rect& rect,
+                                               const PixelBuffer *pb,
+                                               bool convert,
+                                               OffsetPixelBuffer* offsetBuffer,
+                                               ManagedPixelBuffer* convertedBuffer)
 {
   const rdr::U8* buffer;
   int stride;
 
   // Do wo need to convert the data?
   if (convert && !conn->cp.pf().equal(pb->getPF())) {
-    convertedPixelBuffer.setPF(conn->cp.pf());
-    convertedPixelBuffer.setSize(rect.width(), rect.height());
+    convertedBuffer->setPF(conn->cp.pf());
+    convertedBuffer->setSize(rect.width(), rect.height());
 
     buffer = pb->getBuffer(rect, &stride);
-    convertedPixelBuffer.imageRect(pb->getPF(),
-                                   convertedPixelBuffer.getRect(),
-                                   buffer, stride);
+    convertedBuffer->imageRect(pb->getPF(),
+                               convertedBuffer->getRect(),
+                               buffer, stride);
 
-    return &convertedPixelBuffer;
+    return convertedBuffer;
   }
 
   // Otherwise we still need to shift the coordinates. We have our own
@@ -1009,10 +2084,10 @@ PixelBuffer* EncodeManager::preparePixelBuffer(const Rect& rect,
 
   buffer = pb->getBuffer(rect, &stride);
 
-  offsetPixelBuffer.update(pb->getPF(), rect.width(), rect.height(),
-                           buffer, stride);
+  offsetBuffer->update(pb->getPF(), rect.width(), rect.height(),
+                       buffer, stride);
 
-  return &offsetPixelBuffer;
+  return offsetBuffer;
 }
 
 bool EncodeManager::analyseRect(const PixelBuffer *pb,
@@ -1052,6 +2127,144 @@ void EncodeManager::OffsetPixelBuffer::update(const PixelFormat& pf,
   stride = stride_;
 }
 
+void EncodeManager::startThreads()
+{
+  size_t cpuCount;
+
+  queueMutex = new os::Mutex();
+  consumerCond = new os::Condition(queueMutex);
+
+  cpuCount = os::Thread::getSystemCPUCount();
+  if (cpuCount == 0) {
+    vlog.error("Unable to determine the number of CPU cores on this system");
+    cpuCount = 1;
+  }
+
+  // The overhead of threading is small, but not small enough to
+  // ignore on single CPU systems
+  if (cpuCount == 1) {
+    vlog.debug("Encoding data on main thread");
+    return;
+  }
+
+  vlog.debug("Creating %d encoder thread(s)", (int)cpuCount);
+
+  while (cpuCount--)
+    threads.push_back(new EncodeThread());
+}
+
+void EncodeManager::stopThreads()
+{
+  while (!threads.empty()) {
+    delete threads.back();
+    threads.pop_back();
+  }
+
+  delete consumerCond;
+  consumerCond = NULL;
+  delete queueMutex;
+  queueMutex = NULL;
+}
+
+EncodeManager::EncodeThread::EncodeThread()
+{
+  stopRequested = false;
+
+  start();
+}
+
+EncodeManager::EncodeThread::~EncodeThread()
+{
+  stop();
+  wait();
+}
+
+void EncodeManager::EncodeThread::stop()
+{
+  os::AutoMutex a(queueMutex);
+
+  if (!isRunning())
+    return;
+
+  stopRequested = true;
+
+  // We can't wake just this thread, so wake everyone
+  consumerCond->broadcast();
+}
+
+void EncodeManager::EncodeThread::worker()
+{
+  queueMutex->lock();
+
+  while (!stopRequested) {
+    EncodeManager::QueueEntry *entry;
+    EncodeManager *manager;
+
+    // Look for an available entry in the work queue
+    entry = findEntry();
+    if (entry == NULL) {
+      // Wait and try again
+      consumerCond->wait();
+      continue;
+    }
+
+    // This is ours now
+    entry->active = true;
+
+    manager = entry->manager;
+
+    queueMutex->unlock();
+
+    // Do the actual encoding
+    try {
+      manager->encodeQueueEntry(entry, *entry->encoders);
+    } catch (rdr::Exception& e) {
+      manager->setThreadException(e);
+    } catch(...) {
+      assert(false);
+    }
+
+    queueMutex->lock();
+
+    entry->done = true;
+
+    manager->freeThreadEncoders.push_back(entry->encoders);
+    entry->encoders = NULL;
+
+    // Wake the main thread in case it is waiting for this rect
+    manager->producerCond->signal();
+  }
+
+  queueMutex->unlock();
+}
+
+EncodeManager::QueueEntry* EncodeManager::EncodeThread::findEntry()
+{
+  std::list<EncodeManager::QueueEntry*>::iterator iter;
+
+  // The sub-rects never overlap, so any entry will do as long as its
+  // connection has a set of encoders to spare
+  for (iter = pendingEntries.begin(); iter != pendingEntries.end(); ++iter) {
+    EncodeManager::QueueEntry *entry;
+    EncodeManager *manager;
+
+    entry = *iter;
+    manager = entry->manager;
+
+    if (manager->freeThreadEncoders.empty())
+      continue;
+
+    entry->encoders = manager->freeThreadEncoders.front();
+    manager->freeThreadEncoders.pop_front();
+
+    pendingEntries.erase(iter);
+
+    return entry;
+  }
+
+  return NULL;
+}
+
 // Preprocessor generated, optimised methods
 
 #define BPP 8
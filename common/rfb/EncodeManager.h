@@ -20,19 +20,36 @@
 #ifndef __RFB_ENCODEMANAGER_H__
 #define __RFB_ENCODEMANAGER_H__
 
+#include <list>
 #include <vector>
 
+#include <os/Thread.h>
+
+#include <rdr/MemOutStream.h>
 #include <rdr/types.h>
+#include <rfb/EncodeCache.h>
+#include <rfb/EncodeController.h>
 #include <rfb/PixelBuffer.h>
 #include <rfb/Region.h>
 #include <rfb/Timer.h>
 
+namespace os {
+  class Condition;
+  class Mutex;
+}
+
+namespace rdr {
+  struct Exception;
+}
+
 namespace rfb {
   class SConnection;
   class Encoder;
   class UpdateInfo;
   class PixelBuffer;
   class RenderedCursor;
+  class SharedMemory;
+  class TileCacheEncoder;
   struct Rect;
 
   struct RectInfo;
@@ -52,6 +69,20 @@ namespace rfb {
 
     void pruneLosslessRefresh(const Region& limits);
 
+    // setSharedMemory() makes us write pixel data directly in to the
+    // client's shared memory segment whenever it is large enough for
+    // the framebuffer. Ownership of the segment is transferred to us.
+    void setSharedMemory(SharedMemory* shm);
+
+    // setEncodeCache() lets us reuse rects that other clients of the
+    // same server have already encoded, and share the ones we encode.
+    void setEncodeCache(EncodeCache* cache);
+
+    // setBandwidth() gives us the current estimate of the bandwidth to
+    // the client, in bytes per second. A fast enough link makes us
+    // trade compression for encoding speed.
+    void setBandwidth(size_t bandwidth);
+
     void writeUpdate(const UpdateInfo& ui, const PixelBuffer* pb,
                      const RenderedCursor* renderedCursor);
 
@@ -67,20 +98,41 @@ namespace rfb {
                   const PixelBuffer* pb,
                   const RenderedCursor* renderedCursor);
     void prepareEncoders(bool allowLossy);
+    void updateEncodeModes();
 
     Region getLosslessRefresh(const Region& req, size_t maxUpdateSize);
 
     int computeNumRects(const Region& changed);
 
     Encoder *startRect(const Rect& rect, int type);
-    void endRect();
+    void endRect(unsigned extraTime=0, unsigned threadTime=0);
 
     void writeCopyRects(const Region& copied, const Point& delta);
     void writeSolidRects(Region *changed, const PixelBuffer* pb);
     void findSolidRect(const Rect& rect, Region *changed, const PixelBuffer* pb);
     void writeRects(const Region& changed, const PixelBuffer* pb);
+    void sliceRect(const Rect& rect, std::vector<Rect>* slices);
 
     void writeSubRect(const Rect& rect, const PixelBuffer *pb);
+    bool writeSharedRect(const Rect& rect, const PixelBuffer *pb);
+    int selectEncoderType(const Rect& rect, const PixelBuffer *ppb,
+                          struct RectInfo *info);
+
+    bool canUseSharedMemory();
+    void writeSharedMemoryRects(const Region& changed,
+                                const PixelBuffer* pb);
+
+    struct CachedTile {
+      Rect rect;
+      rdr::U64 key;
+    };
+
+    bool canUseTileCache();
+    void findCachedTiles(Region *changed, const PixelBuffer* pb,
+                         bool allowLossy);
+    void writeCachedTiles(const std::vector<CachedTile>& tiles);
+    void storeCachedTiles(const std::vector<CachedTile>& tiles,
+                          const PixelBuffer* pb);
 
     bool checkSolidTile(const Rect& r, const rdr::U8* colourValue,
                         const PixelBuffer *pb);
@@ -132,14 +184,18 @@ namespace rfb {
       unsigned long long bytes;
       unsigned long long pixels;
       unsigned long long equivalent;
+      unsigned long long time;
     };
     typedef std::vector< std::vector<struct EncoderStats> > StatsVector;
 
     unsigned updates;
     EncoderStats copyStats;
+    EncoderStats shmStats;
+    EncoderStats cacheStats;
     StatsVector stats;
     int activeType;
     int beforeLength;
+    struct timeval rectStart;
 
     class OffsetPixelBuffer : public FullFramePixelBuffer {
     public:
@@ -152,6 +208,98 @@ namespace rfb {
 
     OffsetPixelBuffer offsetPixelBuffer;
     ManagedPixelBuffer convertedPixelBuffer;
+
+  protected:
+    Encoder* createEncoder(int klass);
+    void configureEncoder(Encoder* encoder, bool allowLossy);
+
+    PixelBuffer* preparePixelBuffer(const Rect& rect,
+                                    const PixelBuffer *pb, bool convert,
+                                    OffsetPixelBuffer* offsetBuffer,
+                                    ManagedPixelBuffer* convertedBuffer);
+
+    struct QueueEntry;
+
+    void queueSubRect(const Rect& rect, const PixelBuffer *pb);
+    void flushQueue(size_t maxPending);
+    void queueSlices(QueueEntry* entry);
+    void discardQueue();
+
+    void encodeQueueEntry(QueueEntry* entry,
+                          const std::vector<Encoder*>& threadEncoders);
+    void writeQueueEntry(QueueEntry* entry);
+
+    void setThreadException(const rdr::Exception& e);
+    void throwThreadException();
+
+    size_t queueSize;
+    std::list<QueueEntry*> freeEntries;
+    std::list<QueueEntry*> workQueue;
+
+    os::Condition* producerCond;
+
+    // Private instances of the encoders that are safe to use in
+    // parallel, NULL for the others. A worker thread borrows one set
+    // for each rect it encodes.
+    std::vector<std::vector<Encoder*> > threadEncoders;
+    std::list<std::vector<Encoder*>*> freeThreadEncoders;
+
+    rdr::Exception *threadException;
+
+    // The worker threads are shared by all connections, and are only
+    // started and stopped on the main thread
+    class EncodeThread : public os::Thread {
+    public:
+      EncodeThread();
+      ~EncodeThread();
+
+      void stop();
+
+    protected:
+      void worker();
+      EncodeManager::QueueEntry* findEntry();
+
+    private:
+      bool stopRequested;
+    };
+
+    static void startThreads();
+    static void stopThreads();
+
+    static int managerCount;
+    static std::list<EncodeThread*> threads;
+
+    // Entries from every connection that no thread has started on yet
+    static std::list<QueueEntry*> pendingEntries;
+
+    static os::Mutex* queueMutex;
+    static os::Condition* consumerCond;
+
+    SharedMemory* shm;
+
+    TileCacheEncoder* tileCache;
+    std::vector<CachedTile> cacheHits, cacheMisses, cacheLateHits;
+
+    EncodeCache* encodeCache;
+    bool useEncodeCache;
+    EncodeCache::Settings encodeCacheSettings;
+    rdr::MemOutStream encodeCacheStream;
+
+    bool highBandwidth;
+    size_t bandwidth;
+
+    // The settings actually used for the current update, which might
+    // differ from what the client asked for
+    EncodeController controller;
+    EncodeController::Mode encodeMode;
+    int compressLevel;
+    int qualityLevel;
+    int fineQualityLevel;
+
+    unsigned long long updatePixels;
+    // Time spent on the main thread, and on the worker threads
+    unsigned long long updateTime;
+    unsigned long long updateThreadTime;
   };
 }
 
@@ -20,6 +20,7 @@
 #include <rfb/Encoder.h>
 #include <rfb/PixelBuffer.h>
 #include <rfb/Palette.h>
+#include <rfb/SConnection.h>
 
 using namespace rfb;
 
@@ -28,7 +29,7 @@ Encoder::Encoder(SConnection *conn_, int encoding_,
                  unsigned int maxPaletteSize_, int losslessQuality_) :
   encoding(encoding_), flags(flags_),
   maxPaletteSize(maxPaletteSize_), losslessQuality(losslessQuality_),
-  conn(conn_)
+  conn(conn_), outStream(NULL)
 {
 }
 
@@ -53,6 +54,14 @@ void Encoder::writeSolidRect(int width, int height,
   writeRect(&buffer, palette);
 }
 
+rdr::OutStream* Encoder::getOutStream()
+{
+  if (outStream != NULL)
+    return outStream;
+
+  return conn->getOutStream();
+}
+
 void Encoder::writeSolidRect(const PixelBuffer* pb, const Palette& palette)
 {
   rdr::U32 col32;
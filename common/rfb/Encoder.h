@@ -23,6 +23,8 @@
 #include <rdr/types.h>
 #include <rfb/Rect.h>
 
+namespace rdr { class OutStream; }
+
 namespace rfb {
   class SConnection;
   class PixelBuffer;
@@ -37,6 +39,9 @@ namespace rfb {
     EncoderUseNativePF = 1 << 0,
     // Encoder does not encode pixels perfectly accurate
     EncoderLossy = 1 << 1,
+    // Encoder keeps no state between rects, so separate instances can
+    // encode different rects in any order
+    EncoderStateless = 1 << 2,
   };
 
   class Encoder {
@@ -58,6 +63,11 @@ namespace rfb {
     virtual int getCompressLevel() { return -1; };
     virtual int getQualityLevel() { return -1; };
 
+    // setOutStream() makes the encoder write to the given stream instead
+    // of the SConnection, e.g. when encoding on a worker thread. Set it
+    // to NULL to go back to the SConnection.
+    void setOutStream(rdr::OutStream* os) { outStream = os; }
+
     // writeRect() is the main interface that encodes the given rectangle
     // with data from the PixelBuffer onto the SConnection given at
     // encoder creation.
@@ -89,6 +99,9 @@ namespace rfb {
     // short cut method.
     void writeSolidRect(const PixelBuffer* pb, const Palette& palette);
 
+    // The stream encoded data should be written to
+    rdr::OutStream* getOutStream();
+
   public:
     const int encoding;
     const enum EncoderFlags flags;
@@ -102,6 +115,9 @@ namespace rfb {
 
   protected:
     SConnection* conn;
+
+  private:
+    rdr::OutStream* outStream;
   };
 }
 
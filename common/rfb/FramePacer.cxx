@@ -0,0 +1,203 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <rfb/FramePacer.h>
+#include <rfb/LogWriter.h>
+#include <rfb/util.h>
+
+using namespace rfb;
+
+static LogWriter vlog("FramePacer");
+
+// The shortest time without damage that we consider the end of a burst
+static const unsigned MinSettleTime = 1000;
+
+// Intervals longer than this are the application idling, not its
+// frame rate
+static const unsigned MaxCadence = 1000000;
+
+// Weight of a new measurement (as a shift) in the running estimates
+static const int SampleShift = 2;
+
+static inline void updateEstimate(unsigned* estimate, unsigned sample)
+{
+  *estimate = *estimate - (*estimate >> SampleShift) +
+              (sample >> SampleShift);
+}
+
+FramePacer::FramePacer()
+  : frameInterval(1000/60), pending(false),
+    haveGrab(false), haveBurst(false),
+    burstLength(0), burstGap(0), cadence(0),
+    frames(0), totalDelay(0)
+{
+}
+
+FramePacer::~FramePacer()
+{
+}
+
+void FramePacer::setFrameRate(int rate)
+{
+  if (rate <= 0)
+    rate = 1;
+  frameInterval = 1000 / rate;
+}
+
+void FramePacer::damage()
+{
+  struct timeval now;
+
+  gettimeofday(&now, NULL);
+
+  if (!pending) {
+    pending = true;
+    firstDamage = now;
+
+    if (haveBurst) {
+      unsigned sample;
+
+      sample = usBetween(&lastBurst, &now);
+      if (sample < MaxCadence)
+        updateEstimate(&cadence, sample);
+    }
+
+    lastBurst = now;
+    haveBurst = true;
+  } else {
+    unsigned gap;
+
+    // Only gaps short enough to be within a burst are interesting
+    gap = usBetween(&lastDamage, &now);
+    if (gap < (unsigned)frameInterval * 1000 / 2)
+      updateEstimate(&burstGap, gap);
+  }
+
+  lastDamage = now;
+}
+
+int FramePacer::getFrameDelay(int clientDelay)
+{
+  struct timeval now;
+  long long sinceFirst, sinceLast;
+  long long settle, interval, wait;
+
+  if (!pending)
+    return frameInterval;
+
+  gettimeofday(&now, NULL);
+
+  sinceFirst = usBetween(&firstDamage, &now);
+  sinceLast = usBetween(&lastDamage, &now);
+
+  interval = (long long)frameInterval * 1000;
+
+  settle = burstGap * 2;
+  if (settle < MinSettleTime)
+    settle = MinSettleTime;
+  if (settle > interval / 2)
+    settle = interval / 2;
+
+  // Wait for the burst to be as long as they usually are, and for it
+  // to go quiet
+  wait = burstLength - sinceFirst;
+  if (wait < settle - sinceLast)
+    wait = settle - sinceLast;
+
+  // But don't hold on to the damage for longer than a frame
+  if (wait > interval - sinceFirst)
+    wait = interval - sinceFirst;
+
+  // Respect the frame rate
+  if (haveGrab) {
+    long long sinceGrab;
+
+    sinceGrab = usBetween(&lastGrab, &now);
+    if (wait < interval - sinceGrab)
+      wait = interval - sinceGrab;
+  }
+
+  // No point grabbing before anyone can take the frame
+  if (clientDelay > 0) {
+    long long ready;
+
+    ready = (long long)clientDelay * 1000;
+    if (ready > interval)
+      ready = interval;
+    if (wait < ready)
+      wait = ready;
+  }
+
+  if (wait <= 0)
+    return 0;
+
+  return (wait + 999) / 1000;
+}
+
+void FramePacer::frameGrabbed()
+{
+  struct timeval now;
+
+  gettimeofday(&now, NULL);
+
+  if (pending) {
+    updateEstimate(&burstLength, usBetween(&firstDamage, &lastDamage));
+
+    frames++;
+    totalDelay += usBetween(&firstDamage, &now);
+  }
+
+  pending = false;
+
+  lastGrab = now;
+  haveGrab = true;
+}
+
+int FramePacer::msToNextFrame()
+{
+  long long next;
+
+  if (pending)
+    return getFrameDelay(-1);
+
+  // Applications that update slower than our frame rate leave the
+  // clients more time
+  if (!haveBurst || (cadence == 0))
+    return frameInterval / 2;
+
+  next = (long long)cadence + burstLength - usSince(&lastBurst);
+  next /= 1000;
+
+  if (next < frameInterval / 2)
+    return frameInterval / 2;
+  if (next > 1000)
+    return 1000;
+
+  return next;
+}
+
+void FramePacer::logStats()
+{
+  if (frames == 0)
+    return;
+
+  vlog.info("Frames grabbed: %u, %g ms after first damage on average",
+            frames, (double)totalDelay / frames / 1000);
+  vlog.info("  Bursts: %g ms long with %g ms gaps, every %g ms",
+            burstLength / 1000.0, burstGap / 1000.0, cadence / 1000.0);
+}
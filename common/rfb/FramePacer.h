@@ -0,0 +1,85 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// FramePacer - decides when to grab the framebuffer
+//
+// Applications usually draw a frame as a burst of damage, so grabbing
+// at a fixed rate will often catch a frame that is only half done. The
+// pacer learns how long the bursts tend to be and how long the gaps
+// within them are. It then schedules the grab for when the current
+// burst looks finished. It never waits longer than a frame interval
+// and never grabs more often than the frame rate allows. The grab is
+// also held back until at least one client can take the frame, so the
+// clients get the freshest pixels possible.
+//
+
+#ifndef __RFB_FRAMEPACER_H__
+#define __RFB_FRAMEPACER_H__
+
+#include <sys/time.h>
+
+namespace rfb {
+
+  class FramePacer {
+  public:
+    FramePacer();
+    ~FramePacer();
+
+    // setFrameRate() sets the maximum number of grabs per second
+    void setFrameRate(int rate);
+
+    // damage() registers that the application has drawn something
+    void damage();
+
+    // getFrameDelay() returns the number of milliseconds until the
+    // pending damage should be grabbed. clientDelay is the time until
+    // the first client can accept another frame, or -1 if unknown.
+    int getFrameDelay(int clientDelay);
+
+    // frameGrabbed() must be called once the pending damage has been
+    // grabbed.
+    void frameGrabbed();
+
+    // msToNextFrame() estimates the number of milliseconds until the
+    // next frame will be grabbed.
+    int msToNextFrame();
+
+    void logStats();
+
+  private:
+    int frameInterval;
+
+    bool pending;
+    struct timeval firstDamage, lastDamage;
+    struct timeval lastGrab;
+    struct timeval lastBurst;
+    bool haveGrab, haveBurst;
+
+    // Running estimates, in microseconds
+    unsigned burstLength;
+    unsigned burstGap;
+    unsigned cadence;
+
+    unsigned frames;
+    unsigned long long totalDelay;
+  };
+
+}
+
+#endif
@@ -92,7 +92,8 @@ void HextileDecoder::readRect(const Rect& r, rdr::InStream* is,
 
 void HextileDecoder::decodeRect(const Rect& r, const void* buffer,
                                 size_t buflen, const ConnParams& cp,
-                                ModifiablePixelBuffer* pb)
+                                ModifiablePixelBuffer* pb,
+                                DecoderContext* ctx)
 {
   rdr::MemInStream is(buffer, buflen);
   const PixelFormat& pf = cp.pf();
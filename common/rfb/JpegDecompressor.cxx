@@ -105,6 +105,7 @@ JpegSkipInputData(j_decompress_ptr dinfo, long num_bytes)
 }
 
 JpegDecompressor::JpegDecompressor(void)
+  : rowPointer(NULL), rowPointerCount(0), tempBuf(NULL), tempBufSize(0)
 {
   dinfo = new jpeg_decompress_struct;
 
@@ -140,6 +141,9 @@ JpegDecompressor::~JpegDecompressor(void)
 
   jpeg_destroy_decompress(dinfo);
 
+  delete [] rowPointer;
+  delete [] tempBuf;
+
   delete err;
   delete src;
 
@@ -154,14 +158,10 @@ void JpegDecompressor::decompress(const rdr::U8 *jpegBuf, int jpegBufLen,
   int pixelsize;
   int dstBufStride;
   rdr::U8 *dstBuf = NULL;
-  bool dstBufIsTemp = false;
-  JSAMPROW *rowPointer = NULL;
 
   if(setjmp(err->jmpBuffer)) {
     // this will execute if libjpeg has an error
     jpeg_abort_decompress(dinfo);
-    if (dstBufIsTemp && dstBuf) delete[] dstBuf;
-    if (rowPointer) delete[] rowPointer;
     throw rdr::Exception("%s", err->lastError);
   }
 
@@ -194,12 +194,26 @@ void JpegDecompressor::decompress(const rdr::U8 *jpegBuf, int jpegBufLen,
 #endif
 
   if (dinfo->out_color_space == JCS_RGB) {
-    dstBuf = new rdr::U8[w * h * pixelsize];
-    dstBufIsTemp = true;
+    if ((size_t)(w * h * pixelsize) > tempBufSize) {
+      delete [] tempBuf;
+      tempBuf = NULL;
+      tempBufSize = 0;
+
+      tempBuf = new rdr::U8[w * h * pixelsize];
+      tempBufSize = w * h * pixelsize;
+    }
+    dstBuf = tempBuf;
     dstBufStride = w;
   }
 
-  rowPointer = new JSAMPROW[h];
+  if (h > rowPointerCount) {
+    delete [] rowPointer;
+    rowPointer = NULL;
+    rowPointerCount = 0;
+
+    rowPointer = new JSAMPROW[h];
+    rowPointerCount = h;
+  }
   for (int dy = 0; dy < h; dy++)
     rowPointer[dy] = (JSAMPROW)(&dstBuf[dy * dstBufStride * pixelsize]);
 
@@ -209,8 +223,6 @@ void JpegDecompressor::decompress(const rdr::U8 *jpegBuf, int jpegBufLen,
     || dinfo->output_height != (unsigned)r.height()
     || dinfo->output_components != pixelsize) {
     jpeg_abort_decompress(dinfo);
-    if (dstBufIsTemp && dstBuf) delete[] dstBuf;
-    if (rowPointer) delete[] rowPointer;
     throw rdr::Exception("Tight Decoding: Wrong JPEG data received.\n");
   }
 
@@ -223,7 +235,4 @@ void JpegDecompressor::decompress(const rdr::U8 *jpegBuf, int jpegBufLen,
     pf.bufferFromRGB((rdr::U8*)buf, dstBuf, w, stride, h);
 
   jpeg_finish_decompress(dinfo);
-
-  if (dstBufIsTemp) delete [] dstBuf;
-  delete[] rowPointer;
 }
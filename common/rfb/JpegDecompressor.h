@@ -26,6 +26,8 @@
 #ifndef __RFB_JPEGDECOMPRESSOR_H__
 #define __RFB_JPEGDECOMPRESSOR_H__
 
+#include <stddef.h>
+
 #include <rfb/PixelFormat.h>
 #include <rfb/Rect.h>
 
@@ -53,6 +55,12 @@ namespace rfb {
     struct JPEG_ERROR_MGR *err;
     struct JPEG_SRC_MGR *src;
 
+    // Kept between calls as they are usually the same size every time
+    rdr::U8 **rowPointer;
+    int rowPointerCount;
+    rdr::U8 *tempBuf;
+    size_t tempBufSize;
+
   };
 
 } // end of namespace rfb
@@ -0,0 +1,100 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_LZ4
+
+#include <lz4.h>
+
+#include <rdr/InStream.h>
+#include <rdr/MemInStream.h>
+#include <rdr/OutStream.h>
+
+#include <rfb/ConnParams.h>
+#include <rfb/DecoderContext.h>
+#include <rfb/Exception.h>
+#include <rfb/PixelBuffer.h>
+#include <rfb/LZ4Decoder.h>
+
+using namespace rfb;
+
+LZ4Decoder::LZ4Decoder() : Decoder(DecoderPlain)
+{
+}
+
+LZ4Decoder::~LZ4Decoder()
+{
+}
+
+void LZ4Decoder::readRect(const Rect& r, rdr::InStream* is,
+                          const ConnParams& cp, rdr::OutStream* os)
+{
+  rdr::U32 len;
+
+  len = is->readU32();
+  if (len > (rdr::U32)LZ4_compressBound(r.area() * (cp.pf().bpp/8)))
+    throw Exception("LZ4Decoder: Compressed data too large");
+
+  os->writeU32(len);
+  os->copyBytes(is, len);
+}
+
+void LZ4Decoder::decodeRect(const Rect& r, const void* buffer,
+                            size_t buflen, const ConnParams& cp,
+                            ModifiablePixelBuffer* pb,
+                            DecoderContext* ctx)
+{
+  rdr::MemInStream is(buffer, buflen);
+  rdr::U32 len;
+  const rdr::U8* data;
+
+  int length, stride;
+  rdr::U8* out;
+  int result;
+
+  len = is.readU32();
+  data = (const rdr::U8*)is.getptr();
+  is.skip(len);
+
+  length = r.area() * (cp.pf().bpp/8);
+
+  // Decompress straight in to the frame buffer if we can, as this is
+  // typically used for lots of large rects
+  if (pb->getPF().equal(cp.pf())) {
+    out = pb->getBufferRW(r, &stride);
+    if (stride == r.width()) {
+      result = LZ4_decompress_safe((const char*)data, (char*)out,
+                                   len, length);
+      pb->commitBufferRW(r);
+      if (result != length)
+        throw Exception("LZ4Decoder: Invalid compressed data");
+      return;
+    }
+    pb->commitBufferRW(r);
+  }
+
+  out = ctx->getScratch(DecoderContext::scratchPixels, length);
+
+  result = LZ4_decompress_safe((const char*)data, (char*)out,
+                               len, length);
+  if (result != length)
+    throw Exception("LZ4Decoder: Invalid compressed data");
+
+  pb->imageRect(cp.pf(), r, out);
+}
+
+#endif
@@ -0,0 +1,44 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+#ifndef __RFB_LZ4DECODER_H__
+#define __RFB_LZ4DECODER_H__
+
+#ifdef HAVE_LZ4
+
+#include <rfb/Decoder.h>
+
+namespace rfb {
+
+  // Every rect is a separate LZ4 block, so they can all be decoded in
+  // parallel and in any order
+  class LZ4Decoder : public Decoder {
+  public:
+    LZ4Decoder();
+    virtual ~LZ4Decoder();
+    virtual void readRect(const Rect& r, rdr::InStream* is,
+                          const ConnParams& cp, rdr::OutStream* os);
+    virtual void decodeRect(const Rect& r, const void* buffer,
+                            size_t buflen, const ConnParams& cp,
+                            ModifiablePixelBuffer* pb,
+                            DecoderContext* ctx);
+  };
+}
+
+#endif
+
+#endif
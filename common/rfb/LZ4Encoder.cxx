@@ -0,0 +1,132 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_LZ4
+
+#include <string.h>
+
+#include <lz4.h>
+
+#include <rdr/OutStream.h>
+#include <rfb/encodings.h>
+#include <rfb/ConnParams.h>
+#include <rfb/Exception.h>
+#include <rfb/PixelBuffer.h>
+#include <rfb/SConnection.h>
+#include <rfb/LZ4Encoder.h>
+
+using namespace rfb;
+
+LZ4Encoder::LZ4Encoder(SConnection* conn) :
+  Encoder(conn, encodingLZ4, EncoderStateless, 0),
+  acceleration(1), rowBuffer(NULL), rowBufferSize(0),
+  compressBuffer(NULL), compressBufferSize(0)
+{
+}
+
+LZ4Encoder::~LZ4Encoder()
+{
+  delete [] rowBuffer;
+  delete [] compressBuffer;
+}
+
+bool LZ4Encoder::isSupported()
+{
+  return conn->cp.supportsEncoding(encodingLZ4);
+}
+
+void LZ4Encoder::setCompressLevel(int level)
+{
+  // LZ4 has no levels as such, but it can skip over data that does
+  // not compress well. Lower levels skip more aggressively.
+  if ((level < 0) || (level > 9))
+    acceleration = 1;
+  else
+    acceleration = 10 - level;
+}
+
+void LZ4Encoder::writeRect(const PixelBuffer* pb, const Palette& palette)
+{
+  const rdr::U8* buffer;
+  int stride;
+
+  int lineBytes, strideBytes, length;
+
+  buffer = pb->getBuffer(pb->getRect(), &stride);
+
+  lineBytes = pb->width() * pb->getPF().bpp/8;
+  strideBytes = stride * pb->getPF().bpp/8;
+  length = lineBytes * pb->height();
+
+  // LZ4 needs the input in one piece
+  if ((strideBytes != lineBytes) && (pb->height() > 1)) {
+    rdr::U8* dst;
+    int h;
+
+    if (rowBufferSize < length) {
+      delete [] rowBuffer;
+      rowBuffer = new rdr::U8[length];
+      rowBufferSize = length;
+    }
+
+    dst = rowBuffer;
+    h = pb->height();
+    while (h--) {
+      memcpy(dst, buffer, lineBytes);
+      dst += lineBytes;
+      buffer += strideBytes;
+    }
+
+    buffer = rowBuffer;
+  }
+
+  writeBlock(buffer, length);
+}
+
+void LZ4Encoder::writeSolidRect(int width, int height,
+                                const PixelFormat& pf,
+                                const rdr::U8* colour)
+{
+  // Rare, as there are better encoders for this
+  Encoder::writeSolidRect(width, height, pf, colour);
+}
+
+void LZ4Encoder::writeBlock(const rdr::U8* data, int length)
+{
+  rdr::OutStream* os;
+  int bound, compressed;
+
+  bound = LZ4_compressBound(length);
+  if (compressBufferSize < bound) {
+    delete [] compressBuffer;
+    compressBuffer = new rdr::U8[bound];
+    compressBufferSize = bound;
+  }
+
+  compressed = LZ4_compress_fast((const char*)data, (char*)compressBuffer,
+                                 length, bound, acceleration);
+  if (compressed <= 0)
+    throw Exception("LZ4Encoder: Failed to compress data");
+
+  os = getOutStream();
+
+  os->writeU32(compressed);
+  os->writeBytes(compressBuffer, compressed);
+}
+
+#endif
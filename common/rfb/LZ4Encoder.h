@@ -0,0 +1,69 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// LZ4Encoder - raw pixels compressed with LZ4
+//
+// Meant for links where bandwidth is plentiful and the time spent
+// encoding is what limits the frame rate. No analysis of the pixels is
+// done, the rows are simply compressed as one independent LZ4 block:
+//
+//   U32        compressed length
+//   U8[length] LZ4 block of width * height pixels in the client format
+//
+
+#ifndef __RFB_LZ4ENCODER_H__
+#define __RFB_LZ4ENCODER_H__
+
+#ifdef HAVE_LZ4
+
+#include <rfb/Encoder.h>
+
+namespace rfb {
+
+  class LZ4Encoder : public Encoder {
+  public:
+    LZ4Encoder(SConnection* conn);
+    virtual ~LZ4Encoder();
+
+    virtual bool isSupported();
+
+    virtual void setCompressLevel(int level);
+
+    virtual void writeRect(const PixelBuffer* pb, const Palette& palette);
+    virtual void writeSolidRect(int width, int height,
+                                const PixelFormat& pf,
+                                const rdr::U8* colour);
+
+  protected:
+    void writeBlock(const rdr::U8* data, int length);
+
+  protected:
+    int acceleration;
+
+    rdr::U8* rowBuffer;
+    int rowBufferSize;
+    rdr::U8* compressBuffer;
+    int compressBufferSize;
+  };
+
+}
+
+#endif
+
+#endif
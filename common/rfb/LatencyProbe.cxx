@@ -0,0 +1,158 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <string.h>
+
+#include <rdr/MemInStream.h>
+#include <rdr/MemOutStream.h>
+#include <rfb/LatencyProbe.h>
+
+using namespace rfb;
+
+// "LTNC"
+static const rdr::U32 probeMarker = 0x4c544e43;
+
+static const rdr::U32 probeFlagMeasured = 1<<0;
+
+static const char* stageNames[latencyStageCount] = {
+  "Damage", "Grab", "Encode", "Write",
+  "Network", "Decode", "Present", "Total"
+};
+
+// In microseconds
+static const unsigned bucketLimits[LatencyHistogram::bucketCount] = {
+  250, 500, 1000, 2000, 3000, 5000, 7500, 10000, 15000, 20000,
+  30000, 40000, 50000, 75000, 100000, 150000, 200000, 300000, 500000,
+  (unsigned)-1
+};
+
+const char* rfb::latencyStageName(int stage)
+{
+  if ((stage < 0) || (stage >= latencyStageCount))
+    return "Unknown";
+  return stageNames[stage];
+}
+
+LatencyProbe::LatencyProbe() : id(0), measured(false)
+{
+  memset(serverTime, 0, sizeof(serverTime));
+}
+
+bool LatencyProbe::isProbe(unsigned len, const char data[])
+{
+  if (len != payloadSize)
+    return false;
+
+  rdr::MemInStream is(data, len);
+
+  return is.readU32() == probeMarker;
+}
+
+void LatencyProbe::read(const char data[])
+{
+  rdr::MemInStream is(data, payloadSize);
+
+  is.skip(4);
+  id = is.readU32();
+  measured = is.readU32() & probeFlagMeasured;
+  for (int i = 0; i < latencyServerStages; i++)
+    serverTime[i] = is.readU32();
+}
+
+void LatencyProbe::write(char data[]) const
+{
+  rdr::MemOutStream os(payloadSize);
+
+  os.writeU32(probeMarker);
+  os.writeU32(id);
+  os.writeU32(measured ? probeFlagMeasured : 0);
+  for (int i = 0; i < latencyServerStages; i++)
+    os.writeU32(serverTime[i]);
+
+  memcpy(data, os.data(), payloadSize);
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+  clear();
+}
+
+void LatencyHistogram::clear()
+{
+  samples = 0;
+  memset(buckets, 0, sizeof(buckets));
+}
+
+void LatencyHistogram::add(const unsigned times[latencyStageCount])
+{
+  for (int stage = 0; stage < latencyStageCount; stage++) {
+    int bucket;
+
+    bucket = 0;
+    while (times[stage] > bucketLimits[bucket])
+      bucket++;
+
+    buckets[stage][bucket]++;
+  }
+
+  samples++;
+}
+
+unsigned LatencyHistogram::percentile(int stage, unsigned pct) const
+{
+  unsigned target, sum;
+
+  if (samples == 0)
+    return 0;
+
+  target = (samples * pct + 99) / 100;
+  if (target == 0)
+    target = 1;
+
+  sum = 0;
+  for (int bucket = 0; bucket < bucketCount; bucket++) {
+    sum += buckets[stage][bucket];
+    if (sum >= target)
+      return bucketLimits[bucket];
+  }
+
+  return bucketLimits[bucketCount - 1];
+}
+
+unsigned LatencyHistogram::bucketLimit(int bucket)
+{
+  return bucketLimits[bucket];
+}
+
+void LatencyHistogram::write(FILE* f) const
+{
+  fprintf(f, "Upper limit (ms)");
+  for (int stage = 0; stage < latencyStageCount; stage++)
+    fprintf(f, ",%s", latencyStageName(stage));
+  fprintf(f, "\n");
+
+  for (int bucket = 0; bucket < bucketCount; bucket++) {
+    if (bucket == bucketCount - 1)
+      fprintf(f, "inf");
+    else
+      fprintf(f, "%g", bucketLimits[bucket] / 1000.0);
+    for (int stage = 0; stage < latencyStageCount; stage++)
+      fprintf(f, ",%u", buckets[stage][bucket]);
+    fprintf(f, "\n");
+  }
+}
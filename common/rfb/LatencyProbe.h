@@ -0,0 +1,118 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// LatencyProbe - end-to-end latency measurement over fences
+//
+// The viewer sends a fence request with a probe right after a pointer
+// event. A server that understands the probe holds on to it until the
+// update with the resulting damage has been written, fills in how long
+// each of its stages took and only then responds. Other servers simply
+// echo the probe right away, which is recognised by the viewer as an
+// unmeasured probe. The two clocks are never compared, so the time on
+// the network is whatever the server cannot account for.
+//
+// The server only counts damage close to the pointer event, but cannot
+// tell the damage the event caused from other drawing in the same area
+// that was queued before the event was handled. Measurements are
+// therefore only reliable when the rest of the desktop is idle.
+//
+// LatencyHistogram collects the measurements in buckets on a roughly
+// logarithmic scale.
+//
+
+#ifndef __RFB_LATENCYPROBE_H__
+#define __RFB_LATENCYPROBE_H__
+
+#include <stdio.h>
+
+#include <rdr/types.h>
+
+namespace rfb {
+
+  enum LatencyStage {
+    latencyStageDamage,   // Event received until first damage
+    latencyStageGrab,     // First damage until framebuffer grab
+    latencyStageEncode,   // Grab until the update is encoded
+    latencyStageWrite,    // Encoded until queued on the socket
+    latencyStageNetwork,  // Both directions on the network
+    latencyStageDecode,   // Update received until decoded
+    latencyStagePresent,  // Decoded until put on screen
+    latencyStageTotal,    // Event sent until put on screen
+
+    latencyStageCount
+  };
+
+  // The stages the server measures come first
+  const int latencyServerStages = latencyStageWrite + 1;
+
+  const char* latencyStageName(int stage);
+
+  struct LatencyProbe {
+    LatencyProbe();
+
+    // Fence payloads of this size and with the right marker are probes.
+    // The size is chosen not to collide with other fence payloads.
+    static const unsigned payloadSize = 4 + 4 + 4 + latencyServerStages * 4;
+
+    static bool isProbe(unsigned len, const char data[]);
+
+    void read(const char data[]);
+    void write(char data[]) const;
+
+    rdr::U32 id;
+    // Set by a server that has filled in serverTime
+    bool measured;
+    // Microseconds spent in each server stage
+    rdr::U32 serverTime[latencyServerStages];
+  };
+
+  class LatencyHistogram {
+  public:
+    LatencyHistogram();
+
+    void clear();
+
+    // add() records the time in microseconds for each stage
+    void add(const unsigned times[latencyStageCount]);
+
+    unsigned getCount() const { return samples; }
+
+    // percentile() returns the upper bound, in microseconds, of the
+    // bucket containing the given percentile of a stage
+    unsigned percentile(int stage, unsigned pct) const;
+
+    static const int bucketCount = 20;
+    // Upper bound of each bucket in microseconds, the last is unbounded
+    static unsigned bucketLimit(int bucket);
+    unsigned bucketSamples(int stage, int bucket) const {
+      return buckets[stage][bucket];
+    }
+
+    // write() outputs the histogram as comma separated values, one
+    // row per bucket and one column per stage
+    void write(FILE* f) const;
+
+  private:
+    unsigned samples;
+    unsigned buckets[latencyStageCount][bucketCount];
+  };
+
+}
+
+#endif
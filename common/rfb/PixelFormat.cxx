@@ -72,6 +72,9 @@ PixelFormat::Init::Init()
     for (i = 0;i <= 255;i++)
       subDownTable[i] = (i * maxVal + 128) / 255;
   }
+
+  maxSIMDLevel = detectSIMDLevel();
+  simdLevel = maxSIMDLevel;
 }
 
 
@@ -377,7 +380,21 @@ void PixelFormat::bufferFromBuffer(rdr::U8* dst, const PixelFormat &srcPF,
       dst += dstStride * bpp/8;
       src += srcStride * srcPF.bpp/8;
     }
-  } else if (is888() && srcPF.is888()) {
+    return;
+  }
+
+  // The SIMD code does whole blocks of columns, leaving the last few
+  // for the code below
+  int simdWidth = simdBufferFromBuffer(dst, srcPF, src, w, h,
+                                       dstStride, srcStride);
+  if (simdWidth == w)
+    return;
+
+  dst += simdWidth * bpp/8;
+  src += simdWidth * srcPF.bpp/8;
+  w -= simdWidth;
+
+  if (is888() && srcPF.is888()) {
     // Optimised common case A: byte shuffling (e.g. endian conversion)
     rdr::U8 *d[4], *s[4];
     int dstPad, srcPad;
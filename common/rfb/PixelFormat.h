@@ -86,6 +86,14 @@ namespace rfb {
     void print(char* str, int len) const;
     bool parse(const char* str);
 
+    // The conversions use the best SIMD instructions the CPU has. The
+    // level can be lowered, mostly to compare the implementations.
+    enum SIMDLevel { simdNone, simdSSE2, simdAVX2 };
+
+    static SIMDLevel getSIMDLevel();
+    static SIMDLevel getMaxSIMDLevel();
+    static void setSIMDLevel(SIMDLevel level);
+
   protected:
     void updateState(void);
     bool isSane(void);
@@ -113,6 +121,14 @@ namespace rfb {
                                      const rdr::U32* src, int w, int h,
                                      int dstStride, int srcStride) const;
 
+    // SIMD versions of the common cases, returning how many columns
+    // they handled
+    int simdBufferFromBuffer(rdr::U8* dst, const PixelFormat &srcPF,
+                             const rdr::U8* src, int w, int h,
+                             int dstStride, int srcStride) const;
+
+    static SIMDLevel detectSIMDLevel();
+
   public:
     int bpp;
     int depth;
@@ -139,6 +155,8 @@ namespace rfb {
     static rdr::U8 upconvTable[256*8];
     static rdr::U8 downconvTable[256*8];
 
+    static SIMDLevel simdLevel, maxSIMDLevel;
+
     class Init;
     friend class Init;
     static Init _init;
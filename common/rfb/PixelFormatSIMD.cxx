@@ -0,0 +1,553 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// SIMD versions of the most common conversions in bufferFromBuffer().
+// They are compiled for each instruction set with function attributes
+// and picked at runtime, so the rest of the code does not need any
+// special compiler flags. The results are identical to the plain
+// versions, including the rounding done by the conversion tables.
+//
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <rfb/PixelFormat.h>
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace rfb;
+
+PixelFormat::SIMDLevel PixelFormat::simdLevel;
+PixelFormat::SIMDLevel PixelFormat::maxSIMDLevel;
+
+#ifdef HAVE_X86_SIMD
+
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+// Multiplier and shift that turn i*255 in to i*255/max, rounded the
+// same way as upconvTable. Indexed by the number of bits, and only
+// 2 to 7 bit channels have one.
+static const struct {
+  int mul;
+  int shift;
+} upconvMagic[9] = {
+  { 0, 0 }, { 0, 0 }, { 21846, 0 }, { 9363, 0 }, { 4370, 0 },
+  { 8457, 2 }, { 8323, 3 }, { 33027, 6 }, { 0, 0 }
+};
+
+// Channel layout of each kind of conversion
+
+struct ShuffleParams {
+  // Which source byte ends up in each destination byte
+  int srcByte[4];
+};
+
+struct From888Params {
+  // Byte offsets of red, green and blue in the source
+  int srcByte[3];
+  int max[3];
+  int shift[3];
+  bool swap;
+};
+
+struct To888Params {
+  int shift[3];
+  int max[3];
+  int mul[3];
+  int mulShift[3];
+  // Byte offsets of red, green and blue in the destination
+  int dstByte[3];
+  bool swap;
+};
+
+//
+// SSE2
+//
+
+TARGET_SSE2
+static void shuffle888SSE2(rdr::U8* dst, const rdr::U8* src,
+                           int w, int h, int dstStride, int srcStride,
+                           const ShuffleParams& p)
+{
+  __m128i mask, shr[4], shl[4];
+
+  mask = _mm_set1_epi32(0xff);
+  for (int i = 0; i < 4; i++) {
+    shr[i] = _mm_cvtsi32_si128(p.srcByte[i] * 8);
+    shl[i] = _mm_cvtsi32_si128(i * 8);
+  }
+
+  while (h--) {
+    for (int x = 0; x < w; x += 4) {
+      __m128i s, d;
+
+      s = _mm_loadu_si128((const __m128i*)(src + x * 4));
+
+      d = _mm_setzero_si128();
+      for (int i = 0; i < 4; i++) {
+        __m128i c;
+        c = _mm_and_si128(_mm_srl_epi32(s, shr[i]), mask);
+        d = _mm_or_si128(d, _mm_sll_epi32(c, shl[i]));
+      }
+
+      _mm_storeu_si128((__m128i*)(dst + x * 4), d);
+    }
+
+    dst += dstStride * 4;
+    src += srcStride * 4;
+  }
+}
+
+TARGET_SSE2
+static inline __m128i downconvSSE2(__m128i s, __m128i srcShift,
+                                   __m128i max, __m128i dstShift)
+{
+  __m128i c;
+
+  c = _mm_and_si128(_mm_srl_epi32(s, srcShift), _mm_set1_epi32(0xff));
+
+  // (c * max + 128) / 255, where x / 255 is (x + 1 + (x >> 8)) >> 8
+  // for anything that fits in 16 bits
+  c = _mm_add_epi32(_mm_mullo_epi16(c, max), _mm_set1_epi32(128));
+  c = _mm_add_epi32(c, _mm_add_epi32(_mm_srli_epi32(c, 8),
+                                     _mm_set1_epi32(1)));
+  c = _mm_srli_epi32(c, 8);
+
+  return _mm_sll_epi32(c, dstShift);
+}
+
+TARGET_SSE2
+static void from888To16SSE2(rdr::U8* dst, const rdr::U8* src,
+                            int w, int h, int dstStride, int srcStride,
+                            const From888Params& p)
+{
+  __m128i srcShift[3], max[3], dstShift[3];
+
+  for (int i = 0; i < 3; i++) {
+    srcShift[i] = _mm_cvtsi32_si128(p.srcByte[i] * 8);
+    max[i] = _mm_set1_epi32(p.max[i]);
+    dstShift[i] = _mm_cvtsi32_si128(p.shift[i]);
+  }
+
+  while (h--) {
+    for (int x = 0; x < w; x += 8) {
+      __m128i s[2], d[2], out;
+
+      s[0] = _mm_loadu_si128((const __m128i*)(src + x * 4));
+      s[1] = _mm_loadu_si128((const __m128i*)(src + x * 4 + 16));
+
+      for (int j = 0; j < 2; j++) {
+        d[j] = downconvSSE2(s[j], srcShift[0], max[0], dstShift[0]);
+        d[j] = _mm_or_si128(d[j], downconvSSE2(s[j], srcShift[1],
+                                               max[1], dstShift[1]));
+        d[j] = _mm_or_si128(d[j], downconvSSE2(s[j], srcShift[2],
+                                               max[2], dstShift[2]));
+        // Sign extend so the signed pack keeps all 16 bits
+        d[j] = _mm_srai_epi32(_mm_slli_epi32(d[j], 16), 16);
+      }
+
+      out = _mm_packs_epi32(d[0], d[1]);
+      if (p.swap)
+        out = _mm_or_si128(_mm_slli_epi16(out, 8), _mm_srli_epi16(out, 8));
+
+      _mm_storeu_si128((__m128i*)(dst + x * 2), out);
+    }
+
+    dst += dstStride * 2;
+    src += srcStride * 4;
+  }
+}
+
+TARGET_SSE2
+static inline __m128i upconvSSE2(__m128i s, __m128i shift, __m128i max,
+                                 __m128i mul, __m128i mulShift)
+{
+  __m128i c;
+
+  c = _mm_and_si128(_mm_srl_epi16(s, shift), max);
+  c = _mm_mullo_epi16(c, _mm_set1_epi16(255));
+  c = _mm_mulhi_epu16(c, mul);
+
+  return _mm_srl_epi16(c, mulShift);
+}
+
+TARGET_SSE2
+static void from16To888SSE2(rdr::U8* dst, const rdr::U8* src,
+                            int w, int h, int dstStride, int srcStride,
+                            const To888Params& p)
+{
+  __m128i shift[3], max[3], mul[3], mulShift[3], dstShift[3];
+  __m128i zero;
+
+  for (int i = 0; i < 3; i++) {
+    shift[i] = _mm_cvtsi32_si128(p.shift[i]);
+    max[i] = _mm_set1_epi16(p.max[i]);
+    mul[i] = _mm_set1_epi16(p.mul[i]);
+    mulShift[i] = _mm_cvtsi32_si128(p.mulShift[i]);
+    dstShift[i] = _mm_cvtsi32_si128(p.dstByte[i] * 8);
+  }
+
+  zero = _mm_setzero_si128();
+
+  while (h--) {
+    for (int x = 0; x < w; x += 8) {
+      __m128i s, lo, hi;
+
+      s = _mm_loadu_si128((const __m128i*)(src + x * 2));
+      if (p.swap)
+        s = _mm_or_si128(_mm_slli_epi16(s, 8), _mm_srli_epi16(s, 8));
+
+      lo = zero;
+      hi = zero;
+      for (int i = 0; i < 3; i++) {
+        __m128i c;
+        c = upconvSSE2(s, shift[i], max[i], mul[i], mulShift[i]);
+        lo = _mm_or_si128(lo, _mm_sll_epi32(_mm_unpacklo_epi16(c, zero),
+                                            dstShift[i]));
+        hi = _mm_or_si128(hi, _mm_sll_epi32(_mm_unpackhi_epi16(c, zero),
+                                            dstShift[i]));
+      }
+
+      _mm_storeu_si128((__m128i*)(dst + x * 4), lo);
+      _mm_storeu_si128((__m128i*)(dst + x * 4 + 16), hi);
+    }
+
+    dst += dstStride * 4;
+    src += srcStride * 2;
+  }
+}
+
+//
+// AVX2
+//
+
+TARGET_AVX2
+static void shuffle888AVX2(rdr::U8* dst, const rdr::U8* src,
+                           int w, int h, int dstStride, int srcStride,
+                           const ShuffleParams& p)
+{
+  char table[32];
+  __m256i mask;
+
+  // The shuffle works within each 128 bit half, i.e. four pixels
+  for (int i = 0; i < 32; i++)
+    table[i] = (i & ~3 & 15) + p.srcByte[i & 3];
+  mask = _mm256_loadu_si256((const __m256i*)table);
+
+  while (h--) {
+    for (int x = 0; x < w; x += 8) {
+      __m256i s;
+      s = _mm256_loadu_si256((const __m256i*)(src + x * 4));
+      _mm256_storeu_si256((__m256i*)(dst + x * 4),
+                          _mm256_shuffle_epi8(s, mask));
+    }
+
+    dst += dstStride * 4;
+    src += srcStride * 4;
+  }
+}
+
+TARGET_AVX2
+static inline __m256i downconvAVX2(__m256i s, __m128i srcShift,
+                                   __m256i max, __m128i dstShift)
+{
+  __m256i c;
+
+  c = _mm256_and_si256(_mm256_srl_epi32(s, srcShift),
+                       _mm256_set1_epi32(0xff));
+
+  c = _mm256_add_epi32(_mm256_mullo_epi16(c, max),
+                       _mm256_set1_epi32(128));
+  c = _mm256_add_epi32(c, _mm256_add_epi32(_mm256_srli_epi32(c, 8),
+                                           _mm256_set1_epi32(1)));
+  c = _mm256_srli_epi32(c, 8);
+
+  return _mm256_sll_epi32(c, dstShift);
+}
+
+TARGET_AVX2
+static void from888To16AVX2(rdr::U8* dst, const rdr::U8* src,
+                            int w, int h, int dstStride, int srcStride,
+                            const From888Params& p)
+{
+  __m128i srcShift[3], dstShift[3];
+  __m256i max[3];
+
+  for (int i = 0; i < 3; i++) {
+    srcShift[i] = _mm_cvtsi32_si128(p.srcByte[i] * 8);
+    max[i] = _mm256_set1_epi32(p.max[i]);
+    dstShift[i] = _mm_cvtsi32_si128(p.shift[i]);
+  }
+
+  while (h--) {
+    for (int x = 0; x < w; x += 16) {
+      __m256i s[2], d[2], out;
+
+      s[0] = _mm256_loadu_si256((const __m256i*)(src + x * 4));
+      s[1] = _mm256_loadu_si256((const __m256i*)(src + x * 4 + 32));
+
+      for (int j = 0; j < 2; j++) {
+        d[j] = downconvAVX2(s[j], srcShift[0], max[0], dstShift[0]);
+        d[j] = _mm256_or_si256(d[j], downconvAVX2(s[j], srcShift[1],
+                                                  max[1], dstShift[1]));
+        d[j] = _mm256_or_si256(d[j], downconvAVX2(s[j], srcShift[2],
+                                                  max[2], dstShift[2]));
+        d[j] = _mm256_srai_epi32(_mm256_slli_epi32(d[j], 16), 16);
+      }
+
+      // The pack works within each half, so the middle quarters end
+      // up swapped
+      out = _mm256_packs_epi32(d[0], d[1]);
+      out = _mm256_permute4x64_epi64(out, 0xd8);
+      if (p.swap)
+        out = _mm256_or_si256(_mm256_slli_epi16(out, 8),
+                              _mm256_srli_epi16(out, 8));
+
+      _mm256_storeu_si256((__m256i*)(dst + x * 2), out);
+    }
+
+    dst += dstStride * 2;
+    src += srcStride * 4;
+  }
+}
+
+TARGET_AVX2
+static inline __m256i upconvAVX2(__m256i s, __m128i shift, __m256i max,
+                                 __m256i mul, __m128i mulShift)
+{
+  __m256i c;
+
+  c = _mm256_and_si256(_mm256_srl_epi16(s, shift), max);
+  c = _mm256_mullo_epi16(c, _mm256_set1_epi16(255));
+  c = _mm256_mulhi_epu16(c, mul);
+
+  return _mm256_srl_epi16(c, mulShift);
+}
+
+TARGET_AVX2
+static void from16To888AVX2(rdr::U8* dst, const rdr::U8* src,
+                            int w, int h, int dstStride, int srcStride,
+                            const To888Params& p)
+{
+  __m128i shift[3], mulShift[3], dstShift[3];
+  __m256i max[3], mul[3];
+  __m256i zero;
+
+  for (int i = 0; i < 3; i++) {
+    shift[i] = _mm_cvtsi32_si128(p.shift[i]);
+    max[i] = _mm256_set1_epi16(p.max[i]);
+    mul[i] = _mm256_set1_epi16(p.mul[i]);
+    mulShift[i] = _mm_cvtsi32_si128(p.mulShift[i]);
+    dstShift[i] = _mm_cvtsi32_si128(p.dstByte[i] * 8);
+  }
+
+  zero = _mm256_setzero_si256();
+
+  while (h--) {
+    for (int x = 0; x < w; x += 16) {
+      __m256i s, lo, hi;
+
+      s = _mm256_loadu_si256((const __m256i*)(src + x * 2));
+      if (p.swap)
+        s = _mm256_or_si256(_mm256_slli_epi16(s, 8),
+                            _mm256_srli_epi16(s, 8));
+
+      // The unpack works within each half, so put the first eight
+      // pixels in the lower part of both halves
+      s = _mm256_permute4x64_epi64(s, 0xd8);
+
+      lo = zero;
+      hi = zero;
+      for (int i = 0; i < 3; i++) {
+        __m256i c;
+        c = upconvAVX2(s, shift[i], max[i], mul[i], mulShift[i]);
+        lo = _mm256_or_si256(lo, _mm256_sll_epi32(
+                                   _mm256_unpacklo_epi16(c, zero),
+                                   dstShift[i]));
+        hi = _mm256_or_si256(hi, _mm256_sll_epi32(
+                                   _mm256_unpackhi_epi16(c, zero),
+                                   dstShift[i]));
+      }
+
+      _mm256_storeu_si256((__m256i*)(dst + x * 4), lo);
+      _mm256_storeu_si256((__m256i*)(dst + x * 4 + 32), hi);
+    }
+
+    dst += dstStride * 4;
+    src += srcStride * 2;
+  }
+}
+
+#endif /* HAVE_X86_SIMD */
+
+PixelFormat::SIMDLevel PixelFormat::getSIMDLevel()
+{
+  return simdLevel;
+}
+
+PixelFormat::SIMDLevel PixelFormat::getMaxSIMDLevel()
+{
+  return maxSIMDLevel;
+}
+
+void PixelFormat::setSIMDLevel(SIMDLevel level)
+{
+  if (level > maxSIMDLevel)
+    level = maxSIMDLevel;
+  simdLevel = level;
+}
+
+PixelFormat::SIMDLevel PixelFormat::detectSIMDLevel()
+{
+#ifdef HAVE_X86_SIMD
+  // This gets called from a static constructor, before the CPU
+  // information is normally set up
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2"))
+    return simdAVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return simdSSE2;
+#endif
+
+  return simdNone;
+}
+
+int PixelFormat::simdBufferFromBuffer(rdr::U8* dst,
+                                      const PixelFormat &srcPF,
+                                      const rdr::U8* src, int w, int h,
+                                      int dstStride, int srcStride) const
+{
+#ifdef HAVE_X86_SIMD
+  int lanes;
+
+  if (simdLevel == simdNone)
+    return 0;
+
+  lanes = (simdLevel == simdAVX2) ? 16 : 8;
+  if (w < lanes)
+    return 0;
+  w &= ~(lanes - 1);
+
+  if (is888() && srcPF.is888()) {
+    ShuffleParams p;
+    int dstByte[4], srcByte[4];
+
+    dstByte[0] = redShift/8;
+    dstByte[1] = greenShift/8;
+    dstByte[2] = blueShift/8;
+    dstByte[3] = (48 - redShift - greenShift - blueShift)/8;
+    if (bigEndian) {
+      for (int i = 0; i < 4; i++)
+        dstByte[i] = 3 - dstByte[i];
+    }
+
+    srcByte[0] = srcPF.redShift/8;
+    srcByte[1] = srcPF.greenShift/8;
+    srcByte[2] = srcPF.blueShift/8;
+    srcByte[3] = (48 - srcPF.redShift - srcPF.greenShift -
+                  srcPF.blueShift)/8;
+    if (srcPF.bigEndian) {
+      for (int i = 0; i < 4; i++)
+        srcByte[i] = 3 - srcByte[i];
+    }
+
+    for (int i = 0; i < 4; i++)
+      p.srcByte[dstByte[i]] = srcByte[i];
+
+    if (simdLevel == simdAVX2)
+      shuffle888AVX2(dst, src, w, h, dstStride, srcStride, p);
+    else
+      shuffle888SSE2(dst, src, w, h, dstStride, srcStride, p);
+
+    return w;
+  }
+
+  if ((bpp == 16) && srcPF.is888()) {
+    From888Params p;
+
+    p.srcByte[0] = srcPF.redShift/8;
+    p.srcByte[1] = srcPF.greenShift/8;
+    p.srcByte[2] = srcPF.blueShift/8;
+    if (srcPF.bigEndian) {
+      for (int i = 0; i < 3; i++)
+        p.srcByte[i] = 3 - p.srcByte[i];
+    }
+
+    p.max[0] = redMax;
+    p.max[1] = greenMax;
+    p.max[2] = blueMax;
+    p.shift[0] = redShift;
+    p.shift[1] = greenShift;
+    p.shift[2] = blueShift;
+    p.swap = endianMismatch;
+
+    if (simdLevel == simdAVX2)
+      from888To16AVX2(dst, src, w, h, dstStride, srcStride, p);
+    else
+      from888To16SSE2(dst, src, w, h, dstStride, srcStride, p);
+
+    return w;
+  }
+
+  if (is888() && (srcPF.bpp == 16)) {
+    To888Params p;
+    int bits[3];
+
+    bits[0] = srcPF.redBits;
+    bits[1] = srcPF.greenBits;
+    bits[2] = srcPF.blueBits;
+    for (int i = 0; i < 3; i++) {
+      if (upconvMagic[bits[i]].mul == 0)
+        return 0;
+      p.mul[i] = upconvMagic[bits[i]].mul;
+      p.mulShift[i] = upconvMagic[bits[i]].shift;
+    }
+
+    p.shift[0] = srcPF.redShift;
+    p.shift[1] = srcPF.greenShift;
+    p.shift[2] = srcPF.blueShift;
+    p.max[0] = srcPF.redMax;
+    p.max[1] = srcPF.greenMax;
+    p.max[2] = srcPF.blueMax;
+    p.swap = srcPF.endianMismatch;
+
+    p.dstByte[0] = redShift/8;
+    p.dstByte[1] = greenShift/8;
+    p.dstByte[2] = blueShift/8;
+    if (bigEndian) {
+      for (int i = 0; i < 3; i++)
+        p.dstByte[i] = 3 - p.dstByte[i];
+    }
+
+    if (simdLevel == simdAVX2)
+      from16To888AVX2(dst, src, w, h, dstStride, srcStride, p);
+    else
+      from16To888SSE2(dst, src, w, h, dstStride, srcStride, p);
+
+    return w;
+  }
+#endif
+
+  return 0;
+}
@@ -57,7 +57,8 @@ void RREDecoder::readRect(const Rect& r, rdr::InStream* is,
 
 void RREDecoder::decodeRect(const Rect& r, const void* buffer,
                             size_t buflen, const ConnParams& cp,
-                            ModifiablePixelBuffer* pb)
+                            ModifiablePixelBuffer* pb,
+                            DecoderContext* ctx)
 {
   rdr::MemInStream is(buffer, buflen);
   const PixelFormat& pf = cp.pf();
@@ -41,7 +41,8 @@ void RawDecoder::readRect(const Rect& r, rdr::InStream* is,
 
 void RawDecoder::decodeRect(const Rect& r, const void* buffer,
                             size_t buflen, const ConnParams& cp,
-                            ModifiablePixelBuffer* pb)
+                            ModifiablePixelBuffer* pb,
+                            DecoderContext* ctx)
 {
   assert(buflen >= (size_t)r.area() * (cp.pf().bpp/8));
   pb->imageRect(cp.pf(), r, buffer);
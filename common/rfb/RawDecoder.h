@@ -29,7 +29,8 @@ namespace rfb {
                           const ConnParams& cp, rdr::OutStream* os);
     virtual void decodeRect(const Rect& r, const void* buffer,
                             size_t buflen, const ConnParams& cp,
-                            ModifiablePixelBuffer* pb);
+                            ModifiablePixelBuffer* pb,
+                            DecoderContext* ctx);
   };
 }
 #endif
@@ -289,6 +289,14 @@ void SConnection::supportsQEMUKeyEvent()
   writer()->writeQEMUKeyEvent();
 }
 
+void SConnection::supportsSharedMemory()
+{
+  if (!Server::sharedMemory)
+    return;
+
+  writer()->writeSharedMemory();
+}
+
 void SConnection::versionReceived()
 {
 }
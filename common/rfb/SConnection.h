@@ -75,6 +75,8 @@ namespace rfb {
 
     virtual void supportsQEMUKeyEvent();
 
+    virtual void supportsSharedMemory();
+
     // Methods to be overridden in a derived class
 
     // versionReceived() indicates that the version number has just been read
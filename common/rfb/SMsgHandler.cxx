@@ -42,12 +42,13 @@ void SMsgHandler::setPixelFormat(const PixelFormat& pf)
 void SMsgHandler::setEncodings(int nEncodings, const rdr::S32* encodings)
 {
   bool firstFence, firstContinuousUpdates, firstLEDState,
-       firstQEMUKeyEvent;
+       firstQEMUKeyEvent, firstSharedMemory;
 
   firstFence = !cp.supportsFence;
   firstContinuousUpdates = !cp.supportsContinuousUpdates;
   firstLEDState = !cp.supportsLEDState;
   firstQEMUKeyEvent = !cp.supportsQEMUKeyEvent;
+  firstSharedMemory = !cp.supportsSharedMemory;
 
   cp.setEncodings(nEncodings, encodings);
 
@@ -61,6 +62,8 @@ void SMsgHandler::setEncodings(int nEncodings, const rdr::S32* encodings)
     supportsLEDState();
   if (cp.supportsQEMUKeyEvent && firstQEMUKeyEvent)
     supportsQEMUKeyEvent();
+  if (cp.supportsSharedMemory && firstSharedMemory)
+    supportsSharedMemory();
 }
 
 void SMsgHandler::supportsLocalCursor()
@@ -83,6 +86,14 @@ void SMsgHandler::supportsQEMUKeyEvent()
 {
 }
 
+void SMsgHandler::supportsSharedMemory()
+{
+}
+
+void SMsgHandler::setSharedMemory(int shmid, const rdr::U8* key)
+{
+}
+
 void SMsgHandler::setDesktopSize(int fb_width, int fb_height,
                                  const ScreenSet& layout)
 {
@@ -53,6 +53,7 @@ namespace rfb {
     virtual void fence(rdr::U32 flags, unsigned len, const char data[]) = 0;
     virtual void enableContinuousUpdates(bool enable,
                                          int x, int y, int w, int h) = 0;
+    virtual void setSharedMemory(int shmid, const rdr::U8* key);
 
     // InputHandler interface
     // The InputHandler methods will be called for the corresponding messages.
@@ -85,6 +86,12 @@ namespace rfb {
     // handler will send a pseudo-rect back, signalling server support.
     virtual void supportsQEMUKeyEvent();
 
+    // supportsSharedMemory() is called the first time we detect that the
+    // client can receive framebuffer updates through shared memory. A
+    // pseudo-rect should be sent back so that the client can set up a
+    // segment and tell us about it.
+    virtual void supportsSharedMemory();
+
     ConnParams cp;
   };
 }
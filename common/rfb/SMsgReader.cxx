@@ -24,6 +24,7 @@
 #include <rfb/util.h>
 #include <rfb/SMsgHandler.h>
 #include <rfb/SMsgReader.h>
+#include <rfb/SharedMemory.h>
 #include <rfb/Configuration.h>
 #include <rfb/LogWriter.h>
 
@@ -70,6 +71,9 @@ void SMsgReader::readMsg()
   case msgTypeClientFence:
     readFence();
     break;
+  case msgTypeSetSharedMemory:
+    readSetSharedMemory();
+    break;
   case msgTypeKeyEvent:
     readKeyEvent();
     break;
@@ -183,6 +187,17 @@ void SMsgReader::readFence()
   handler->fence(flags, len, data);
 }
 
+void SMsgReader::readSetSharedMemory()
+{
+  rdr::U8 key[SharedMemory::keyLength];
+
+  is->skip(3);
+  int shmid = is->readU32();
+  is->readBytes(key, sizeof(key));
+
+  handler->setSharedMemory(shmid, key);
+}
+
 void SMsgReader::readKeyEvent()
 {
   bool down = is->readU8();
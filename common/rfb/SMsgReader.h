@@ -51,6 +51,8 @@ namespace rfb {
 
     void readFence();
 
+    void readSetSharedMemory();
+
     void readKeyEvent();
     void readPointerEvent();
     void readClientCutText();
@@ -18,6 +18,7 @@
  * USA.
  */
 #include <stdio.h>
+#include <string.h>
 #include <rdr/OutStream.h>
 #include <rfb/msgTypes.h>
 #include <rfb/fenceTypes.h>
@@ -39,12 +40,19 @@ SMsgWriter::SMsgWriter(ConnParams* cp_, rdr::OutStream* os_)
     needSetDesktopSize(false), needExtendedDesktopSize(false),
     needSetDesktopName(false), needSetCursor(false),
     needSetXCursor(false), needSetCursorWithAlpha(false),
-    needLEDState(false), needQEMUKeyEvent(false)
+    needLEDState(false), needQEMUKeyEvent(false),
+    needSharedMemory(false), cursorCacheClock(0)
 {
+  for (int i = 0; i < cursorCacheMaxEntries; i++) {
+    cursorCache[i] = NULL;
+    cursorCacheUsed[i] = 0;
+  }
 }
 
 SMsgWriter::~SMsgWriter()
 {
+  for (int i = 0; i < cursorCacheMaxEntries; i++)
+    delete cursorCache[i];
 }
 
 void SMsgWriter::writeServerInit()
@@ -217,6 +225,16 @@ bool SMsgWriter::writeQEMUKeyEvent()
   return true;
 }
 
+bool SMsgWriter::writeSharedMemory()
+{
+  if (!cp->supportsSharedMemory)
+    return false;
+
+  needSharedMemory = true;
+
+  return true;
+}
+
 bool SMsgWriter::needFakeUpdate()
 {
   if (needSetDesktopName)
@@ -227,6 +245,8 @@ bool SMsgWriter::needFakeUpdate()
     return true;
   if (needQEMUKeyEvent)
     return true;
+  if (needSharedMemory)
+    return true;
   if (needNoDataUpdate())
     return true;
 
@@ -279,6 +299,8 @@ void SMsgWriter::writeFramebufferUpdateStart(int nRects)
       nRects++;
     if (needQEMUKeyEvent)
       nRects++;
+    if (needSharedMemory)
+      nRects++;
   }
 
   os->writeU16(nRects);
@@ -318,6 +340,13 @@ void SMsgWriter::writeCopyRect(const Rect& r, int srcX, int srcY)
   endRect();
 }
 
+void SMsgWriter::writeSharedMemoryDataRect(const Rect& r, int shmid)
+{
+  startRect(r,encodingSharedMemory);
+  os->writeU32(shmid);
+  endRect();
+}
+
 void SMsgWriter::startRect(const Rect& r, int encoding)
 {
   if (++nRectsInUpdate > nRectsInHeader && nRectsInHeader)
@@ -347,6 +376,23 @@ void SMsgWriter::endMsg()
 
 void SMsgWriter::writePseudoRects()
 {
+  if ((needSetCursor || needSetXCursor || needSetCursorWithAlpha) &&
+      cp->supportsCursorCache) {
+    const Cursor& cursor = cp->cursor();
+    int slot;
+
+    slot = findCachedCursor(cursor);
+    if (slot != -1) {
+      // The client marks the slot as used when it gets the rect
+      cursorCacheUsed[slot] = ++cursorCacheClock;
+      writeCursorCacheRect(cursor.width(), cursor.height(),
+                           cursor.hotspot().x, cursor.hotspot().y, slot);
+      needSetCursor = false;
+      needSetXCursor = false;
+      needSetCursorWithAlpha = false;
+    }
+  }
+
   if (needSetCursor) {
     const Cursor& cursor = cp->cursor();
 
@@ -367,6 +413,7 @@ void SMsgWriter::writePseudoRects()
     writeSetCursorRect(cursor.width(), cursor.height(),
                        cursor.hotspot().x, cursor.hotspot().y,
                        data.buf, mask.buf);
+    cacheCursor(cursor);
     needSetCursor = false;
   }
 
@@ -378,6 +425,7 @@ void SMsgWriter::writePseudoRects()
     writeSetXCursorRect(cursor.width(), cursor.height(),
                         cursor.hotspot().x, cursor.hotspot().y,
                         bitmap.buf, mask.buf);
+    cacheCursor(cursor);
     needSetXCursor = false;
   }
 
@@ -387,6 +435,7 @@ void SMsgWriter::writePseudoRects()
     writeSetCursorWithAlphaRect(cursor.width(), cursor.height(),
                                 cursor.hotspot().x, cursor.hotspot().y,
                                 cursor.getBuffer());
+    cacheCursor(cursor);
     needSetCursorWithAlpha = false;
   }
 
@@ -404,6 +453,11 @@ void SMsgWriter::writePseudoRects()
     writeQEMUKeyEventRect();
     needQEMUKeyEvent = false;
   }
+
+  if (needSharedMemory) {
+    writeSharedMemoryRect();
+    needSharedMemory = false;
+  }
 }
 
 void SMsgWriter::writeNoDataRects()
@@ -568,6 +622,22 @@ void SMsgWriter::writeSetCursorWithAlphaRect(int width, int height,
   }
 }
 
+void SMsgWriter::writeCursorCacheRect(int width, int height,
+                                      int hotspotX, int hotspotY, int slot)
+{
+  if (!cp->supportsCursorCache)
+    throw Exception("Client does not support the cursor cache");
+  if (++nRectsInUpdate > nRectsInHeader && nRectsInHeader)
+    throw Exception("SMsgWriter::writeCursorCacheRect: nRects out of sync");
+
+  os->writeS16(hotspotX);
+  os->writeS16(hotspotY);
+  os->writeU16(width);
+  os->writeU16(height);
+  os->writeU32(pseudoEncodingCursorCache);
+  os->writeU8(slot);
+}
+
 void SMsgWriter::writeLEDStateRect(rdr::U8 state)
 {
   if (!cp->supportsLEDState)
@@ -598,3 +668,58 @@ void SMsgWriter::writeQEMUKeyEventRect()
   os->writeU16(0);
   os->writeU32(pseudoEncodingQEMUKeyEvent);
 }
+
+void SMsgWriter::writeSharedMemoryRect()
+{
+  if (!cp->supportsSharedMemory)
+    throw Exception("Client does not support shared memory");
+  if (++nRectsInUpdate > nRectsInHeader && nRectsInHeader)
+    throw Exception("SMsgWriter::writeSharedMemoryRect: nRects out of sync");
+
+  os->writeS16(0);
+  os->writeS16(0);
+  os->writeU16(0);
+  os->writeU16(0);
+  os->writeU32(pseudoEncodingSharedMemory);
+}
+
+int SMsgWriter::findCachedCursor(const Cursor& cursor)
+{
+  for (int i = 0; i < cursorCacheMaxEntries; i++) {
+    const Cursor* cached;
+
+    cached = cursorCache[i];
+    if (cached == NULL)
+      continue;
+
+    if ((cached->width() != cursor.width()) ||
+        (cached->height() != cursor.height()))
+      continue;
+    if (!cached->hotspot().equals(cursor.hotspot()))
+      continue;
+    if (memcmp(cached->getBuffer(), cursor.getBuffer(),
+               cursor.width() * cursor.height() * 4) != 0)
+      continue;
+
+    return i;
+  }
+
+  return -1;
+}
+
+void SMsgWriter::cacheCursor(const Cursor& cursor)
+{
+  int slot;
+
+  // The client does the same for every cursor it gets, regardless of
+  // if it supports the cache or not
+  slot = 0;
+  for (int i = 1; i < cursorCacheMaxEntries; i++) {
+    if (cursorCacheUsed[i] < cursorCacheUsed[slot])
+      slot = i;
+  }
+
+  delete cursorCache[slot];
+  cursorCache[slot] = new Cursor(cursor);
+  cursorCacheUsed[slot] = ++cursorCacheClock;
+}
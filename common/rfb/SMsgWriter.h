@@ -24,6 +24,7 @@
 #define __RFB_SMSGWRITER_H__
 
 #include <rdr/types.h>
+#include <rfb/cursorCacheTypes.h>
 #include <rfb/encodings.h>
 #include <rfb/ScreenSet.h>
 
@@ -32,6 +33,7 @@ namespace rdr { class OutStream; }
 namespace rfb {
 
   class ConnParams;
+  class Cursor;
   struct ScreenSet;
 
   class SMsgWriter {
@@ -77,7 +79,8 @@ namespace rfb {
     bool writeSetDesktopName();
 
     // Like setDesktopSize, we can't just write out a cursor message
-    // immediately. 
+    // immediately. If the client has the cursor in its cursor cache,
+    // only a reference to it is sent.
     bool writeSetCursor();
     bool writeSetXCursor();
     bool writeSetCursorWithAlpha();
@@ -88,6 +91,9 @@ namespace rfb {
     // And QEMU keyboard event handshake
     bool writeQEMUKeyEvent();
 
+    // And shared memory handshake
+    bool writeSharedMemory();
+
     // needFakeUpdate() returns true when an immediate update is needed in
     // order to flush out pseudo-rectangles to the client.
     bool needFakeUpdate();
@@ -111,6 +117,10 @@ namespace rfb {
     // There is no explicit encoder for CopyRect rects.
     void writeCopyRect(const Rect& r, int srcX, int srcY);
 
+    // Nor for rects whose pixel data has been placed in the shared
+    // memory segment.
+    void writeSharedMemoryDataRect(const Rect& r, int shmid);
+
     // Encoders should call these to mark the start and stop of individual
     // rects.
     void startRect(const Rect& r, int enc);
@@ -137,8 +147,11 @@ namespace rfb {
     void writeSetCursorWithAlphaRect(int width, int height,
                                      int hotspotX, int hotspotY,
                                      const rdr::U8* data);
+    void writeCursorCacheRect(int width, int height,
+                              int hotspotX, int hotspotY, int slot);
     void writeLEDStateRect(rdr::U8 state);
     void writeQEMUKeyEventRect();
+    void writeSharedMemoryRect();
 
     ConnParams* cp;
     rdr::OutStream* os;
@@ -154,6 +167,15 @@ namespace rfb {
     bool needSetCursorWithAlpha;
     bool needLEDState;
     bool needQEMUKeyEvent;
+    bool needSharedMemory;
+
+    // Mirror of the client's cursor cache
+    int findCachedCursor(const Cursor& cursor);
+    void cacheCursor(const Cursor& cursor);
+
+    Cursor* cursorCache[cursorCacheMaxEntries];
+    unsigned cursorCacheUsed[cursorCacheMaxEntries];
+    unsigned cursorCacheClock;
 
     typedef struct {
       rdr::U16 reason, result;
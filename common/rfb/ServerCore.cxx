@@ -52,10 +52,25 @@ rfb::IntParameter rfb::Server::compareFB
  "Perform pixel comparison on framebuffer to reduce unnecessary updates "
  "(0: never, 1: always, 2: auto)",
  2);
+rfb::BoolParameter rfb::Server::compareFBHashes
+("CompareFBHashes",
+ "Only keep a hash of each part of the framebuffer when performing "
+ "pixel comparison, rather than a full copy",
+ false);
+rfb::BoolParameter rfb::Server::detectScroll
+("DetectScroll",
+ "Look for parts of the framebuffer that have moved when performing "
+ "pixel comparison, and send them as copies",
+ true);
 rfb::IntParameter rfb::Server::frameRate
 ("FrameRate",
  "The maximum number of updates per second sent to each client",
  60);
+rfb::BoolParameter rfb::Server::framePacing
+("FramePacing",
+ "Time the updates after how the application draws and how fast the "
+ "clients can receive them, rather than using a fixed interval",
+ false);
 rfb::BoolParameter rfb::Server::protocol3_3
 ("Protocol3.3",
  "Always use protocol version 3.3 for backwards compatibility with "
@@ -101,3 +116,33 @@ rfb::BoolParameter rfb::Server::queryConnect
 ("QueryConnect",
  "Prompt the local user to accept or reject incoming connections.",
  false);
+rfb::BoolParameter rfb::Server::sharedMemory
+("SharedMemory",
+ "Use shared memory to send framebuffer updates to clients on the same host.",
+ true);
+rfb::BoolParameter rfb::Server::tileCache
+("TileCache",
+ "Send references to tiles the client already has in its cache, rather "
+ "than encoding them again.",
+ true);
+rfb::BoolParameter rfb::Server::shareEncoding
+("ShareEncoding",
+ "Let clients with the same pixel format and encoding settings reuse "
+ "each other's encoded updates.",
+ true);
+rfb::IntParameter rfb::Server::jpegSliceArea
+("JPEGSliceArea",
+ "Split large rectangles that are compressed using JPEG into slices of "
+ "about this many pixels, so that they can be compressed in parallel "
+ "(0 = off)",
+ 0, 0);
+rfb::IntParameter rfb::Server::lz4Bandwidth
+("LZ4Bandwidth",
+ "Switch to the LZ4 encoding for clients that support it once the "
+ "estimated bandwidth is above this many kbit/s (0 = never)",
+ 200000, 0);
+rfb::BoolParameter rfb::Server::adaptiveEncoding
+("AdaptiveEncoding",
+ "Measure the cost of different encoding settings and pick the one "
+ "that gives the highest frame rate for each client",
+ false);
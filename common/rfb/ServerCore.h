@@ -38,7 +38,10 @@ namespace rfb {
     static IntParameter maxIdleTime;
     static IntParameter clientWaitTimeMillis;
     static IntParameter compareFB;
+    static BoolParameter compareFBHashes;
+    static BoolParameter detectScroll;
     static IntParameter frameRate;
+    static BoolParameter framePacing;
     static BoolParameter protocol3_3;
     static BoolParameter alwaysShared;
     static BoolParameter neverShared;
@@ -49,6 +52,12 @@ namespace rfb {
     static BoolParameter sendCutText;
     static BoolParameter acceptSetDesktopSize;
     static BoolParameter queryConnect;
+    static BoolParameter sharedMemory;
+    static BoolParameter tileCache;
+    static BoolParameter shareEncoding;
+    static IntParameter jpegSliceArea;
+    static IntParameter lz4Bandwidth;
+    static BoolParameter adaptiveEncoding;
 
   };
 
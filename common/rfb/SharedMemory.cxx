@@ -0,0 +1,180 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <string.h>
+#include <errno.h>
+
+#ifndef WIN32
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#endif
+
+#include <rdr/Exception.h>
+#include <rdr/RandomStream.h>
+#include <rfb/Exception.h>
+#include <rfb/PixelFormat.h>
+#include <rfb/Rect.h>
+#include <rfb/SharedMemory.h>
+
+using namespace rfb;
+
+static const char magic[8] = { 'R', 'F', 'B', 'S', 'H', 'M', '0', '1' };
+
+// The header is padded so that the pixel data is nicely aligned
+struct SharedMemoryHeader {
+  char magic[8];
+  rdr::U8 key[SharedMemory::keyLength];
+  rdr::U32 width;
+  rdr::U32 height;
+  rdr::U8 padding[32];
+};
+
+static size_t segmentSize(int width, int height)
+{
+  return sizeof(SharedMemoryHeader) + (size_t)width * height * 4;
+}
+
+#ifdef WIN32
+
+SharedMemory::SharedMemory(int width, int height)
+  : shmid(-1), width_(0), height_(0), owner(false), segment(0), data(0)
+{
+  throw Exception("Shared memory is not supported on this platform");
+}
+
+SharedMemory::SharedMemory(int shmid_, const rdr::U8* key_)
+  : shmid(-1), width_(0), height_(0), owner(false), segment(0), data(0)
+{
+  throw Exception("Shared memory is not supported on this platform");
+}
+
+SharedMemory::~SharedMemory()
+{
+}
+
+#else
+
+SharedMemory::SharedMemory(int width, int height)
+  : shmid(-1), width_(width), height_(height), owner(true),
+    segment(0), data(0)
+{
+  SharedMemoryHeader* header;
+  rdr::RandomStream rs;
+
+  if ((width <= 0) || (height <= 0))
+    throw Exception("Invalid shared memory framebuffer size %dx%d",
+                    width, height);
+
+  shmid = shmget(IPC_PRIVATE, segmentSize(width, height), IPC_CREAT | 0600);
+  if (shmid == -1)
+    throw rdr::SystemException("shmget", errno);
+
+  segment = (rdr::U8*)shmat(shmid, 0, 0);
+  if (segment == (rdr::U8*)-1) {
+    int err = errno;
+    shmctl(shmid, IPC_RMID, 0);
+    throw rdr::SystemException("shmat", err);
+  }
+
+#ifdef __linux__
+  // Linux allows further attachments to a segment that has been marked
+  // for removal, so we can make sure it goes away with the last user
+  // even if we crash.
+  shmctl(shmid, IPC_RMID, 0);
+#endif
+
+  rs.readBytes(key, keyLength);
+
+  header = (SharedMemoryHeader*)segment;
+  memset(header, 0, sizeof(SharedMemoryHeader));
+  memcpy(header->magic, magic, sizeof(magic));
+  memcpy(header->key, key, keyLength);
+  header->width = width;
+  header->height = height;
+
+  data = segment + sizeof(SharedMemoryHeader);
+}
+
+SharedMemory::SharedMemory(int shmid_, const rdr::U8* key_)
+  : shmid(shmid_), width_(0), height_(0), owner(false),
+    segment(0), data(0)
+{
+  struct shmid_ds info;
+  SharedMemoryHeader* header;
+
+  if (shmctl(shmid, IPC_STAT, &info) != 0)
+    throw rdr::SystemException("shmctl", errno);
+
+  // Never touch memory that belongs to someone else
+  if (info.shm_perm.uid != geteuid())
+    throw Exception("Shared memory segment %d is not owned by us", shmid);
+
+  if (info.shm_segsz < sizeof(SharedMemoryHeader))
+    throw Exception("Shared memory segment %d is too small", shmid);
+
+  segment = (rdr::U8*)shmat(shmid, 0, 0);
+  if (segment == (rdr::U8*)-1) {
+    segment = 0;
+    throw rdr::SystemException("shmat", errno);
+  }
+
+  // The peer can modify the header at any time, so copy what we need
+  // before validating it
+  header = (SharedMemoryHeader*)segment;
+  memcpy(key, header->key, keyLength);
+  width_ = header->width;
+  height_ = header->height;
+
+  if ((memcmp(header->magic, magic, sizeof(magic)) != 0) ||
+      ((key_ != NULL) && (memcmp(key, key_, keyLength) != 0))) {
+    shmdt(segment);
+    throw Exception("Shared memory segment %d has an invalid header", shmid);
+  }
+
+  if ((width_ <= 0) || (height_ <= 0) ||
+      (width_ > 16384) || (height_ > 16384) ||
+      (info.shm_segsz < segmentSize(width_, height_))) {
+    shmdt(segment);
+    throw Exception("Shared memory segment %d has an invalid size", shmid);
+  }
+
+  data = segment + sizeof(SharedMemoryHeader);
+}
+
+SharedMemory::~SharedMemory()
+{
+  if (segment != NULL)
+    shmdt(segment);
+  if (owner)
+    shmctl(shmid, IPC_RMID, 0);
+}
+
+#endif
+
+rdr::U8* SharedMemory::getBuffer(const Rect& r, const PixelFormat& pf,
+                                 int* stride)
+{
+  if ((r.tl.x < 0) || (r.tl.y < 0) ||
+      (r.br.x > width_) || (r.br.y > height_))
+    throw Exception("Rect outside shared memory framebuffer");
+
+  *stride = width_;
+  return data + (r.tl.y * width_ + r.tl.x) * (pf.bpp/8);
+}
@@ -0,0 +1,77 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// SharedMemory - a System V shared memory segment holding a framebuffer
+// that both a viewer and a server on the same host can access.
+//
+// The viewer creates the segment and tells the server about it. The
+// server then writes pixel data directly in to the segment and only
+// sends the coordinates of the updated rectangles over the connection.
+// The segment starts with a small header that identifies it and
+// describes its size, followed by room for width x height pixels of at
+// most 32 bits each.
+//
+
+#ifndef __RFB_SHAREDMEMORY_H__
+#define __RFB_SHAREDMEMORY_H__
+
+#include <rdr/types.h>
+
+namespace rfb {
+
+  class PixelFormat;
+  struct Rect;
+
+  class SharedMemory {
+  public:
+    static const int keyLength = 16;
+
+    // Create a new segment, large enough for a framebuffer of the
+    // given size, and fill the header with a random key.
+    SharedMemory(int width, int height);
+
+    // Attach to an existing segment. If key is given then the segment
+    // must have been created with that key, otherwise an exception is
+    // thrown.
+    SharedMemory(int shmid, const rdr::U8* key=0);
+
+    ~SharedMemory();
+
+    int getId() const { return shmid; }
+    const rdr::U8* getKey() const { return key; }
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    // Get a pointer to the top-left pixel of the specified Rect when
+    // stored in the given format. The stride (in pixels) is returned.
+    rdr::U8* getBuffer(const Rect& r, const PixelFormat& pf, int* stride);
+
+  private:
+    int shmid;
+    rdr::U8 key[keyLength];
+    int width_, height_;
+    bool owner;
+    rdr::U8* segment;
+    rdr::U8* data;
+  };
+
+}
+
+#endif
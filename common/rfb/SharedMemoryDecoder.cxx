@@ -0,0 +1,68 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+#include <assert.h>
+
+#include <rdr/InStream.h>
+#include <rdr/MemInStream.h>
+#include <rdr/OutStream.h>
+#include <rfb/ConnParams.h>
+#include <rfb/Exception.h>
+#include <rfb/PixelBuffer.h>
+#include <rfb/SharedMemory.h>
+#include <rfb/SharedMemoryDecoder.h>
+
+using namespace rfb;
+
+// The server overwrites the segment with later updates, so the rects
+// must be decoded in order
+SharedMemoryDecoder::SharedMemoryDecoder() : Decoder(DecoderOrdered)
+{
+}
+
+SharedMemoryDecoder::~SharedMemoryDecoder()
+{
+}
+
+void SharedMemoryDecoder::readRect(const Rect& r, rdr::InStream* is,
+                                   const ConnParams& cp, rdr::OutStream* os)
+{
+  os->copyBytes(is, 4);
+}
+
+void SharedMemoryDecoder::decodeRect(const Rect& r, const void* buffer,
+                                     size_t buflen, const ConnParams& cp,
+                                     ModifiablePixelBuffer* pb,
+                                     DecoderContext* ctx)
+{
+  rdr::MemInStream is(buffer, buflen);
+  int shmid;
+  const rdr::U8* data;
+  int stride;
+
+  assert(buflen >= 4);
+
+  shmid = is.readU32();
+
+  // Only ever read from the segment we created ourselves, never from
+  // some other segment the server points us at
+  if ((cp.sharedMemory == NULL) || (cp.sharedMemory->getId() != shmid))
+    throw Exception("SharedMemoryDecoder: Unknown shared memory segment");
+
+  data = cp.sharedMemory->getBuffer(r, cp.pf(), &stride);
+  pb->imageRect(cp.pf(), r, data, stride);
+}
@@ -26,6 +26,7 @@
 #include <rdr/OutStream.h>
 
 #include <rfb/ConnParams.h>
+#include <rfb/DecoderContext.h>
 #include <rfb/Exception.h>
 #include <rfb/PixelBuffer.h>
 #include <rfb/TightConstants.h>
@@ -77,8 +78,7 @@ void TightDecoder::readRect(const Rect& r, rdr::InStream* is,
   if (comp_ctl == tightJpeg) {
     rdr::U32 len;
 
-    len = readCompact(is);
-    os->writeOpaque32(len);
+    len = readCompact(is, os);
     os->copyBytes(is, len);
     return;
   }
@@ -142,8 +142,7 @@ void TightDecoder::readRect(const Rect& r, rdr::InStream* is,
   else {
     rdr::U32 len;
 
-    len = readCompact(is);
-    os->writeOpaque32(len);
+    len = readCompact(is, os);
     os->copyBytes(is, len);
   }
 }
@@ -178,7 +177,8 @@ bool TightDecoder::doRectsConflict(const Rect& rectA,
 
 void TightDecoder::decodeRect(const Rect& r, const void* buffer,
                               size_t buflen, const ConnParams& cp,
-                              ModifiablePixelBuffer* pb)
+                              ModifiablePixelBuffer* pb,
+                              DecoderContext* ctx)
 {
   const rdr::U8* bufptr;
   const PixelFormat& pf = cp.pf();
@@ -196,7 +196,7 @@ void TightDecoder::decodeRect(const Rect& r, const void* buffer,
   // Reset zlib streams if we are told by the server to do so.
   for (int i = 0; i < 4; i++) {
     if (comp_ctl & 1) {
-      zis[i].reset();
+      resetStream(i);
     }
     comp_ctl >>= 1;
   }
@@ -224,17 +224,14 @@ void TightDecoder::decodeRect(const Rect& r, const void* buffer,
     int stride;
     rdr::U8 *buf;
 
-    JpegDecompressor jd;
+    JpegDecompressor* jd;
 
-    assert(buflen >= 4);
-
-    memcpy(&len, bufptr, 4);
-    bufptr += 4;
-    buflen -= 4;
+    len = readCompact(&bufptr, &buflen);
 
     // We always use direct decoding with JPEG images
+    jd = ctx->getJpegDecompressor();
     buf = pb->getBufferRW(r, &stride);
-    jd.decompress(bufptr, len, buf, stride, r, pb->getPF());
+    jd->decompress(bufptr, len, buf, stride, r, pb->getPF());
     pb->commitBufferRW(r);
     return;
   }
@@ -301,8 +298,6 @@ void TightDecoder::decodeRect(const Rect& r, const void* buffer,
   size_t rowSize, dataSize;
   rdr::U8* netbuf;
 
-  netbuf = NULL;
-
   if (palSize != 0) {
     if (palSize <= 2)
       rowSize = (r.width() + 7) / 8;
@@ -321,27 +316,17 @@ void TightDecoder::decodeRect(const Rect& r, const void* buffer,
   else {
     rdr::U32 len;
     int streamId;
-    rdr::MemInStream* ms;
 
-    assert(buflen >= 4);
-
-    memcpy(&len, bufptr, 4);
-    bufptr += 4;
-    buflen -= 4;
+    len = readCompact(&bufptr, &buflen);
 
     assert(buflen >= len);
 
     streamId = comp_ctl & 0x03;
-    ms = new rdr::MemInStream(bufptr, len);
-    zis[streamId].setUnderlying(ms, len);
 
     // Allocate buffer and decompress the data
-    netbuf = new rdr::U8[dataSize];
-
-    zis[streamId].readBytes(netbuf, dataSize);
+    netbuf = ctx->getScratch(DecoderContext::scratchData, dataSize);
 
-    zis[streamId].removeUnderlying();
-    delete ms;
+    decompress(streamId, bufptr, len, netbuf, dataSize);
 
     bufptr = netbuf;
     buflen = dataSize;
@@ -364,7 +349,8 @@ void TightDecoder::decodeRect(const Rect& r, const void* buffer,
   if (directDecode)
     outbuf = pb->getBufferRW(r, &stride);
   else {
-    outbuf = new rdr::U8[r.area() * (pf.bpp/8)];
+    outbuf = ctx->getScratch(DecoderContext::scratchPixels,
+                             r.area() * (pf.bpp/8));
     stride = r.width();
   }
 
@@ -428,26 +414,71 @@ void TightDecoder::decodeRect(const Rect& r, const void* buffer,
 
   if (directDecode)
     pb->commitBufferRW(r);
-  else {
+  else
     pb->imageRect(pf, r, outbuf);
-    delete [] outbuf;
-  }
+}
 
-  delete [] netbuf;
+void TightDecoder::resetStream(int streamId)
+{
+  zis[streamId].reset();
 }
 
-rdr::U32 TightDecoder::readCompact(rdr::InStream* is)
+void TightDecoder::decompress(int streamId, const rdr::U8* data,
+                              size_t length, rdr::U8* out, size_t outLength)
+{
+  rdr::MemInStream ms(data, length);
+
+  zis[streamId].setUnderlying(&ms, length);
+  zis[streamId].readBytes(out, outLength);
+  zis[streamId].removeUnderlying();
+}
+
+// The length is kept in its compact form in the buffer, so that the
+// buffer holds exactly what was sent by the server
+
+rdr::U32 TightDecoder::readCompact(rdr::InStream* is, rdr::OutStream* os)
 {
   rdr::U8 b;
   rdr::U32 result;
 
   b = is->readU8();
+  os->writeU8(b);
   result = (int)b & 0x7F;
   if (b & 0x80) {
     b = is->readU8();
+    os->writeU8(b);
     result |= ((int)b & 0x7F) << 7;
     if (b & 0x80) {
       b = is->readU8();
+      os->writeU8(b);
+      result |= ((int)b & 0xFF) << 14;
+    }
+  }
+
+  return result;
+}
+
+rdr::U32 TightDecoder::readCompact(const rdr::U8** bufptr, size_t* buflen)
+{
+  rdr::U8 b;
+  rdr::U32 result;
+
+  assert(*buflen >= 1);
+  b = **bufptr;
+  (*bufptr)++;
+  (*buflen)--;
+  result = (int)b & 0x7F;
+  if (b & 0x80) {
+    assert(*buflen >= 1);
+    b = **bufptr;
+    (*bufptr)++;
+    (*buflen)--;
+    result |= ((int)b & 0x7F) << 7;
+    if (b & 0x80) {
+      assert(*buflen >= 1);
+      b = **bufptr;
+      (*bufptr)++;
+      (*buflen)--;
       result |= ((int)b & 0xFF) << 14;
     }
   }
@@ -42,10 +42,19 @@ namespace rfb {
                                  const ConnParams& cp);
     virtual void decodeRect(const Rect& r, const void* buffer,
                             size_t buflen, const ConnParams& cp,
-                            ModifiablePixelBuffer* pb);
+                            ModifiablePixelBuffer* pb,
+                            DecoderContext* ctx);
+
+  protected:
+    // Variants of Tight that use a different compression override
+    // these two
+    virtual void resetStream(int streamId);
+    virtual void decompress(int streamId, const rdr::U8* data,
+                            size_t length, rdr::U8* out, size_t outLength);
 
   private:
-    rdr::U32 readCompact(rdr::InStream* is);
+    rdr::U32 readCompact(rdr::InStream* is, rdr::OutStream* os);
+    rdr::U32 readCompact(const rdr::U8** bufptr, size_t* buflen);
 
     void FilterGradient24(const rdr::U8* inbuf, const PixelFormat& pf,
                           rdr::U32* outbuf, int stride, const Rect& r);
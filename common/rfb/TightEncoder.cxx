@@ -56,8 +56,19 @@ static const TightConf conf[10] = {
   { 9, 9, 9 }  // 9
 };
 
-TightEncoder::TightEncoder(SConnection* conn) :
-  Encoder(conn, encodingTight, EncoderPlain, 256)
+TightEncoder::TightEncoder(SConnection* conn, bool independent_) :
+  Encoder(conn, encodingTight,
+          independent_ ? EncoderStateless : EncoderPlain, 256),
+  independent(independent_), fixedStream(-1)
+{
+  setCompressLevel(-1);
+}
+
+TightEncoder::TightEncoder(SConnection* conn, int encoding,
+                           bool independent_) :
+  Encoder(conn, encoding,
+          independent_ ? EncoderStateless : EncoderPlain, 256),
+  independent(independent_), fixedStream(-1)
 {
   setCompressLevel(-1);
 }
@@ -68,7 +79,7 @@ TightEncoder::~TightEncoder()
 
 bool TightEncoder::isSupported()
 {
-  return conn->cp.supportsEncoding(encodingTight);
+  return conn->cp.supportsEncoding(encoding);
 }
 
 void TightEncoder::setCompressLevel(int level)
@@ -81,6 +92,15 @@ void TightEncoder::setCompressLevel(int level)
   rawZlibLevel = conf[level].rawZlibLevel;
 }
 
+void TightEncoder::setStream(int streamId)
+{
+  assert(!independent);
+  assert(streamId >= 0);
+  assert(streamId < 3);
+
+  fixedStream = streamId;
+}
+
 void TightEncoder::writeRect(const PixelBuffer* pb, const Palette& palette)
 {
   switch (palette.size()) {
@@ -104,7 +124,7 @@ void TightEncoder::writeSolidRect(int width, int height,
 {
   rdr::OutStream* os;
 
-  os = conn->getOutStream();
+  os = getOutStream();
 
   os->writeU8(tightFill << 4);
   writePixels(colour, pf, 1, os);
@@ -156,7 +176,7 @@ void TightEncoder::writeIndexedRect(const PixelBuffer* pb, const Palette& palett
 
 void TightEncoder::writeFullColourRect(const PixelBuffer* pb, const Palette& palette)
 {
-  const int streamId = 0;
+  int streamId;
 
   rdr::OutStream* os;
   rdr::OutStream* zos;
@@ -165,9 +185,10 @@ void TightEncoder::writeFullColourRect(const PixelBuffer* pb, const Palette& pal
   const rdr::U8* buffer;
   int stride, h;
 
-  os = conn->getOutStream();
+  os = getOutStream();
 
-  os->writeU8(streamId << 4);
+  streamId = getStreamId(0);
+  os->writeU8((streamId << 4) | getResetFlags(streamId));
 
   // Set up compression
   if ((pb->getPF().bpp != 32) || !pb->getPF().is888())
@@ -233,12 +254,29 @@ void TightEncoder::writeCompact(rdr::OutStream* os, rdr::U32 value)
   }
 }
 
+int TightEncoder::getStreamId(int streamId)
+{
+  if (independent)
+    return 3;
+  if (fixedStream != -1)
+    return fixedStream;
+  return streamId;
+}
+
+int TightEncoder::getResetFlags(int streamId)
+{
+  // The client resets the streams before decoding anything
+  if (independent)
+    return 1 << streamId;
+  return 0;
+}
+
 rdr::OutStream* TightEncoder::getZlibOutStream(int streamId, int level, size_t length)
 {
   // Minimum amount of data to be compressed. This value should not be
   // changed, doing so will break compatibility with existing clients.
   if (length < 12)
-    return conn->getOutStream();
+    return getOutStream();
 
   assert(streamId >= 0);
   assert(streamId < 4);
@@ -259,9 +297,11 @@ void TightEncoder::flushZlibOutStream(rdr::OutStream* os_)
     return;
 
   zos->flush();
+  if (independent)
+    zos->reset();
   zos->setUnderlying(NULL);
 
-  os = conn->getOutStream();
+  os = getOutStream();
 
   writeCompact(os, memStream.length());
   os->writeBytes(memStream.data(), memStream.length());
@@ -28,19 +28,30 @@ namespace rfb {
 
   class TightEncoder : public Encoder {
   public:
-    TightEncoder(SConnection* conn);
+    // A stream-independent encoder resets its zlib stream for every
+    // rect, so the output can be reused on other connections. It only
+    // uses the last stream, leaving the others untouched.
+    TightEncoder(SConnection* conn, bool independent=false);
     virtual ~TightEncoder();
 
     virtual bool isSupported();
 
     virtual void setCompressLevel(int level);
 
+    // setStream() makes the encoder use a single zlib stream for all
+    // rects, rather than one for each kind of data. Encoders using
+    // different streams can then run in parallel.
+    void setStream(int streamId);
+
     virtual void writeRect(const PixelBuffer* pb, const Palette& palette);
     virtual void writeSolidRect(int width, int height,
                                 const PixelFormat& pf,
                                 const rdr::U8* colour);
 
   protected:
+    // For variants that only differ in how the data is compressed
+    TightEncoder(SConnection* conn, int encoding, bool independent);
+
     void writeMonoRect(const PixelBuffer* pb, const Palette& palette);
     void writeIndexedRect(const PixelBuffer* pb, const Palette& palette);
     void writeFullColourRect(const PixelBuffer* pb, const Palette& palette);
@@ -50,8 +61,12 @@ namespace rfb {
 
     void writeCompact(rdr::OutStream* os, rdr::U32 value);
 
-    rdr::OutStream* getZlibOutStream(int streamId, int level, size_t length);
-    void flushZlibOutStream(rdr::OutStream* os);
+    int getStreamId(int streamId);
+    int getResetFlags(int streamId);
+
+    virtual rdr::OutStream* getZlibOutStream(int streamId, int level,
+                                             size_t length);
+    virtual void flushZlibOutStream(rdr::OutStream* os);
 
   protected:
     // Preprocessor generated, optimised methods
@@ -76,6 +91,9 @@ namespace rfb {
     rdr::MemOutStream memStream;
 
     int idxZlibLevel, monoZlibLevel, rawZlibLevel;
+
+    bool independent;
+    int fixedStream;
   };
 
 }
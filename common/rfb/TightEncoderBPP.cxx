@@ -30,7 +30,7 @@ void TightEncoder::writeMonoRect(int width, int height,
 {
   rdr::OutStream* os;
 
-  const int streamId = 1;
+  int streamId;
   rdr::UBPP pal[2];
 
   int length;
@@ -38,9 +38,11 @@ void TightEncoder::writeMonoRect(int width, int height,
 
   assert(palette.size() == 2);
 
-  os = conn->getOutStream();
+  os = getOutStream();
 
-  os->writeU8((streamId | tightExplicitFilter) << 4);
+  streamId = getStreamId(1);
+  os->writeU8(((streamId | tightExplicitFilter) << 4) |
+              getResetFlags(streamId));
   os->writeU8(tightFilterPalette);
 
   // Write the palette
@@ -113,7 +115,7 @@ void TightEncoder::writeIndexedRect(int width, int height,
 {
   rdr::OutStream* os;
 
-  const int streamId = 2;
+  int streamId;
   rdr::UBPP pal[256];
 
   rdr::OutStream* zos;
@@ -125,9 +127,11 @@ void TightEncoder::writeIndexedRect(int width, int height,
   assert(palette.size() > 0);
   assert(palette.size() <= 256);
 
-  os = conn->getOutStream();
+  os = getOutStream();
 
-  os->writeU8((streamId | tightExplicitFilter) << 4);
+  streamId = getStreamId(2);
+  os->writeU8(((streamId | tightExplicitFilter) << 4) |
+              getResetFlags(streamId));
   os->writeU8(tightFilterPalette);
 
   // Write the palette
@@ -65,7 +65,8 @@ static const struct TightJPEGConfiguration conf[10] = {
 
 TightJPEGEncoder::TightJPEGEncoder(SConnection* conn) :
   Encoder(conn, encodingTight,
-          (EncoderFlags)(EncoderUseNativePF | EncoderLossy), -1, 9),
+          (EncoderFlags)(EncoderUseNativePF | EncoderLossy |
+                         EncoderStateless), -1, 9),
   qualityLevel(-1), fineQuality(-1), fineSubsampling(subsampleUndefined)
 {
 }
@@ -136,7 +137,7 @@ void TightJPEGEncoder::writeRect(const PixelBuffer* pb, const Palette& palette)
   jc.compress(buffer, stride, pb->getRect(),
               pb->getPF(), quality, subsampling);
 
-  os = conn->getOutStream();
+  os = getOutStream();
 
   os->writeU8(tightJpeg << 4);
 
@@ -0,0 +1,51 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// TightZstdDecoder - Tight encoding using Zstandard instead of zlib
+//
+
+#ifndef __RFB_TIGHTZSTDDECODER_H__
+#define __RFB_TIGHTZSTDDECODER_H__
+
+#ifdef HAVE_ZSTD
+
+#include <rdr/ZstdInStream.h>
+#include <rfb/TightDecoder.h>
+
+namespace rfb {
+
+  class TightZstdDecoder : public TightDecoder {
+  public:
+    TightZstdDecoder();
+    virtual ~TightZstdDecoder();
+
+  protected:
+    virtual void resetStream(int streamId);
+    virtual void decompress(int streamId, const rdr::U8* data,
+                            size_t length, rdr::U8* out, size_t outLength);
+
+  private:
+    rdr::ZstdInStream zstdStreams[4];
+  };
+
+}
+
+#endif
+
+#endif
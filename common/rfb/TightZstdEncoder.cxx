@@ -0,0 +1,89 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_ZSTD
+
+#include <assert.h>
+
+#include <rfb/Configuration.h>
+#include <rfb/encodings.h>
+#include <rfb/TightZstdEncoder.h>
+
+using namespace rfb;
+
+IntParameter zstdThreads("ZstdThreads",
+                         "Number of extra threads for each stream of the "
+                         "TightZstd encoding (0 = none)",
+                         0, 0, 64);
+
+TightZstdEncoder::TightZstdEncoder(SConnection* conn, bool independent_) :
+  TightEncoder(conn, encodingTightZstd, independent_)
+{
+  for (int i = 0; i < 4; i++)
+    zstdStreams[i].setWorkers(zstdThreads);
+}
+
+TightZstdEncoder::~TightZstdEncoder()
+{
+}
+
+rdr::OutStream* TightZstdEncoder::getZlibOutStream(int streamId, int level,
+                                                   size_t length)
+{
+  // Same limit as Tight, to keep the encodings as similar as possible
+  if (length < 12)
+    return getOutStream();
+
+  assert(streamId >= 0);
+  assert(streamId < 4);
+
+  // The levels are chosen for zlib, but Zstandard gives roughly the
+  // same trade off for the same numbers. It has no level that only
+  // stores the data though, so use the fastest level that is commonly
+  // used instead.
+  if (level == 0)
+    level = -1;
+
+  zstdStreams[streamId].setUnderlying(&memStream);
+  zstdStreams[streamId].setCompressionLevel(level);
+
+  return &zstdStreams[streamId];
+}
+
+void TightZstdEncoder::flushZlibOutStream(rdr::OutStream* os_)
+{
+  rdr::OutStream* os;
+  rdr::ZstdOutStream* zos;
+
+  zos = dynamic_cast<rdr::ZstdOutStream*>(os_);
+  if (zos == NULL)
+    return;
+
+  zos->flush();
+  if (independent)
+    zos->reset();
+  zos->setUnderlying(NULL);
+
+  os = getOutStream();
+
+  writeCompact(os, memStream.length());
+  os->writeBytes(memStream.data(), memStream.length());
+  memStream.clear();
+}
+
+#endif
@@ -0,0 +1,55 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// TightZstdEncoder - Tight encoding using Zstandard instead of zlib
+//
+// The rects are encoded exactly like Tight, including the use of four
+// streams that each keep their compression history between rects. Only
+// the compression of the data is different.
+//
+
+#ifndef __RFB_TIGHTZSTDENCODER_H__
+#define __RFB_TIGHTZSTDENCODER_H__
+
+#ifdef HAVE_ZSTD
+
+#include <rdr/ZstdOutStream.h>
+#include <rfb/TightEncoder.h>
+
+namespace rfb {
+
+  class TightZstdEncoder : public TightEncoder {
+  public:
+    TightZstdEncoder(SConnection* conn, bool independent=false);
+    virtual ~TightZstdEncoder();
+
+  protected:
+    virtual rdr::OutStream* getZlibOutStream(int streamId, int level,
+                                             size_t length);
+    virtual void flushZlibOutStream(rdr::OutStream* os);
+
+  private:
+    rdr::ZstdOutStream zstdStreams[4];
+  };
+
+}
+
+#endif
+
+#endif
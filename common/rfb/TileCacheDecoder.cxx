@@ -0,0 +1,144 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+#include <assert.h>
+
+#include <rdr/InStream.h>
+#include <rdr/MemInStream.h>
+#include <rdr/OutStream.h>
+#include <rfb/ConnParams.h>
+#include <rfb/Exception.h>
+#include <rfb/PixelBuffer.h>
+#include <rfb/TileCacheDecoder.h>
+#include <rfb/tileCacheTypes.h>
+
+using namespace rfb;
+
+// The cache must be updated in exactly the same order as the server's
+// copy of it, so all rects are handled in order
+TileCacheDecoder::TileCacheDecoder() : Decoder(DecoderOrdered)
+{
+}
+
+TileCacheDecoder::~TileCacheDecoder()
+{
+  flush();
+}
+
+void TileCacheDecoder::readRect(const Rect& r, rdr::InStream* is,
+                                const ConnParams& cp, rdr::OutStream* os)
+{
+  os->copyBytes(is, 1 + 8);
+}
+
+void TileCacheDecoder::decodeRect(const Rect& r, const void* buffer,
+                                  size_t buflen, const ConnParams& cp,
+                                  ModifiablePixelBuffer* pb,
+                                  DecoderContext* ctx)
+{
+  rdr::MemInStream is(buffer, buflen);
+  int op;
+  rdr::U64 key;
+
+  assert(buflen >= 1 + 8);
+
+  op = is.readU8();
+  key = (rdr::U64)is.readU32() << 32;
+  key |= is.readU32();
+
+  switch (op) {
+  case tileCacheOpReference:
+    drawTile(r, key, pb);
+    break;
+  case tileCacheOpStore:
+    storeTile(r, key, pb);
+    break;
+  case tileCacheOpFlush:
+    flush();
+    break;
+  default:
+    throw Exception("Unknown tile cache operation %d", op);
+  }
+}
+
+void TileCacheDecoder::storeTile(const Rect& r, rdr::U64 key,
+                                 ModifiablePixelBuffer* pb)
+{
+  std::map<rdr::U64, Entry>::iterator iter;
+  Entry entry;
+
+  if (!r.enclosed_by(pb->getRect()))
+    throw Exception("Tile cache rect outside framebuffer");
+
+  // Replacing an entry counts as using it
+  iter = entries.find(key);
+  if (iter != entries.end()) {
+    lru.erase(iter->second.lru);
+    delete [] iter->second.data;
+    entries.erase(iter);
+  }
+
+  if (entries.size() >= (size_t)tileCacheMaxEntries) {
+    iter = entries.find(lru.back());
+    assert(iter != entries.end());
+    delete [] iter->second.data;
+    entries.erase(iter);
+    lru.pop_back();
+  }
+
+  lru.push_front(key);
+
+  // The tile has already been decoded, so grab it straight from the
+  // framebuffer
+  entry.lru = lru.begin();
+  entry.width = r.width();
+  entry.height = r.height();
+  entry.pf = pb->getPF();
+  entry.data = new rdr::U8[r.area() * (entry.pf.bpp/8)];
+  pb->getImage(entry.data, r);
+
+  entries[key] = entry;
+}
+
+void TileCacheDecoder::drawTile(const Rect& r, rdr::U64 key,
+                                ModifiablePixelBuffer* pb)
+{
+  std::map<rdr::U64, Entry>::iterator iter;
+
+  iter = entries.find(key);
+  if (iter == entries.end())
+    throw Exception("Unknown tile cache entry");
+
+  if ((iter->second.width != r.width()) ||
+      (iter->second.height != r.height()))
+    throw Exception("Tile cache entry has the wrong size");
+
+  lru.splice(lru.begin(), lru, iter->second.lru);
+
+  pb->imageRect(iter->second.pf, r, iter->second.data);
+}
+
+void TileCacheDecoder::flush()
+{
+  std::map<rdr::U64, Entry>::iterator iter;
+
+  for (iter = entries.begin(); iter != entries.end(); ++iter)
+    delete [] iter->second.data;
+
+  entries.clear();
+  lru.clear();
+}
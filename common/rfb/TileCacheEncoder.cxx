@@ -0,0 +1,169 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+#include <assert.h>
+#include <string.h>
+
+#include <rdr/OutStream.h>
+#include <rfb/PixelBuffer.h>
+#include <rfb/SConnection.h>
+#include <rfb/SMsgWriter.h>
+#include <rfb/TileCacheEncoder.h>
+#include <rfb/encodings.h>
+#include <rfb/tileCacheTypes.h>
+
+using namespace rfb;
+
+TileCacheEncoder::TileCacheEncoder(SConnection* conn_) : conn(conn_)
+{
+}
+
+TileCacheEncoder::~TileCacheEncoder()
+{
+}
+
+bool TileCacheEncoder::lookup(rdr::U64 key, bool* lossy) const
+{
+  std::map<rdr::U64, Entry>::const_iterator iter;
+
+  iter = entries.find(key);
+  if (iter == entries.end())
+    return false;
+
+  *lossy = iter->second.lossy;
+
+  return true;
+}
+
+bool TileCacheEncoder::matches(rdr::U64 key, const Rect& r,
+                               const PixelBuffer* pb) const
+{
+  std::map<rdr::U64, Entry>::const_iterator iter;
+  const rdr::U8* data;
+  const rdr::U8* cached;
+  int stride, bytesPerPixel;
+
+  iter = entries.find(key);
+  if (iter == entries.end())
+    return false;
+
+  if ((iter->second.width != r.width()) ||
+      (iter->second.height != r.height()))
+    return false;
+
+  bytesPerPixel = pb->getPF().bpp/8;
+  if (iter->second.pixels.size() != (size_t)r.area() * bytesPerPixel)
+    return false;
+
+  data = pb->getBuffer(r, &stride);
+  cached = &iter->second.pixels[0];
+  for (int y = 0; y < r.height(); y++) {
+    if (memcmp(data, cached, r.width() * bytesPerPixel) != 0)
+      return false;
+    data += stride * bytesPerPixel;
+    cached += r.width() * bytesPerPixel;
+  }
+
+  return true;
+}
+
+bool TileCacheEncoder::needFlush() const
+{
+  // The client stores whatever ended up in its framebuffer, so tiles
+  // from a different pixel format would look different
+  return !entries.empty() && !pf.equal(conn->cp.pf());
+}
+
+void TileCacheEncoder::writeReference(const Rect& r, rdr::U64 key)
+{
+  std::map<rdr::U64, Entry>::iterator iter;
+
+  iter = entries.find(key);
+  assert(iter != entries.end());
+
+  lru.splice(lru.begin(), lru, iter->second.lru);
+
+  writeRect(r, tileCacheOpReference, key);
+}
+
+void TileCacheEncoder::writeStore(const Rect& r, rdr::U64 key, bool lossy,
+                                  const PixelBuffer* pb)
+{
+  std::map<rdr::U64, Entry>::iterator iter;
+  Entry* entry;
+  const rdr::U8* data;
+  rdr::U8* cached;
+  int stride, bytesPerPixel;
+
+  if (entries.empty())
+    pf = conn->cp.pf();
+
+  // Must match TileCacheDecoder::storeTile() exactly
+  iter = entries.find(key);
+  if (iter != entries.end()) {
+    lru.erase(iter->second.lru);
+    entries.erase(iter);
+  }
+
+  if (entries.size() >= (size_t)tileCacheMaxEntries) {
+    entries.erase(lru.back());
+    lru.pop_back();
+  }
+
+  lru.push_front(key);
+
+  entry = &entries[key];
+  entry->lru = lru.begin();
+  entry->lossy = lossy;
+
+  entry->width = r.width();
+  entry->height = r.height();
+
+  bytesPerPixel = pb->getPF().bpp/8;
+  entry->pixels.resize(r.area() * bytesPerPixel);
+
+  data = pb->getBuffer(r, &stride);
+  cached = &entry->pixels[0];
+  for (int y = 0; y < r.height(); y++) {
+    memcpy(cached, data, r.width() * bytesPerPixel);
+    data += stride * bytesPerPixel;
+    cached += r.width() * bytesPerPixel;
+  }
+
+  writeRect(r, tileCacheOpStore, key);
+}
+
+void TileCacheEncoder::writeFlush()
+{
+  entries.clear();
+  lru.clear();
+
+  writeRect(Rect(), tileCacheOpFlush, 0);
+}
+
+void TileCacheEncoder::writeRect(const Rect& r, int op, rdr::U64 key)
+{
+  rdr::OutStream* os;
+
+  os = conn->getOutStream();
+
+  conn->writer()->startRect(r, encodingTileCache);
+  os->writeU8(op);
+  os->writeU32(key >> 32);
+  os->writeU32(key & 0xffffffff);
+  conn->writer()->endRect();
+}
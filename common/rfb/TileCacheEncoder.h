@@ -0,0 +1,87 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+//
+// TileCacheEncoder - keeps track of which tiles the client has in its
+// cache and writes the TileCache rects that reference and fill it.
+//
+// The client's cache is never described to us. Instead both sides
+// apply the exact same operations to a cache of a fixed size, so our
+// copy of the keys always matches what the client has.
+//
+
+#ifndef __RFB_TILECACHEENCODER_H__
+#define __RFB_TILECACHEENCODER_H__
+
+#include <list>
+#include <map>
+#include <vector>
+
+#include <rdr/types.h>
+#include <rfb/PixelFormat.h>
+
+namespace rfb {
+
+  class SConnection;
+  class PixelBuffer;
+  struct Rect;
+
+  class TileCacheEncoder {
+  public:
+    TileCacheEncoder(SConnection* conn);
+    ~TileCacheEncoder();
+
+    // lookup() checks if the client has the given tile, and if it was
+    // lossy when it was stored. It does not count as using the tile.
+    bool lookup(rdr::U64 key, bool* lossy) const;
+
+    // matches() checks that the given tile has the same pixels as the
+    // one stored for the key. Keys are only hashes, so they can collide.
+    bool matches(rdr::U64 key, const Rect& r, const PixelBuffer* pb) const;
+
+    // needFlush() returns true if the client must throw away its
+    // cache before any other rects can be sent, e.g. because the
+    // pixel format has changed.
+    bool needFlush() const;
+
+    void writeReference(const Rect& r, rdr::U64 key);
+    void writeStore(const Rect& r, rdr::U64 key, bool lossy,
+                    const PixelBuffer* pb);
+    void writeFlush();
+
+  protected:
+    void writeRect(const Rect& r, int op, rdr::U64 key);
+
+  protected:
+    SConnection* conn;
+
+  private:
+    struct Entry {
+      std::list<rdr::U64>::iterator lru;
+      bool lossy;
+      // Our own copy of the pixels, in the framebuffer's format
+      int width, height;
+      std::vector<rdr::U8> pixels;
+    };
+
+    std::list<rdr::U64> lru;
+    std::map<rdr::U64, Entry> entries;
+
+    PixelFormat pf;
+  };
+}
+#endif
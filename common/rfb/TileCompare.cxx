@@ -0,0 +1,211 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include <string.h>
+
+#include <rfb/LogWriter.h>
+#include <rfb/TileCompare.h>
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace rfb;
+
+static LogWriter vlog("TileCompare");
+
+// The scanline loop is the same for every implementation, only the
+// way a single tile is compared differs.
+#define COMPARE_TILES_FUNC(name, attr, differs)                         \
+static attr int name(const rdr::U8* oldData, const rdr::U8* newData,   \
+                     int width, int bytesPerPixel, int tileWidth,      \
+                     rdr::U32* mask)                                   \
+{                                                                      \
+  int tileBytes = tileWidth * bytesPerPixel;                           \
+  int totalBytes = width * bytesPerPixel;                              \
+  int nChanged = 0;                                                    \
+  int tile = 0;                                                        \
+  for (int offset = 0; offset < totalBytes; offset += tileBytes) {     \
+    int len = totalBytes - offset;                                     \
+    if (len > tileBytes)                                               \
+      len = tileBytes;                                                 \
+    if (!tileMaskTest(mask, tile) &&                                   \
+        differs(oldData + offset, newData + offset, len)) {            \
+      tileMaskSet(mask, tile);                                         \
+      nChanged++;                                                      \
+    }                                                                  \
+    tile++;                                                            \
+  }                                                                    \
+  return nChanged;                                                     \
+}
+
+static inline bool differsScalar(const rdr::U8* a, const rdr::U8* b,
+                                 int len)
+{
+  return memcmp(a, b, len) != 0;
+}
+
+COMPARE_TILES_FUNC(compareTilesScalar, , differsScalar)
+
+#ifdef HAVE_X86_SIMD
+
+static inline __attribute__((target("sse2"), always_inline))
+bool differsSSE2(const rdr::U8* a, const rdr::U8* b, int len)
+{
+  __m128i acc;
+  int i;
+
+  // Differences are accumulated for the entire tile as tiles are
+  // small and usually equal
+  acc = _mm_setzero_si128();
+  for (i = 0; i + 16 <= len; i += 16) {
+    __m128i x, y;
+    x = _mm_loadu_si128((const __m128i*)(a + i));
+    y = _mm_loadu_si128((const __m128i*)(b + i));
+    acc = _mm_or_si128(acc, _mm_xor_si128(x, y));
+  }
+
+  acc = _mm_cmpeq_epi8(acc, _mm_setzero_si128());
+  if (_mm_movemask_epi8(acc) != 0xffff)
+    return true;
+
+  return memcmp(a + i, b + i, len - i) != 0;
+}
+
+static inline __attribute__((target("avx2"), always_inline))
+bool differsAVX2(const rdr::U8* a, const rdr::U8* b, int len)
+{
+  __m256i acc;
+  int i;
+
+  acc = _mm256_setzero_si256();
+  for (i = 0; i + 32 <= len; i += 32) {
+    __m256i x, y;
+    x = _mm256_loadu_si256((const __m256i*)(a + i));
+    y = _mm256_loadu_si256((const __m256i*)(b + i));
+    acc = _mm256_or_si256(acc, _mm256_xor_si256(x, y));
+  }
+
+  if (!_mm256_testz_si256(acc, acc))
+    return true;
+
+  return memcmp(a + i, b + i, len - i) != 0;
+}
+
+COMPARE_TILES_FUNC(compareTilesSSE2, __attribute__((target("sse2"))),
+                   differsSSE2)
+COMPARE_TILES_FUNC(compareTilesAVX2, __attribute__((target("avx2"))),
+                   differsAVX2)
+
+#endif
+
+typedef int (*CompareTilesFunc)(const rdr::U8*, const rdr::U8*,
+                                int, int, int, rdr::U32*);
+
+static CompareTilesFunc selectCompareTiles()
+{
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2")) {
+    vlog.debug("Using AVX2 tile comparison");
+    return compareTilesAVX2;
+  }
+
+  if (__builtin_cpu_supports("sse2")) {
+    vlog.debug("Using SSE2 tile comparison");
+    return compareTilesSSE2;
+  }
+#endif
+
+  vlog.debug("Using generic tile comparison");
+  return compareTilesScalar;
+}
+
+int rfb::compareTiles(const rdr::U8* oldData, const rdr::U8* newData,
+                      int width, int bytesPerPixel, int tileWidth,
+                      rdr::U32* mask)
+{
+  // Every thread will come up with the same answer, so there is no
+  // harm if this races
+  static CompareTilesFunc func = NULL;
+
+  if (func == NULL)
+    func = selectCompareTiles();
+
+  return func(oldData, newData, width, bytesPerPixel, tileWidth, mask);
+}
+
+// Each step below is a bijection of both the state and the input word,
+// so a change in a single word always results in a different hash.
+// Four independent lanes are used to avoid stalling on the multiply.
+
+static const rdr::U64 hashMultiplier = 0x9e3779b97f4a7c15ULL;
+
+static inline rdr::U64 hashStep(rdr::U64 h, rdr::U64 v)
+{
+  h = (h ^ v) * hashMultiplier;
+  return h ^ (h >> 32);
+}
+
+rdr::U64 rfb::hashTile(const rdr::U8* data, int width, int height,
+                       int stride, int bytesPerPixel)
+{
+  int strideBytes = stride * bytesPerPixel;
+  int rowBytes = width * bytesPerPixel;
+
+  rdr::U64 h0, h1, h2, h3;
+
+  h0 = width;
+  h1 = height;
+  h2 = h3 = 0;
+
+  for (int y = 0; y < height; y++) {
+    const rdr::U8* ptr = data;
+    int len = rowBytes;
+
+    while (len >= 32) {
+      rdr::U64 v[4];
+      memcpy(v, ptr, sizeof(v));
+      h0 = hashStep(h0, v[0]);
+      h1 = hashStep(h1, v[1]);
+      h2 = hashStep(h2, v[2]);
+      h3 = hashStep(h3, v[3]);
+      ptr += 32;
+      len -= 32;
+    }
+
+    while (len >= 8) {
+      rdr::U64 v;
+      memcpy(&v, ptr, sizeof(v));
+      h0 = hashStep(h0, v);
+      ptr += 8;
+      len -= 8;
+    }
+
+    if (len > 0) {
+      rdr::U64 v = 0;
+      memcpy(&v, ptr, len);
+      h1 = hashStep(h1, v);
+    }
+
+    data += strideBytes;
+  }
+
+  return hashStep(hashStep(hashStep(h0, h1), h2), h3);
+}
@@ -0,0 +1,68 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// TileCompare - fast comparison of framebuffer scanlines
+//
+// A scanline is split in to tiles of a fixed number of pixels and the
+// two versions are compared one tile at a time. The result is a bit
+// mask with one bit per tile, stored in an array of 32-bit words. The
+// comparison uses SSE2 or AVX2 when the CPU supports it.
+//
+// There is also a fast, non-cryptographic hash for when keeping the
+// old pixels around is too expensive.
+//
+
+#ifndef __RFB_TILECOMPARE_H__
+#define __RFB_TILECOMPARE_H__
+
+#include <rdr/types.h>
+
+namespace rfb {
+
+  // Number of 32-bit words needed to hold the mask for a scanline
+  // of the given width.
+  inline int tileMaskSize(int width, int tileWidth) {
+    return (((width + tileWidth - 1) / tileWidth) + 31) / 32;
+  }
+
+  inline bool tileMaskTest(const rdr::U32* mask, int tile) {
+    return (mask[tile / 32] & (1U << (tile % 32))) != 0;
+  }
+
+  inline void tileMaskSet(rdr::U32* mask, int tile) {
+    mask[tile / 32] |= 1U << (tile % 32);
+  }
+
+  // Compare width pixels of oldData and newData. The bit in mask for
+  // every tile that differs is set. Tiles that already have their bit
+  // set are not compared again, so the mask can be accumulated over
+  // several scanlines. Returns the number of bits that were set.
+  int compareTiles(const rdr::U8* oldData, const rdr::U8* newData,
+                   int width, int bytesPerPixel, int tileWidth,
+                   rdr::U32* mask);
+
+  // Hash a block of pixels, including its dimensions. The stride is
+  // in pixels. Any change to a single 64-bit word of the data is
+  // guaranteed to give a different hash.
+  rdr::U64 hashTile(const rdr::U8* data, int width, int height,
+                    int stride, int bytesPerPixel);
+
+}
+
+#endif
@@ -18,6 +18,8 @@
  * USA.
  */
 
+#include <sys/time.h>
+
 #include <network/TcpSocket.h>
 
 #include <rfb/ComparingUpdateTracker.h>
@@ -26,12 +28,14 @@
 #include <rfb/LogWriter.h>
 #include <rfb/Security.h>
 #include <rfb/ServerCore.h>
+#include <rfb/SharedMemory.h>
 #include <rfb/SMsgWriter.h>
 #include <rfb/VNCServerST.h>
 #include <rfb/VNCSConnectionST.h>
 #include <rfb/screenTypes.h>
 #include <rfb/fenceTypes.h>
 #include <rfb/ledStates.h>
+#include <rfb/util.h>
 #define XK_LATIN1
 #define XK_MISCELLANY
 #define XK_XKB_KEYS
@@ -43,13 +47,18 @@ static LogWriter vlog("VNCSConnST");
 
 static Cursor emptyCursor(0, 0, Point(0, 0), NULL);
 
+// How far from the pointer damage may be to count for a latency probe
+static const int probeAreaRadius = 128;
+
 VNCSConnectionST::VNCSConnectionST(VNCServerST* server_, network::Socket *s,
                                    bool reverse)
   : sock(s), reverseConnection(reverse),
     inProcessMessages(false),
     pendingSyncFence(false), syncFence(false), fenceFlags(0),
     fenceDataLen(0), fenceData(NULL), congestionTimer(this),
-    losslessTimer(this), server(server_), updates(false),
+    losslessTimer(this), probeTimer(this), pendingProbe(false),
+    probeDamaged(false), probeGrabbed(false), probeEncoded(false),
+    server(server_), updates(false),
     updateRenderedCursor(false), removeRenderedCursor(false),
     continuousUpdates(false), encodeManager(this), pointerEventTime(0),
     clientHasCursor(false),
@@ -62,6 +71,9 @@ VNCSConnectionST::VNCSConnectionST(VNCServerST* server_, network::Socket *s,
   // Configure the socket
   setSocketTimeouts();
   lastEventTime = time(0);
+  gettimeofday(&lastPointerTime, NULL);
+
+  encodeManager.setEncodeCache(&server->encodeCache);
 
   server->clients.push_front(this);
 }
@@ -351,6 +363,14 @@ bool VNCSConnectionST::getComparerState()
 }
 
 
+bool VNCSConnectionST::isUpdateRequested()
+{
+  if (state() != RFBSTATE_NORMAL)
+    return false;
+  return !requested.is_empty() || continuousUpdates;
+}
+
+
 // renderedCursorChange() is called whenever the server-side rendered cursor
 // changes shape or position.  It ensures that the next update will clean up
 // the old rendered cursor and if necessary draw the new rendered cursor.
@@ -505,6 +525,7 @@ void VNCSConnectionST::pointerEvent(const Point& pos, int buttonMask)
 {
   pointerEventTime = lastEventTime = time(0);
   server->lastUserInputTime = lastEventTime;
+  gettimeofday(&lastPointerTime, NULL);
   if (!(accessRights & AccessPtrEvents)) return;
   if (!rfb::Server::acceptPointerEvents) return;
   if (!server->pointerClient || server->pointerClient == this) {
@@ -758,6 +779,28 @@ void VNCSConnectionST::fence(rdr::U32 flags, unsigned len, const char data[])
       return;
     }
 
+    if (LatencyProbe::isProbe(len, data)) {
+      // Only one probe is expected at a time, so give up on the old one
+      if (pendingProbe)
+        writeLatencyProbe();
+
+      probe.read(data);
+      probe.measured = false;
+      pendingProbe = true;
+      probeDamaged = probeGrabbed = probeEncoded = false;
+
+      // The probe is sent right after the pointer event it measures
+      probeStart = lastPointerTime;
+      probeArea = Rect(pointerEventPos.x - probeAreaRadius,
+                       pointerEventPos.y - probeAreaRadius,
+                       pointerEventPos.x + probeAreaRadius,
+                       pointerEventPos.y + probeAreaRadius);
+
+      // Respond unmeasured if the event never causes any damage
+      probeTimer.start(1000);
+      return;
+    }
+
     // We handle everything synchronously so we trivially honor these modes
     flags = flags & (fenceFlagBlockBefore | fenceFlagBlockAfter);
 
@@ -802,6 +845,29 @@ void VNCSConnectionST::enableContinuousUpdates(bool enable,
   }
 }
 
+void VNCSConnectionST::setSharedMemory(int shmid, const rdr::U8* key)
+{
+  SharedMemory* shm;
+
+  if (!cp.supportsSharedMemory || !rfb::Server::sharedMemory)
+    return;
+
+  // The client might not actually be on the same host as us, so any
+  // failure here just means we keep using the normal encodings
+  try {
+    shm = new SharedMemory(shmid, key);
+  } catch (rdr::Exception& e) {
+    vlog.info("Not using shared memory: %s", e.str());
+    encodeManager.setSharedMemory(NULL);
+    return;
+  }
+
+  vlog.info("Using shared memory segment %d (%dx%d) for updates",
+            shm->getId(), shm->width(), shm->height());
+
+  encodeManager.setSharedMemory(shm);
+}
+
 // supportsLocalCursor() is called whenever the status of
 // cp.supportsLocalCursor has changed.  If the client does now support local
 // cursor, we make sure that the old server-side rendered cursor is cleaned up
@@ -843,6 +909,10 @@ bool VNCSConnectionST::handleTimeout(Timer* t)
     if ((t == &congestionTimer) ||
         (t == &losslessTimer))
       writeFramebufferUpdate();
+    else if (t == &probeTimer) {
+      if (pendingProbe)
+        writeLatencyProbe();
+    }
   } catch (rdr::Exception& e) {
     close(e.str());
   }
@@ -883,6 +953,33 @@ void VNCSConnectionST::writeRTTPing()
   congestion.sentPing();
 }
 
+void VNCSConnectionST::writeLatencyProbe()
+{
+  char data[LatencyProbe::payloadSize];
+
+  if (probeEncoded) {
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+
+    probe.measured = true;
+    probe.serverTime[latencyStageDamage] = usBetween(&probeStart,
+                                                     &probeDamage);
+    probe.serverTime[latencyStageGrab] = usBetween(&probeDamage,
+                                                   &probeGrab);
+    probe.serverTime[latencyStageEncode] = usBetween(&probeGrab,
+                                                     &probeEncode);
+    probe.serverTime[latencyStageWrite] = usBetween(&probeEncode, &now);
+  }
+
+  probe.write(data);
+  writer()->writeFence(0, sizeof(data), data);
+
+  pendingProbe = false;
+  probeDamaged = probeGrabbed = probeEncoded = false;
+  probeTimer.stop();
+}
+
 bool VNCSConnectionST::isCongested()
 {
   int eta;
@@ -910,6 +1007,50 @@ bool VNCSConnectionST::isCongested()
 }
 
 
+int VNCSConnectionST::msToReady()
+{
+  if (!isUpdateRequested())
+    return -1;
+
+  // No idea how long the send buffer will take to drain
+  if (sock->outStream().bufferUsage() > 0)
+    return -1;
+
+  if (!cp.supportsFence)
+    return 0;
+
+  congestion.updatePosition(sock->outStream().length());
+  if (!congestion.isCongested())
+    return 0;
+
+  return congestion.getUncongestedETA();
+}
+
+void VNCSConnectionST::latencyDamage(const Region& region)
+{
+  if (!pendingProbe || probeDamaged)
+    return;
+
+  // Anything else changing on the desktop would otherwise complete the
+  // probe right away. Damage that was already on its way before the
+  // event was handled can still get through, so the result is only
+  // exact when nothing else is drawing near the pointer.
+  if (region.intersect(probeArea).is_empty())
+    return;
+
+  gettimeofday(&probeDamage, NULL);
+  probeDamaged = true;
+}
+
+void VNCSConnectionST::latencyGrab()
+{
+  if (!probeDamaged || probeGrabbed)
+    return;
+
+  gettimeofday(&probeGrab, NULL);
+  probeGrabbed = true;
+}
+
 void VNCSConnectionST::writeFramebufferUpdate()
 {
   congestion.updatePosition(sock->outStream().length());
@@ -949,6 +1090,10 @@ void VNCSConnectionST::writeFramebufferUpdate()
   // Then real data (if possible)
   writeDataUpdate();
 
+  // The probe response must follow the update it was measured on
+  if (probeEncoded)
+    writeLatencyProbe();
+
   sock->cork(false);
 
   congestion.updatePosition(sock->outStream().length());
@@ -1084,9 +1229,15 @@ void VNCSConnectionST::writeDataUpdate()
 
   writeRTTPing();
 
-  if (!ui.is_empty())
+  encodeManager.setBandwidth(congestion.getBandwidth());
+
+  if (!ui.is_empty()) {
     encodeManager.writeUpdate(ui, server->getPixelBuffer(), cursor);
-  else {
+    if (probeGrabbed && !probeEncoded) {
+      gettimeofday(&probeEncode, NULL);
+      probeEncoded = true;
+    }
+  } else {
     int nextUpdate;
 
     // FIXME: If continuous updates aren't used then the client might
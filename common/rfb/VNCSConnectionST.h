@@ -31,6 +31,7 @@
 
 #include <rfb/Congestion.h>
 #include <rfb/EncodeManager.h>
+#include <rfb/LatencyProbe.h>
 #include <rfb/SConnection.h>
 #include <rfb/Timer.h>
 
@@ -91,6 +92,23 @@ namespace rfb {
     // comparer to be enabled.
     bool getComparerState();
 
+    // isUpdateRequested() returns true if this client is waiting for a
+    // framebuffer update.
+    bool isUpdateRequested();
+
+    // msToReady() returns the number of milliseconds until this client
+    // can send another update, 0 if it can right away, or -1 if it is
+    // not waiting for one or if it cannot tell.
+    int msToReady();
+
+    // latencyDamage() and latencyGrab() are called when the desktop has
+    // drawn something and when the framebuffer has been grabbed. They
+    // advance any latency probe from the client that is waiting for the
+    // results of its last pointer event. Only damage near where that
+    // event happened counts towards the probe.
+    void latencyDamage(const Region& region);
+    void latencyGrab();
+
     // renderedCursorChange() is called whenever the server-side rendered
     // cursor changes shape or position.  It ensures that the next update will
     // clean up the old rendered cursor and if necessary draw the new rendered
@@ -143,6 +161,7 @@ namespace rfb {
     virtual void fence(rdr::U32 flags, unsigned len, const char data[]);
     virtual void enableContinuousUpdates(bool enable,
                                          int x, int y, int w, int h);
+    virtual void setSharedMemory(int shmid, const rdr::U8* key);
     virtual void supportsLocalCursor();
     virtual void supportsFence();
     virtual void supportsContinuousUpdates();
@@ -171,6 +190,7 @@ namespace rfb {
     void writeFramebufferUpdate();
     void writeNoDataUpdate();
     void writeDataUpdate();
+    void writeLatencyProbe();
 
     void screenLayoutChange(rdr::U16 reason);
     void setCursor();
@@ -192,6 +212,14 @@ namespace rfb {
     Congestion congestion;
     Timer congestionTimer;
     Timer losslessTimer;
+    Timer probeTimer;
+
+    bool pendingProbe;
+    LatencyProbe probe;
+    bool probeDamaged, probeGrabbed, probeEncoded;
+    Rect probeArea;
+    struct timeval lastPointerTime;
+    struct timeval probeStart, probeDamage, probeGrab, probeEncode;
 
     VNCServerST* server;
     SimpleUpdateTracker updates;
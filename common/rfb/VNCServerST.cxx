@@ -111,6 +111,8 @@ VNCServerST::~VNCServerST()
     comparer->logStats();
   delete comparer;
 
+  encodeCache.logStats();
+
   delete cursor;
 }
 
@@ -318,7 +320,8 @@ void VNCServerST::setPixelBuffer(PixelBuffer* pb_, const ScreenSet& layout)
 
   // Assume the framebuffer contents wasn't saved and reset everything
   // that tracks its contents
-  comparer = new ComparingUpdateTracker(pb);
+  comparer = new ComparingUpdateTracker(pb, rfb::Server::compareFBHashes,
+                                        rfb::Server::detectScroll);
   renderedCursorInvalid = true;
   add_changed(pb->getRect());
 
@@ -408,20 +411,32 @@ void VNCServerST::setName(const char* name_)
 
 void VNCServerST::add_changed(const Region& region)
 {
+  std::list<VNCSConnectionST*>::iterator ci;
+
   if (comparer == NULL)
     return;
 
   comparer->add_changed(region);
+  pacer.damage();
   startFrameClock();
+
+  for (ci = clients.begin(); ci != clients.end(); ci++)
+    (*ci)->latencyDamage(region);
 }
 
 void VNCServerST::add_copied(const Region& dest, const Point& delta)
 {
+  std::list<VNCSConnectionST*>::iterator ci;
+
   if (comparer == NULL)
     return;
 
   comparer->add_copied(dest, delta);
+  pacer.damage();
   startFrameClock();
+
+  for (ci = clients.begin(); ci != clients.end(); ci++)
+    (*ci)->latencyDamage(dest);
 }
 
 void VNCServerST::setCursor(int width, int height, const Point& newHotspot,
@@ -516,6 +531,24 @@ SConnection* VNCServerST::getSConnection(network::Socket* sock) {
 bool VNCServerST::handleTimeout(Timer* t)
 {
   if (t == &frameTimer) {
+    if (rfb::Server::framePacing) {
+      int delay;
+
+      if (comparer->is_empty())
+        return false;
+
+      // Things might have changed since the timer was started
+      delay = pacer.getFrameDelay(msToClientsReady());
+      if (delay > 0) {
+        frameTimer.start(delay);
+        return false;
+      }
+
+      // New damage will start the timer again
+      writeUpdate();
+      return false;
+    }
+
     // We keep running until we go a full interval without any updates
     if (comparer->is_empty())
       return false;
@@ -558,6 +591,7 @@ void VNCServerST::stopDesktop()
     desktopStarted = false;
     desktop->stop();
     stopFrameClock();
+    pacer.logStats();
   }
 }
 
@@ -581,13 +615,22 @@ inline bool VNCServerST::needRenderedCursor()
 
 void VNCServerST::startFrameClock()
 {
-  if (frameTimer.isStarted())
-    return;
   if (blockCounter > 0)
     return;
   if (!desktopStarted)
     return;
 
+  if (frameTimer.isStarted())
+    return;
+
+  // The delay is only computed here and when the timer fires, which
+  // checks again in case more damage has come in since
+  if (rfb::Server::framePacing) {
+    pacer.setFrameRate(rfb::Server::frameRate);
+    frameTimer.start(pacer.getFrameDelay(msToClientsReady()));
+    return;
+  }
+
   // The first iteration will be just half a frame as we get a very
   // unstable update rate if we happen to be perfectly in sync with
   // the application's update rate
@@ -601,13 +644,38 @@ void VNCServerST::stopFrameClock()
 
 int VNCServerST::msToNextUpdate()
 {
-  // FIXME: If the application is updating slower than frameRate then
-  //        we could allow the clients more time here
-
-  if (!frameTimer.isStarted())
-    return 1000/rfb::Server::frameRate/2;
-  else
+  if (frameTimer.isStarted())
     return frameTimer.getRemainingMs();
+
+  // The pacer knows if the application is updating slower than
+  // frameRate, which allows the clients more time
+  if (rfb::Server::framePacing)
+    return pacer.msToNextFrame();
+
+  return 1000/rfb::Server::frameRate/2;
+}
+
+// msToClientsReady() returns the time until the first client can accept
+// another update, or -1 if none of them can tell
+
+int VNCServerST::msToClientsReady()
+{
+  std::list<VNCSConnectionST*>::iterator ci;
+  int delay;
+
+  delay = -1;
+  for (ci = clients.begin(); ci != clients.end(); ci++) {
+    int ms;
+
+    ms = (*ci)->msToReady();
+    if (ms < 0)
+      continue;
+
+    if ((delay == -1) || (ms < delay))
+      delay = ms;
+  }
+
+  return delay;
 }
 
 // writeUpdate() is called on a regular interval in order to see what
@@ -640,6 +708,10 @@ void VNCServerST::writeUpdate()
   }
 
   pb->grabRegion(toCheck);
+  pacer.frameGrabbed();
+
+  for (ci = clients.begin(); ci != clients.end(); ci++)
+    (*ci)->latencyGrab();
 
   if (getComparerState())
     comparer->enable();
@@ -651,12 +723,19 @@ void VNCServerST::writeUpdate()
 
   comparer->clear();
 
+  // The framebuffer stays the same until we return, so clients can
+  // share the encoded data
+  if (rfb::Server::shareEncoding && (authClientCount() > 1))
+    encodeCache.startFrame();
+
   for (ci = clients.begin(); ci != clients.end(); ci = ci_next) {
     ci_next = ci; ci_next++;
     (*ci)->add_copied(ui.copied, ui.copy_delta);
     (*ci)->add_changed(ui.changed);
     (*ci)->writeFramebufferUpdateOrClose();
   }
+
+  encodeCache.endFrame();
 }
 
 // checkUpdate() is called by clients to see if it is safe to read from
@@ -733,6 +812,16 @@ void VNCServerST::notifyScreenLayoutChange(VNCSConnectionST* requester)
   }
 }
 
+bool VNCServerST::updatesRequested()
+{
+  std::list<VNCSConnectionST*>::iterator ci;
+  for (ci = clients.begin(); ci != clients.end(); ci++) {
+    if ((*ci)->isUpdateRequested())
+      return true;
+  }
+  return false;
+}
+
 bool VNCServerST::getComparerState()
 {
   if (rfb::Server::compareFB == 0)
@@ -31,6 +31,8 @@
 #include <rfb/LogWriter.h>
 #include <rfb/Blacklist.h>
 #include <rfb/Cursor.h>
+#include <rfb/EncodeCache.h>
+#include <rfb/FramePacer.h>
 #include <rfb/Timer.h>
 #include <network/Socket.h>
 #include <rfb/ScreenSet.h>
@@ -182,6 +184,11 @@ namespace rfb {
     void getConnInfo(ListConnInfo * listConn);
     void setConnStatus(ListConnInfo* listConn);
 
+    // updatesRequested() returns true if any client is waiting for a
+    // framebuffer update. There is no point looking for changes to the
+    // framebuffer until this is the case.
+    bool updatesRequested();
+
     bool getDisable() { return disableclients;};
     void setDisable(bool disable) { disableclients = disable;};
 
@@ -215,6 +222,7 @@ namespace rfb {
     std::list<network::Socket*> closingSockets;
 
     ComparingUpdateTracker* comparer;
+    EncodeCache encodeCache;
 
     Point cursorPos;
     Cursor* cursor;
@@ -228,6 +236,7 @@ namespace rfb {
     void startFrameClock();
     void stopFrameClock();
     int msToNextUpdate();
+    int msToClientsReady();
     void writeUpdate();
     Region getPendingRegion();
     const RenderedCursor* getRenderedCursor();
@@ -246,6 +255,7 @@ namespace rfb {
     bool disableclients;
 
     Timer frameTimer;
+    FramePacer pacer;
   };
 
 };
@@ -83,7 +83,8 @@ void ZRLEDecoder::readRect(const Rect& r, rdr::InStream* is,
 
 void ZRLEDecoder::decodeRect(const Rect& r, const void* buffer,
                              size_t buflen, const ConnParams& cp,
-                             ModifiablePixelBuffer* pb)
+                             ModifiablePixelBuffer* pb,
+                             DecoderContext* ctx)
 {
   rdr::MemInStream is(buffer, buflen);
   const rfb::PixelFormat& pf = cp.pf();
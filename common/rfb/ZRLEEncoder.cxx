@@ -82,7 +82,7 @@ void ZRLEEncoder::writeRect(const PixelBuffer* pb, const Palette& palette)
 
   zos.flush();
 
-  os = conn->getOutStream();
+  os = getOutStream();
 
   os->writeU32(mos.length());
   os->writeBytes(mos.data(), mos.length());
@@ -107,7 +107,7 @@ void ZRLEEncoder::writeSolidRect(int width, int height,
 
   zos.flush();
 
-  os = conn->getOutStream();
+  os = getOutStream();
 
   os->writeU32(mos.length());
   os->writeBytes(mos.data(), mos.length());
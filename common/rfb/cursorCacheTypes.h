@@ -0,0 +1,30 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+#ifndef __RFB_CURSORCACHETYPES_H__
+#define __RFB_CURSORCACHETYPES_H__
+
+namespace rfb {
+  // Both sides put every cursor that is sent with one of the normal
+  // cursor pseudo-encodings in the least recently used of this many
+  // slots, where both storing a cursor and a CursorCache rect referring
+  // to it count as a use. A CursorCache rect then only has to carry the
+  // slot number. Ties are broken by picking the lowest slot.
+  const int cursorCacheMaxEntries = 16;
+}
+
+#endif
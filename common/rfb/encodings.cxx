@@ -28,6 +28,8 @@ int rfb::encodingNum(const char* name)
   if (strcasecmp(name, "hextile") == 0)  return encodingHextile;
   if (strcasecmp(name, "ZRLE") == 0)     return encodingZRLE;
   if (strcasecmp(name, "Tight") == 0)    return encodingTight;
+  if (strcasecmp(name, "TightZstd") == 0) return encodingTightZstd;
+  if (strcasecmp(name, "LZ4") == 0) return encodingLZ4;
   return -1;
 }
 
@@ -41,6 +43,10 @@ const char* rfb::encodingName(int num)
   case encodingHextile:  return "hextile";
   case encodingZRLE:     return "ZRLE";
   case encodingTight:    return "Tight";
+  case encodingSharedMemory: return "SharedMemory";
+  case encodingTileCache: return "TileCache";
+  case encodingTightZstd: return "TightZstd";
+  case encodingLZ4: return "LZ4";
   default:               return "[unknown encoding]";
   }
 }
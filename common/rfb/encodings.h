@@ -29,6 +29,12 @@ namespace rfb {
   const int encodingTight = 7;
   const int encodingZRLE = 16;
 
+  // x11clone-specific
+  const int encodingSharedMemory = 200;
+  const int encodingTileCache = 201;
+  const int encodingTightZstd = 202;
+  const int encodingLZ4 = 203;
+
   const int encodingMax = 255;
 
   const int pseudoEncodingXCursor = -240;
@@ -59,6 +65,11 @@ namespace rfb {
   const int pseudoEncodingSubsamp8X = -764;
   const int pseudoEncodingSubsamp16X = -763;
 
+  // x11clone-specific
+  const int pseudoEncodingSharedMemory = -1100;
+  const int pseudoEncodingTileCache = -1101;
+  const int pseudoEncodingCursorCache = -1102;
+
   int encodingNum(const char* name);
   const char* encodingName(int num);
 }
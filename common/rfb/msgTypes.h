@@ -42,6 +42,9 @@ namespace rfb {
 
   const int msgTypeEnableContinuousUpdates = 150;
 
+  // x11clone-specific
+  const int msgTypeSetSharedMemory = 200;
+
   const int msgTypeClientFence = 248;
 
   const int msgTypeSetDesktopSize = 251;
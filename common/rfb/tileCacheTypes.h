@@ -0,0 +1,36 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+#ifndef __RFB_TILECACHETYPES_H__
+#define __RFB_TILECACHETYPES_H__
+
+namespace rfb {
+  // Operations in a TileCache rect
+  const int tileCacheOpReference = 0;
+  const int tileCacheOpStore     = 1;
+  const int tileCacheOpFlush     = 2;
+
+  // Both sides must evict entries in the same way, so the size of the
+  // cache is fixed by the protocol. With the largest pixel format this
+  // is at most 32 MiB.
+  const int tileCacheMaxEntries  = 2048;
+
+  // Tiles are aligned to this grid
+  const int tileCacheTileSize    = 64;
+}
+
+#endif
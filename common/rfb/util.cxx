@@ -129,6 +129,28 @@ namespace rfb {
     return msBetween(then, &now);
   }
 
+  unsigned usBetween(const struct timeval *first,
+                     const struct timeval *second)
+  {
+    unsigned diff;
+
+    diff = (second->tv_sec - first->tv_sec) * 1000000;
+
+    diff += second->tv_usec;
+    diff -= first->tv_usec;
+
+    return diff;
+  }
+
+  unsigned usSince(const struct timeval *then)
+  {
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+
+    return usBetween(then, &now);
+  }
+
   bool isBefore(const struct timeval *first,
                 const struct timeval *second)
   {
@@ -106,6 +106,11 @@ namespace rfb {
   // Returns time elapsed since given moment in milliseconds.
   unsigned msSince(const struct timeval *then);
 
+  // Same as the above, but in microseconds.
+  unsigned usBetween(const struct timeval *first,
+                     const struct timeval *second);
+  unsigned usSince(const struct timeval *then);
+
   // Returns true if first happened before seconds
   bool isBefore(const struct timeval *first,
                 const struct timeval *second);
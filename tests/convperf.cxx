@@ -35,6 +35,8 @@ typedef void (*testfn) (rfb::PixelFormat&, rfb::PixelFormat&, rdr::U8*, rdr::U8*
 struct TestEntry {
   const char *label;
   testfn fn;
+  // Only bufferFromBuffer() has SIMD versions
+  rfb::PixelFormat::SIMDLevel simd;
 };
 
 static void testMemcpy(rfb::PixelFormat &dstpf, rfb::PixelFormat &srcpf,
@@ -92,10 +94,12 @@ static void doTest(testfn fn, rfb::PixelFormat &dstpf, rfb::PixelFormat &srcpf)
 }
 
 struct TestEntry tests[] = {
-  {"memcpy", testMemcpy},
-  {"bufferFromBuffer", testBuffer},
-  {"rgbFromBuffer", testToRGB},
-  {"bufferFromRGB", testFromRGB},
+  {"memcpy", testMemcpy, rfb::PixelFormat::simdNone},
+  {"bufferFromBuffer", testBuffer, rfb::PixelFormat::simdNone},
+  {"bufferFromBuffer (SSE2)", testBuffer, rfb::PixelFormat::simdSSE2},
+  {"bufferFromBuffer (AVX2)", testBuffer, rfb::PixelFormat::simdAVX2},
+  {"rgbFromBuffer", testToRGB, rfb::PixelFormat::simdNone},
+  {"bufferFromRGB", testFromRGB, rfb::PixelFormat::simdNone},
 };
 
 static void doTests(rfb::PixelFormat &dstpf, rfb::PixelFormat &srcpf)
@@ -110,6 +114,13 @@ static void doTests(rfb::PixelFormat &dstpf, rfb::PixelFormat &srcpf)
 
   for (i = 0;i < sizeof(tests)/sizeof(tests[0]);i++) {
     printf(",");
+
+    if (tests[i].simd > rfb::PixelFormat::getMaxSIMDLevel()) {
+      printf("n/a");
+      continue;
+    }
+
+    rfb::PixelFormat::setSIMDLevel(tests[i].simd);
     doTest(tests[i].fn, dstpf, srcpf);
   }
 
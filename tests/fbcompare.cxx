@@ -0,0 +1,353 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+/*
+ * This program reads the same files as encperf and replays them
+ * through a ComparingUpdateTracker using a full copy of the
+ * framebuffer, and one using block hashes. It verifies that both
+ * report every pixel that actually changed, and prints how much
+ * each of them reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rdr/Exception.h>
+#include <rdr/FileInStream.h>
+
+#include <rfb/CConnection.h>
+#include <rfb/CMsgReader.h>
+#include <rfb/ComparingUpdateTracker.h>
+#include <rfb/PixelBuffer.h>
+#include <rfb/PixelFormat.h>
+
+static rfb::IntParameter width("width", "Frame buffer width", 0);
+static rfb::IntParameter height("height", "Frame buffer height", 0);
+
+static rfb::StringParameter format("format", "Pixel format (e.g. bgr888)", "");
+
+// The frame buffer is always this format
+static const rfb::PixelFormat fbPF(32, 24, false, true, 255, 255, 255, 0, 8, 16);
+
+struct Mode {
+  const char *name;
+  bool useHashes;
+  rfb::ComparingUpdateTracker *tracker;
+  unsigned long long pixels;
+  unsigned long long missed;
+};
+
+class CConn : public rfb::CConnection {
+public:
+  CConn(const char *filename);
+  ~CConn();
+
+  virtual void setDesktopSize(int w, int h);
+  virtual void setCursor(int, int, const rfb::Point&, const rdr::U8*);
+  virtual void framebufferUpdateStart();
+  virtual void framebufferUpdateEnd();
+  virtual void dataRect(const rfb::Rect&, int);
+  virtual void setColourMapEntries(int, int, rdr::U16*);
+  virtual void bell();
+  virtual void serverCutText(const char*, rdr::U32);
+
+public:
+  Mode modes[2];
+  unsigned long long updates;
+  unsigned long long damagePixels;
+  unsigned long long changedPixels;
+
+protected:
+  void resetTrackers();
+  rfb::Region findChanges(const rfb::Region& damage);
+
+  rdr::FileInStream *in;
+  rfb::ManagedPixelBuffer *reference;
+  rfb::Region damage;
+};
+
+CConn::CConn(const char *filename)
+{
+  modes[0].name = "Copy";
+  modes[0].useHashes = false;
+  modes[1].name = "Hashes";
+  modes[1].useHashes = true;
+  for (int i = 0; i < 2; i++) {
+    modes[i].tracker = NULL;
+    modes[i].pixels = modes[i].missed = 0;
+  }
+
+  updates = damagePixels = changedPixels = 0;
+  reference = NULL;
+
+  in = new rdr::FileInStream(filename);
+  setStreams(in, NULL);
+
+  // Need to skip the initial handshake and ServerInit
+  setState(RFBSTATE_NORMAL);
+  // That also means that the reader and writer weren't setup
+  setReader(new rfb::CMsgReader(this, in));
+  // Nor the frame buffer size and format
+  rfb::PixelFormat pf;
+  pf.parse(format);
+  setPixelFormat(pf);
+  setDesktopSize(width, height);
+}
+
+CConn::~CConn()
+{
+  for (int i = 0; i < 2; i++)
+    delete modes[i].tracker;
+  delete reference;
+  delete in;
+}
+
+void CConn::setDesktopSize(int w, int h)
+{
+  CConnection::setDesktopSize(w, h);
+
+  setFramebuffer(new rfb::ManagedPixelBuffer(fbPF, cp.width, cp.height));
+
+  delete reference;
+  reference = new rfb::ManagedPixelBuffer(fbPF, cp.width, cp.height);
+
+  resetTrackers();
+}
+
+void CConn::resetTrackers()
+{
+  rfb::PixelBuffer* pb = getFramebuffer();
+  const rdr::U8* data;
+  int stride;
+
+  for (int i = 0; i < 2; i++) {
+    delete modes[i].tracker;
+    modes[i].tracker = new rfb::ComparingUpdateTracker(pb, modes[i].useHashes);
+    // First call only records the initial state
+    modes[i].tracker->compare();
+  }
+
+  data = pb->getBuffer(pb->getRect(), &stride);
+  reference->imageRect(pb->getRect(), data, stride);
+}
+
+void CConn::setCursor(int, int, const rfb::Point&, const rdr::U8*)
+{
+}
+
+void CConn::framebufferUpdateStart()
+{
+  CConnection::framebufferUpdateStart();
+
+  damage.clear();
+}
+
+void CConn::framebufferUpdateEnd()
+{
+  rfb::PixelBuffer* pb = getFramebuffer();
+  std::vector<rfb::Rect> rects;
+  std::vector<rfb::Rect>::const_iterator rect;
+  rfb::Region changes;
+
+  CConnection::framebufferUpdateEnd();
+
+  updates++;
+
+  damage.get_rects(&rects);
+  for (rect = rects.begin(); rect != rects.end(); ++rect)
+    damagePixels += rect->area();
+
+  changes = findChanges(damage);
+  changes.get_rects(&rects);
+  for (rect = rects.begin(); rect != rects.end(); ++rect)
+    changedPixels += rect->area();
+
+  for (int i = 0; i < 2; i++) {
+    rfb::UpdateInfo ui;
+    rfb::Region missed;
+
+    modes[i].tracker->add_changed(damage);
+    modes[i].tracker->compare();
+    modes[i].tracker->getUpdateInfo(&ui, pb->getRect());
+    modes[i].tracker->clear();
+
+    ui.changed.get_rects(&rects);
+    for (rect = rects.begin(); rect != rects.end(); ++rect)
+      modes[i].pixels += rect->area();
+
+    missed = changes.subtract(ui.changed);
+    missed.get_rects(&rects);
+    for (rect = rects.begin(); rect != rects.end(); ++rect)
+      modes[i].missed += rect->area();
+  }
+
+  damage.get_rects(&rects);
+  for (rect = rects.begin(); rect != rects.end(); ++rect) {
+    int stride;
+    const rdr::U8* data = pb->getBuffer(*rect, &stride);
+    reference->imageRect(*rect, data, stride);
+  }
+}
+
+// findChanges() returns exactly those pixels in the damaged region that
+// differ from the previous frame
+rfb::Region CConn::findChanges(const rfb::Region& damage)
+{
+  rfb::PixelBuffer* pb = getFramebuffer();
+  std::vector<rfb::Rect> rects, runs;
+  std::vector<rfb::Rect>::const_iterator rect;
+  rfb::Region changes;
+
+  damage.get_rects(&rects);
+  for (rect = rects.begin(); rect != rects.end(); ++rect) {
+    rfb::Region rectChanges;
+    int newStride, oldStride;
+    const rdr::U32* newData;
+    const rdr::U32* oldData;
+
+    newData = (const rdr::U32*)pb->getBuffer(*rect, &newStride);
+    oldData = (const rdr::U32*)reference->getBuffer(*rect, &oldStride);
+
+    for (int y = 0; y < rect->height(); y++) {
+      int x = 0;
+      while (x < rect->width()) {
+        int start;
+
+        if (newData[x] == oldData[x]) {
+          x++;
+          continue;
+        }
+
+        start = x;
+        while ((x < rect->width()) && (newData[x] != oldData[x]))
+          x++;
+
+        runs.push_back(rfb::Rect(rect->tl.x + start, rect->tl.y + y,
+                                 rect->tl.x + x, rect->tl.y + y + 1));
+      }
+
+      newData += newStride;
+      oldData += oldStride;
+    }
+
+    // The runs are already sorted in bands of one line
+    rectChanges.setOrderedRects(runs);
+    changes.assign_union(rectChanges);
+    runs.clear();
+  }
+
+  return changes;
+}
+
+void CConn::dataRect(const rfb::Rect &r, int encoding)
+{
+  CConnection::dataRect(r, encoding);
+
+  damage.assign_union(rfb::Region(r));
+}
+
+void CConn::setColourMapEntries(int, int, rdr::U16*)
+{
+}
+
+void CConn::bell()
+{
+}
+
+void CConn::serverCutText(const char*, rdr::U32)
+{
+}
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr, "Syntax: %s [options] <rfb file>\n", argv0);
+  fprintf(stderr, "Options:\n");
+  rfb::Configuration::listParams(79, 14);
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  int i;
+  const char *fn;
+  CConn *cc;
+  bool failed;
+
+  fn = NULL;
+  for (i = 1; i < argc; i++) {
+    if (rfb::Configuration::setParam(argv[i]))
+      continue;
+
+    if (argv[i][0] == '-') {
+      if (i + 1 < argc) {
+        if (rfb::Configuration::setParam(&argv[i][1], argv[i + 1])) {
+          i++;
+          continue;
+        }
+      }
+      usage(argv[0]);
+    }
+
+    if (fn != NULL)
+      usage(argv[0]);
+    fn = argv[i];
+  }
+
+  if (fn == NULL) {
+    fprintf(stderr, "No file specified!\n\n");
+    usage(argv[0]);
+  }
+
+  try {
+    cc = new CConn(fn);
+  } catch (rdr::Exception& e) {
+    fprintf(stderr, "Failed to open rfb file: %s\n", e.str());
+    exit(1);
+  }
+
+  try {
+    while (true)
+      cc->processMsg();
+  } catch (rdr::EndOfStream& e) {
+  } catch (rdr::Exception& e) {
+    fprintf(stderr, "Failed to run rfb file: %s\n", e.str());
+    exit(1);
+  }
+
+  printf("Updates: %llu\n", cc->updates);
+  printf("Damaged pixels: %llu\n", cc->damagePixels);
+  printf("Changed pixels: %llu\n", cc->changedPixels);
+
+  failed = false;
+  for (i = 0; i < 2; i++) {
+    printf("%s: %llu pixels reported, %llu changed pixels missed\n",
+           cc->modes[i].name, cc->modes[i].pixels, cc->modes[i].missed);
+    if (cc->modes[i].missed != 0)
+      failed = true;
+  }
+
+  delete cc;
+
+  if (failed) {
+    printf("FAILED\n");
+    return 1;
+  }
+
+  return 0;
+}
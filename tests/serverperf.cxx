@@ -0,0 +1,838 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+/*
+ * This program reads the same files as encperf, but instead of
+ * feeding the updates straight to an encoder it replays them as
+ * damage on the desktop of a complete VNCServerST. One or more
+ * clients connect to that server over socket pairs and decode
+ * everything it sends them, each in its own thread. Every recorded
+ * update is grabbed by the server as a separate frame, so the whole
+ * server pipeline is exercised: change detection, cursor rendering,
+ * encoding and congestion control. CPU time is reported for each
+ * kind of thread rather than for each of those stages.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <list>
+#include <vector>
+
+#include <os/Mutex.h>
+#include <os/Thread.h>
+
+#include <rdr/Exception.h>
+#include <rdr/FileInStream.h>
+
+#include <network/UnixSocket.h>
+
+#include <rfb/CConnection.h>
+#include <rfb/CMsgReader.h>
+#include <rfb/CMsgWriter.h>
+#include <rfb/CSecurity.h>
+#ifdef HAVE_GNUTLS
+#include <rfb/CSecurityTLS.h>
+#endif
+#include <rfb/ComparingUpdateTracker.h>
+#include <rfb/Logger_stdio.h>
+#include <rfb/PixelBuffer.h>
+#include <rfb/PixelFormat.h>
+#include <rfb/SDesktop.h>
+#include <rfb/SecurityClient.h>
+#include <rfb/SecurityServer.h>
+#include <rfb/Timer.h>
+#include <rfb/VNCServerST.h>
+#include <rfb/util.h>
+
+static rfb::IntParameter width("width", "Frame buffer width", 0);
+static rfb::IntParameter height("height", "Frame buffer height", 0);
+static rfb::IntParameter count("count", "Number of benchmark iterations", 3);
+
+static rfb::StringParameter format("format", "Pixel format (e.g. bgr888)", "");
+
+static rfb::IntParameter clientCount("clients", "Number of clients", 1);
+static rfb::StringParameter encoding("encoding",
+                                     "Encoding the clients prefer", "Tight");
+static rfb::IntParameter qualityLevel("quality",
+                                      "JPEG quality level the clients ask "
+                                      "for, or -1 for lossless", 8);
+static rfb::IntParameter compressLevel("compress",
+                                       "Compression level the clients "
+                                       "ask for", 2);
+static rfb::BoolParameter localCursor("localCursor",
+                                      "Let the clients draw the cursor "
+                                      "instead of the server", false);
+
+// The frame buffer is always this format
+static const rfb::PixelFormat fbPF(32, 24, false, true, 255, 255, 255, 0, 8, 16);
+
+// The CPU time of the calling thread only, as the clients and the
+// encoders run in parallel with the server
+static double threadCpuTime()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static double processCpuTime()
+{
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+}
+
+// Reads the recorded file one update at a time
+class Player : public rfb::CConnection {
+public:
+  Player(const char *filename);
+  ~Player();
+
+  // nextFrame() applies the next update to the frame buffer and
+  // returns where it changed, or false at the end of the file
+  bool nextFrame(rfb::Region* damage);
+
+  rfb::PixelBuffer* getPixelBuffer() { return getFramebuffer(); }
+
+  virtual void setDesktopSize(int w, int h);
+  virtual void setCursor(int, int, const rfb::Point&, const rdr::U8*);
+  virtual void framebufferUpdateEnd();
+  virtual void dataRect(const rfb::Rect&, int);
+  virtual void setColourMapEntries(int, int, rdr::U16*);
+  virtual void bell();
+  virtual void serverCutText(const char*, rdr::U32);
+
+protected:
+  rdr::FileInStream *in;
+  bool frameDone;
+  rfb::Region frameDamage;
+};
+
+class Desktop : public rfb::SDesktop {
+public:
+  Desktop(rfb::PixelBuffer* pb_) : server(NULL), pb(pb_) {}
+
+  virtual void start(rfb::VNCServer* vs);
+  virtual void stop();
+
+protected:
+  rfb::VNCServer* server;
+  rfb::PixelBuffer* pb;
+};
+
+class Server : public rfb::VNCServerST {
+public:
+  Server(rfb::SDesktop* desktop) : VNCServerST("serverperf", desktop) {}
+
+  // writeFrame() grabs any damage right away instead of waiting for
+  // the frame clock
+  void writeFrame();
+};
+
+class Client : public rfb::CConnection, public os::Thread {
+public:
+  Client(network::Socket* sock);
+  ~Client();
+
+  network::Socket* getSock() { return sock; }
+
+  // Statistics only cover the updates after the first one
+  bool isReady();
+  void getStats(unsigned* updates, unsigned long long* bytes,
+                struct timeval* lastUpdate, double* cpuTime);
+  bool hasFailed();
+
+  virtual void serverInit();
+  virtual void setCursor(int, int, const rfb::Point&, const rdr::U8*);
+  virtual void framebufferUpdateStart();
+  virtual void framebufferUpdateEnd();
+  virtual void setColourMapEntries(int, int, rdr::U16*);
+  virtual void bell();
+  virtual void serverCutText(const char*, rdr::U32);
+
+protected:
+  virtual void worker();
+
+protected:
+  network::Socket* sock;
+
+  os::Mutex mutex;
+  bool ready;
+  bool failed;
+  unsigned updates;
+  unsigned long long startPos, bytes;
+  struct timeval lastUpdate;
+  double cpuStart, cpuTime;
+};
+
+// No security type that needs these is ever used, but they must exist
+class UserPrompt : public rfb::UserPasswdGetter, public rfb::UserMsgBox {
+public:
+  virtual void getUserPasswd(bool, char** user, char** password);
+  virtual bool showMsgBox(int, const char*, const char*);
+};
+
+Player::Player(const char *filename)
+{
+  frameDone = false;
+
+  in = new rdr::FileInStream(filename);
+  setStreams(in, NULL);
+
+  // Need to skip the initial handshake and ServerInit
+  setState(RFBSTATE_NORMAL);
+  // That also means that the reader and writer weren't setup
+  setReader(new rfb::CMsgReader(this, in));
+  // Nor the frame buffer size and format
+  rfb::PixelFormat pf;
+  pf.parse(format);
+  setPixelFormat(pf);
+  setDesktopSize(width, height);
+}
+
+Player::~Player()
+{
+  delete in;
+}
+
+bool Player::nextFrame(rfb::Region* damage)
+{
+  frameDone = false;
+  frameDamage.clear();
+
+  try {
+    while (!frameDone)
+      processMsg();
+  } catch (rdr::EndOfStream& e) {
+    return false;
+  }
+
+  *damage = frameDamage;
+
+  return true;
+}
+
+void Player::setDesktopSize(int w, int h)
+{
+  CConnection::setDesktopSize(w, h);
+
+  setFramebuffer(new rfb::ManagedPixelBuffer(fbPF, cp.width, cp.height));
+}
+
+void Player::setCursor(int, int, const rfb::Point&, const rdr::U8*)
+{
+}
+
+void Player::framebufferUpdateEnd()
+{
+  CConnection::framebufferUpdateEnd();
+
+  frameDone = true;
+}
+
+void Player::dataRect(const rfb::Rect &r, int encoding)
+{
+  CConnection::dataRect(r, encoding);
+
+  frameDamage.assign_union(rfb::Region(r));
+}
+
+void Player::setColourMapEntries(int, int, rdr::U16*)
+{
+}
+
+void Player::bell()
+{
+}
+
+void Player::serverCutText(const char*, rdr::U32)
+{
+}
+
+void Desktop::start(rfb::VNCServer* vs)
+{
+  server = vs;
+  server->setPixelBuffer(pb);
+}
+
+void Desktop::stop()
+{
+  server->setPixelBuffer(NULL);
+  server = NULL;
+}
+
+void Server::writeFrame()
+{
+  if (!desktopStarted || (comparer == NULL) || comparer->is_empty())
+    return;
+
+  writeUpdate();
+}
+
+Client::Client(network::Socket* sock_)
+  : sock(sock_), ready(false), failed(false), updates(0),
+    startPos(0), bytes(0), cpuStart(0), cpuTime(0)
+{
+  setStreams(&sock->inStream(), &sock->outStream());
+
+  setShared(true);
+
+  cp.supportsLocalCursor = localCursor;
+  cp.supportsDesktopResize = true;
+  cp.supportsExtendedDesktopSize = true;
+
+  cp.qualityLevel = qualityLevel;
+  cp.compressLevel = compressLevel;
+
+  initialiseProtocol();
+}
+
+Client::~Client()
+{
+  delete sock;
+}
+
+bool Client::isReady()
+{
+  os::AutoMutex a(&mutex);
+  return ready || failed;
+}
+
+void Client::getStats(unsigned* updates_, unsigned long long* bytes_,
+                      struct timeval* lastUpdate_, double* cpuTime_)
+{
+  os::AutoMutex a(&mutex);
+
+  *updates_ = updates;
+  *bytes_ = bytes;
+  *lastUpdate_ = lastUpdate;
+  *cpuTime_ = cpuTime;
+}
+
+bool Client::hasFailed()
+{
+  os::AutoMutex a(&mutex);
+  return failed;
+}
+
+void Client::serverInit()
+{
+  int encNum;
+
+  CConnection::serverInit();
+
+  setFramebuffer(new rfb::ManagedPixelBuffer(cp.pf(), cp.width, cp.height));
+
+  encNum = rfb::encodingNum(encoding);
+  if (encNum == -1)
+    throw rdr::Exception("Unknown encoding");
+
+  writer()->writeSetEncodings(encNum, true);
+  writer()->writeFramebufferUpdateRequest(rfb::Rect(0, 0, cp.width, cp.height),
+                                          false);
+}
+
+void Client::setCursor(int, int, const rfb::Point&, const rdr::U8*)
+{
+}
+
+void Client::framebufferUpdateStart()
+{
+  CConnection::framebufferUpdateStart();
+
+  // Ask for the next one right away, like the viewer
+  writer()->writeFramebufferUpdateRequest(rfb::Rect(0, 0, cp.width, cp.height),
+                                          true);
+}
+
+void Client::framebufferUpdateEnd()
+{
+  CConnection::framebufferUpdateEnd();
+
+  os::AutoMutex a(&mutex);
+
+  if (!ready) {
+    startPos = sock->inStream().pos();
+    cpuStart = threadCpuTime();
+    ready = true;
+    return;
+  }
+
+  updates++;
+  bytes = sock->inStream().pos() - startPos;
+  gettimeofday(&lastUpdate, NULL);
+}
+
+void Client::setColourMapEntries(int, int, rdr::U16*)
+{
+}
+
+void Client::bell()
+{
+}
+
+void Client::serverCutText(const char*, rdr::U32)
+{
+}
+
+void Client::worker()
+{
+  try {
+    while (true)
+      processMsg();
+  } catch (rdr::EndOfStream& e) {
+  } catch (rdr::Exception& e) {
+    // A closed socket is how we are told to stop
+    if (!sock->isShutdown()) {
+      fprintf(stderr, "Client failed: %s\n", e.str());
+      os::AutoMutex a(&mutex);
+      failed = true;
+    }
+  }
+
+  os::AutoMutex a(&mutex);
+  if (ready)
+    cpuTime = threadCpuTime() - cpuStart;
+}
+
+void UserPrompt::getUserPasswd(bool, char** user, char** password)
+{
+  if (user)
+    *user = rfb::strDup("");
+  *password = rfb::strDup("");
+}
+
+bool UserPrompt::showMsgBox(int, const char*, const char*)
+{
+  return false;
+}
+
+// serviceSockets() waits at most timeout milliseconds for socket
+// activity on the server side and handles it. Returns true if there
+// was any.
+static bool serviceSockets(Server* server, int timeout)
+{
+  std::list<network::Socket*> sockets;
+  std::list<network::Socket*>::iterator i;
+  std::vector<struct pollfd> fds;
+  size_t n;
+
+  server->getSockets(&sockets);
+
+  for (i = sockets.begin(); i != sockets.end(); ++i) {
+    struct pollfd fd;
+    fd.fd = (*i)->getFd();
+    fd.events = POLLIN;
+    if ((*i)->outStream().bufferUsage() > 0)
+      fd.events |= POLLOUT;
+    fd.revents = 0;
+    fds.push_back(fd);
+  }
+
+  if (fds.empty())
+    return false;
+
+  if (poll(&fds[0], fds.size(), timeout) <= 0)
+    return false;
+
+  for (i = sockets.begin(), n = 0; i != sockets.end(); ++i, ++n) {
+    if (fds[n].revents & (POLLIN | POLLHUP | POLLERR))
+      server->processSocketReadEvent(*i);
+    if (fds[n].revents & POLLOUT)
+      server->processSocketWriteEvent(*i);
+  }
+
+  server->getSockets(&sockets);
+  for (i = sockets.begin(); i != sockets.end(); ++i) {
+    if ((*i)->isShutdown()) {
+      server->removeSocket(*i);
+      delete *i;
+    }
+  }
+
+  return true;
+}
+
+struct stats
+{
+  unsigned frames;
+  double realTime;
+
+  // CPU time by thread, and on the main thread by the kind of work.
+  // The pipeline stages are not separated, as frame writing covers
+  // compare, encoding and queueing the data on the sockets.
+  double replayTime;
+  double frameTime;
+  double socketTime;
+  double clientTime;
+  double otherTime;
+
+  unsigned updates;
+  unsigned long long bytes;
+
+  bool failed;
+};
+
+static struct stats runTest(const char *fn)
+{
+  Player *player;
+  Desktop *desktop;
+  Server *server;
+  std::vector<Client*> clients;
+  std::vector<Client*>::iterator ci;
+
+  struct stats s;
+  struct timeval start, end;
+  double cpuStart, cpuBefore;
+  int idle;
+  bool ready;
+
+  rfb::Region damage;
+  rfb::Point cursorPos;
+
+  memset(&s, 0, sizeof(s));
+
+  try {
+    player = new Player(fn);
+  } catch (rdr::Exception& e) {
+    fprintf(stderr, "Failed to open rfb file: %s\n", e.str());
+    exit(1);
+  }
+
+  desktop = new Desktop(player->getPixelBuffer());
+  server = new Server(desktop);
+
+  // A plain arrow, so that the server has something to render
+  {
+    const int size = 16;
+    rdr::U8 data[size * size * 4];
+
+    memset(data, 0, sizeof(data));
+    for (int y = 0; y < size; y++) {
+      for (int x = 0; x <= y / 2; x++) {
+        rdr::U8* pixel = &data[(y * size + x) * 4];
+        pixel[0] = pixel[1] = pixel[2] = (x == y / 2) ? 0 : 255;
+        pixel[3] = 255;
+      }
+    }
+
+    server->setCursor(size, size, rfb::Point(0, 0), data);
+  }
+
+  for (int i = 0; i < clientCount; i++) {
+    int fds[2];
+    Client *client;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+      perror("socketpair");
+      exit(1);
+    }
+
+    server->addSocket(new network::UnixSocket(fds[0]));
+
+    client = new Client(new network::UnixSocket(fds[1]));
+    client->start();
+    clients.push_back(client);
+  }
+
+  // Wait for everyone to get the initial full update
+  do {
+    serviceSockets(server, 10);
+    rfb::Timer::checkTimeouts();
+
+    ready = true;
+    for (ci = clients.begin(); ci != clients.end(); ++ci) {
+      if (!(*ci)->isReady())
+        ready = false;
+    }
+  } while (!ready);
+
+  gettimeofday(&start, NULL);
+  cpuStart = processCpuTime();
+
+  try {
+    while (true) {
+      cpuBefore = threadCpuTime();
+      if (!player->nextFrame(&damage))
+        break;
+      s.replayTime += threadCpuTime() - cpuBefore;
+
+      s.frames++;
+
+      cpuBefore = threadCpuTime();
+
+      // Wander around a bit so the rendered cursor keeps changing
+      cursorPos = damage.get_bounding_rect().tl;
+      server->setCursorPos(cursorPos);
+
+      server->add_changed(damage);
+
+      serviceSockets(server, 0);
+      rfb::Timer::checkTimeouts();
+
+      s.socketTime += threadCpuTime() - cpuBefore;
+
+      cpuBefore = threadCpuTime();
+      server->writeFrame();
+      s.frameTime += threadCpuTime() - cpuBefore;
+    }
+  } catch (rdr::Exception& e) {
+    fprintf(stderr, "Failed to run rfb file: %s\n", e.str());
+    exit(1);
+  }
+
+  // The server has to be done with every frame, even those that did
+  // not result in an update, before the clock stops
+  gettimeofday(&end, NULL);
+
+  // Let the clients catch up with whatever is still queued. The idle
+  // waits at the end are not part of the real time.
+  cpuBefore = threadCpuTime();
+  idle = 0;
+  while (idle < 10) {
+    bool busy;
+
+    busy = serviceSockets(server, 10);
+    rfb::Timer::checkTimeouts();
+    server->writeFrame();
+
+    if (busy) {
+      idle = 0;
+      gettimeofday(&end, NULL);
+    } else {
+      idle++;
+    }
+  }
+  s.socketTime += threadCpuTime() - cpuBefore;
+
+  s.otherTime = processCpuTime() - cpuStart;
+
+  for (ci = clients.begin(); ci != clients.end(); ++ci)
+    (*ci)->getSock()->shutdown();
+
+  for (ci = clients.begin(); ci != clients.end(); ++ci) {
+    unsigned updates;
+    unsigned long long bytes;
+    struct timeval lastUpdate;
+    double cpuTime;
+
+    (*ci)->wait();
+
+    (*ci)->getStats(&updates, &bytes, &lastUpdate, &cpuTime);
+    if ((*ci)->hasFailed())
+      s.failed = true;
+
+    s.updates += updates;
+    s.bytes += bytes;
+    s.clientTime += cpuTime;
+
+    if ((updates > 0) && rfb::isBefore(&end, &lastUpdate))
+      end = lastUpdate;
+
+    delete *ci;
+  }
+
+  s.realTime = (double)end.tv_sec - start.tv_sec;
+  s.realTime += ((double)end.tv_usec - start.tv_usec)/1000000.0;
+
+  s.otherTime -= s.replayTime + s.frameTime + s.socketTime + s.clientTime;
+  if (s.otherTime < 0)
+    s.otherTime = 0;
+
+  // The server side will see the sockets close
+  while (serviceSockets(server, 100))
+    ;
+
+  delete server;
+  delete desktop;
+  delete player;
+
+  return s;
+}
+
+static void sort(double *array, int count)
+{
+  bool sorted;
+  int i;
+  do {
+    sorted = true;
+    for (i = 1; i < count; i++) {
+      if (array[i-1] > array[i]) {
+        double d;
+        d = array[i];
+        array[i] = array[i - 1];
+        array[i - 1] = d;
+        sorted = false;
+      }
+    }
+  } while (!sorted);
+}
+
+static void printMedian(const char* label, const char* unit,
+                        double* values, int count)
+{
+  double dev[count];
+  double median, meddev;
+
+  sort(values, count);
+  median = values[count/2];
+
+  for (int i = 0;i < count;i++) {
+    if (median == 0)
+      dev[i] = 0;
+    else
+      dev[i] = fabs((values[i] - median) / median) * 100;
+  }
+
+  sort(dev, count);
+  meddev = dev[count/2];
+
+  printf("%s: %g%s (+/- %g %%)\n", label, median, unit, meddev);
+}
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr, "Syntax: %s [options] <rfb file>\n", argv0);
+  fprintf(stderr, "Options:\n");
+  rfb::Configuration::listParams(79, 14);
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  int i;
+
+  const char *fn;
+
+  UserPrompt userPrompt;
+
+  fn = NULL;
+  for (i = 1; i < argc; i++) {
+    if (rfb::Configuration::setParam(argv[i]))
+      continue;
+
+    if (argv[i][0] == '-') {
+      if (i + 1 < argc) {
+        if (rfb::Configuration::setParam(&argv[i][1], argv[i + 1])) {
+          i++;
+          continue;
+        }
+      }
+      usage(argv[0]);
+    }
+
+    if (fn != NULL)
+      usage(argv[0]);
+
+    fn = argv[i];
+  }
+
+  int runCount = count;
+  struct stats runs[runCount];
+  double values[runCount];
+
+  if (fn == NULL) {
+    fprintf(stderr, "No file specified!\n\n");
+    usage(argv[0]);
+  }
+
+  if (strcmp(format, "") == 0) {
+    fprintf(stderr, "Pixel format not specified!\n\n");
+    usage(argv[0]);
+  }
+
+  if (width == 0 || height == 0) {
+    fprintf(stderr, "Frame buffer size not specified!\n\n");
+    usage(argv[0]);
+  }
+
+  if ((runCount < 1) || (clientCount < 1)) {
+    fprintf(stderr, "Need at least one run and one client!\n\n");
+    usage(argv[0]);
+  }
+
+  rfb::initStdIOLoggers();
+
+  // No authentication between the server and the clients
+  rfb::SecurityServer::secTypes.setParam("None");
+  rfb::SecurityClient::secTypes.setParam("None");
+  rfb::CSecurity::upg = &userPrompt;
+#ifdef HAVE_GNUTLS
+  rfb::CSecurityTLS::msg = &userPrompt;
+#endif
+
+  // Warmup
+  runTest(fn);
+
+  // Multiple runs to get a good average
+  for (i = 0; i < runCount; i++) {
+    runs[i] = runTest(fn);
+    if (runs[i].failed)
+      exit(1);
+  }
+
+  printf("Frames replayed: %u\n", runs[0].frames);
+  printf("Updates received: %g per client\n",
+         (double)runs[0].updates / clientCount);
+
+  for (i = 0;i < runCount;i++)
+    values[i] = runs[i].realTime;
+  printMedian("Real time", " s", values, runCount);
+
+  for (i = 0;i < runCount;i++)
+    values[i] = runs[i].updates / clientCount / runs[i].realTime;
+  printMedian("Updates per second", " fps", values, runCount);
+
+  for (i = 0;i < runCount;i++)
+    values[i] = runs[i].replayTime;
+  printMedian("Main thread CPU time (replaying)", " s", values, runCount);
+
+  for (i = 0;i < runCount;i++)
+    values[i] = runs[i].frameTime;
+  printMedian("Main thread CPU time (writing frames)", " s", values, runCount);
+
+  for (i = 0;i < runCount;i++)
+    values[i] = runs[i].socketTime;
+  printMedian("Main thread CPU time (damage and sockets)", " s", values, runCount);
+
+  for (i = 0;i < runCount;i++)
+    values[i] = runs[i].clientTime;
+  printMedian("Client threads CPU time", " s", values, runCount);
+
+  for (i = 0;i < runCount;i++)
+    values[i] = runs[i].otherTime;
+  printMedian("Other threads CPU time", " s", values, runCount);
+
+  printf("Bytes on the wire: %llu per client\n",
+         runs[0].bytes / clientCount);
+
+  return 0;
+}
@@ -0,0 +1,108 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *    
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// DamageCoalescer.cxx
+//
+
+#include <x0vncserver/DamageCoalescer.h>
+
+using namespace rfb;
+
+DamageCoalescer::DamageCoalescer(int width, int height)
+  : m_width(width), m_height(height),
+    m_widthTiles((width + 31) / 32),
+    m_heightTiles((height + 31) / 32),
+    m_tiles(m_widthTiles * m_heightTiles, false),
+    m_empty(true)
+{
+}
+
+void DamageCoalescer::add(const Rect &r)
+{
+  Rect clipped = r.intersect(Rect(0, 0, m_width, m_height));
+  if (clipped.is_empty())
+    return;
+
+  int x0 = clipped.tl.x / 32;
+  int x1 = (clipped.br.x + 31) / 32;
+  int y0 = clipped.tl.y / 32;
+  int y1 = (clipped.br.y + 31) / 32;
+
+  for (int ty = y0; ty < y1; ty++) {
+    std::vector<bool>::iterator row = m_tiles.begin() + ty * m_widthTiles;
+    for (int tx = x0; tx < x1; tx++)
+      row[tx] = true;
+  }
+
+  m_empty = false;
+}
+
+void DamageCoalescer::flush(rfb::Region *region)
+{
+  std::vector<Rect> rects;
+  std::vector<int> runs, prevRuns;
+  int bandStart;
+
+  if (m_empty)
+    return;
+
+  // Each row of tiles is turned in to runs of damaged tiles. Rows with
+  // the same runs as the one above simply make that band taller.
+  bandStart = 0;
+  for (int ty = 0; ty < m_heightTiles; ty++) {
+    std::vector<bool>::iterator row = m_tiles.begin() + ty * m_widthTiles;
+    int y = ty * 32;
+    int bottom = y + 32 < m_height ? y + 32 : m_height;
+
+    runs.clear();
+    for (int tx = 0; tx < m_widthTiles; tx++) {
+      if (!row[tx])
+        continue;
+      int start = tx;
+      while ((tx < m_widthTiles) && row[tx]) {
+        row[tx] = false;
+        tx++;
+      }
+      runs.push_back(start);
+      runs.push_back(tx);
+    }
+
+    if (!runs.empty() && (runs == prevRuns)) {
+      for (int i = bandStart; i < (int)rects.size(); i++)
+        rects[i].br.y = bottom;
+      continue;
+    }
+
+    bandStart = rects.size();
+    for (int i = 0; i < (int)runs.size(); i += 2) {
+      int right = runs[i + 1] * 32;
+      if (right > m_width)
+        right = m_width;
+      rects.push_back(Rect(runs[i] * 32, y, right, bottom));
+    }
+
+    prevRuns = runs;
+  }
+
+  Region damage;
+  damage.setOrderedRects(rects);
+  region->assign_union(damage);
+
+  m_empty = true;
+}
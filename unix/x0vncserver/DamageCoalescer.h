@@ -0,0 +1,63 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *    
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// DamageCoalescer class. It collects damage rectangles as reported by
+// the X server in a grid of 32x32 tiles, so that marking a rectangle
+// is cheap no matter how many have been reported before. The damaged
+// tiles are then handed out as a region made of a few wide bands.
+//
+
+#ifndef __DAMAGECOALESCER_H__
+#define __DAMAGECOALESCER_H__
+
+#include <vector>
+
+#include <rfb/Rect.h>
+#include <rfb/Region.h>
+
+class DamageCoalescer {
+
+public:
+
+  DamageCoalescer(int width, int height);
+
+  // Mark the tiles covered by the rectangle as damaged. The rectangle
+  // is clipped to the framebuffer.
+  void add(const rfb::Rect &r);
+
+  bool isEmpty() const { return m_empty; }
+
+  // Store all damaged tiles in the region and forget about them.
+  void flush(rfb::Region *region);
+
+protected:
+
+  const int m_width;
+  const int m_height;
+  const int m_widthTiles;       // shortcut for ((m_width + 31) / 32)
+  const int m_heightTiles;      // shortcut for ((m_height + 31) / 32)
+
+  // One flag per tile, row by row
+  std::vector<bool> m_tiles;
+
+  bool m_empty;
+
+};
+
+#endif // __DAMAGECOALESCER_H__
@@ -28,6 +28,7 @@
 #include <rfb/VNCServer.h>
 #include <rfb/Configuration.h>
 #include <rfb/ServerCore.h>
+#include <rfb/TileCompare.h>
 
 #include <x0vncserver/PollingManager.h>
 
@@ -35,6 +36,13 @@ using namespace rfb;
 
 static LogWriter vlog("PollingMgr");
 
+static IntParameter pollingBackoff("PollingBackoff",
+                                   "How many times to halve how often "
+                                   "unchanged parts of the screen are "
+                                   "checked. Each step doubles the time it "
+                                   "can take to notice a small change in "
+                                   "such a part", 0, 0, 3);
+
 const int PollingManager::m_pollingOrder[32] = {
    0, 16,  8, 24,  4, 20, 12, 28,
   10, 26, 18,  2, 22,  6, 30, 14,
@@ -42,6 +50,17 @@ const int PollingManager::m_pollingOrder[32] = {
   19,  3, 27, 11, 29, 13,  5, 21
 };
 
+// Static tiles end up being checked at most every 8th pass
+const int PollingManager::m_maxBackoff = 3;
+
+// Tiles that changed within this many passes are considered hot, and
+// get this many scan lines checked in each pass
+const unsigned PollingManager::m_hotPasses = 32;
+const int PollingManager::m_hotLines = 4;
+
+// Seconds between each time the statistics are logged
+const int PollingManager::m_statsInterval = 300;
+
 //
 // Constructor.
 //
@@ -63,6 +82,10 @@ PollingManager::PollingManager(Display *dpy, const Image *image,
     m_heightTiles((image->xim->height + 31) / 32),
     m_numTiles(((image->xim->width + 31) / 32) *
                ((image->xim->height + 31) / 32)),
+    m_backoffLimit(pollingBackoff),
+    m_pass(0),
+    m_statsPasses(0),
+    m_statsStart(time(NULL)),
     m_pollingStep(0)
 {
   // Create additional images used in polling algorithm, warn if
@@ -81,10 +104,28 @@ PollingManager::PollingManager(Display *dpy, const Image *image,
 
   m_changeFlags = new bool[m_numTiles];
   memset(m_changeFlags, 0, m_numTiles * sizeof(bool));
+
+  m_rowMask = new rdr::U32[tileMaskSize(m_width, 32)];
+
+  m_skipFlags = new bool[m_widthTiles];
+  m_pendingFlags = new bool[m_widthTiles];
+
+  m_tileState = new TileState[m_numTiles];
+  memset(m_tileState, 0, m_numTiles * sizeof(TileState));
+  for (int i = 0; i < m_numTiles; i++)
+    m_tileState[i].lastChange = m_pass - m_hotPasses;
+  m_tileDue = new bool[m_numTiles];
 }
 
 PollingManager::~PollingManager()
 {
+  logStats();
+
+  delete[] m_tileDue;
+  delete[] m_tileState;
+  delete[] m_pendingFlags;
+  delete[] m_skipFlags;
+  delete[] m_rowMask;
   delete[] m_changeFlags;
 
   delete m_rowImage;
@@ -127,6 +168,9 @@ void PollingManager::poll(VNCServer *server)
 
   pollScreen(server);
 
+  if (time(NULL) - m_statsStart >= m_statsInterval)
+    logStats();
+
 #ifdef DEBUG
   debugAfterPoll();
 #endif
@@ -147,15 +191,63 @@ bool PollingManager::pollScreen(VNCServer *server)
   // been detected yet.
   memset(m_changeFlags, 0, m_numTiles * sizeof(bool));
 
+  // Find out which tiles are due to be checked in this pass.
+  for (int i = 0; i < m_numTiles; i++)
+    m_tileDue[i] = (int)(m_pass - m_tileState[i].nextPass) >= 0;
+
   // First pass over the framebuffer. Here we scan 1/32 part of the
   // framebuffer -- that is, one line in each (32 * m_width) stripe.
-  // We compare the pixels of that line with previous framebuffer
-  // contents and raise corresponding elements of m_changeFlags[].
-  int scanOffset = m_pollingOrder[m_pollingStep++ % 32];
+  // Hot tiles get a few more lines, evenly spread over the polling
+  // order. Each tile moves along the polling order on its own, so
+  // that tiles that are checked less often still get all their lines
+  // checked. We compare the pixels of those lines with previous
+  // framebuffer contents and raise corresponding elements of
+  // m_changeFlags[].
   int nTilesChanged = 0;
-  for (int y = scanOffset; y < m_height; y += 32) {
-    nTilesChanged += checkRow(0, y, m_width);
+  for (int line = 0; line < m_hotLines; line++) {
+    for (int tileY = 0; tileY < m_heightTiles; tileY++) {
+      int rowStart = tileY * m_widthTiles;
+      const bool *pDue = &m_tileDue[rowStart];
+      int first = m_widthTiles;
+
+      for (int x = 0; x < m_widthTiles; x++) {
+        if (line == 0)
+          m_pendingFlags[x] = pDue[x];
+        else
+          m_pendingFlags[x] = pDue[x] && isHot(rowStart + x);
+        if (m_pendingFlags[x] && (first == m_widthTiles))
+          first = x;
+      }
+
+      // Tiles are mostly at the same position in the polling order,
+      // so this is usually a single scan line per row of tiles
+      while (first < m_widthTiles) {
+        int scanLine = scanOffset(rowStart + first, line);
+        int next = m_widthTiles;
+
+        for (int x = first; x < m_widthTiles; x++) {
+          m_skipFlags[x] = true;
+          if (!m_pendingFlags[x])
+            continue;
+          if (scanOffset(rowStart + x, line) == scanLine) {
+            m_skipFlags[x] = false;
+            m_pendingFlags[x] = false;
+          } else if (next == m_widthTiles) {
+            next = x;
+          }
+        }
+        for (int x = 0; x < first; x++)
+          m_skipFlags[x] = true;
+
+        int y = tileY * 32 + scanLine;
+        if (y < m_height)
+          nTilesChanged += checkTileRow(y);
+
+        first = next;
+      }
+    }
   }
+  m_pollingStep++;
 
   DBG_REPORT_CHANGES("After 1st pass");
 
@@ -168,6 +260,8 @@ bool PollingManager::pollScreen(VNCServer *server)
     nTilesChanged = sendChanges(server);
   }
 
+  updateSchedule();
+
 #ifdef DEBUG_PRINT_NUM_CHANGED_TILES
   printf("%3d ", nTilesChanged);
   if (m_pollingStep % 32 == 0) {
@@ -184,7 +278,33 @@ bool PollingManager::pollScreen(VNCServer *server)
   return (nTilesChanged != 0);
 }
 
-int PollingManager::checkRow(int x, int y, int w)
+int PollingManager::checkTileRow(int y)
+{
+  int first, last;
+
+  // Only get the part of the row that has tiles to check
+  for (first = 0; first < m_widthTiles; first++) {
+    if (!m_skipFlags[first])
+      break;
+  }
+  if (first == m_widthTiles)
+    return 0;
+
+  for (last = m_widthTiles - 1; last > first; last--) {
+    if (!m_skipFlags[last])
+      break;
+  }
+
+  int x = first * 32;
+  int w = (last + 1) * 32;
+  if (w > m_width)
+    w = m_width;
+  w -= x;
+
+  return checkRow(x, y, w, &m_skipFlags[first]);
+}
+
+int PollingManager::checkRow(int x, int y, int w, const bool *pSkipFlags)
 {
   // If necessary, expand the row to the left, to the tile border.
   // In other words, x must be a multiple of 32.
@@ -205,26 +325,24 @@ int PollingManager::checkRow(int x, int y, int w)
   char *ptr_new = m_rowImage->xim->data;
 
   // Compare pixels, raise corresponding elements of m_changeFlags[].
-  // First, handle full-size (32 pixels wide) tiles.
-  int nTilesChanged = 0;
-  int nBytesPerTile = 32 * m_bytesPerPixel;
-  for (int i = 0; i < w / 32; i++) {
-    if (memcmp(ptr_old, ptr_new, nBytesPerTile)) {
-      *pChangeFlags = true;
-      nTilesChanged++;
-    }
-    pChangeFlags++;
-    ptr_old += nBytesPerTile;
-    ptr_new += nBytesPerTile;
+  // Tiles already known to have changed are skipped, as are those we
+  // were asked to skip.
+  int nTiles = (w + 31) / 32;
+  memset(m_rowMask, 0, tileMaskSize(w, 32) * sizeof(rdr::U32));
+  for (int i = 0; i < nTiles; i++) {
+    if (pChangeFlags[i] || (pSkipFlags && pSkipFlags[i]))
+      tileMaskSet(m_rowMask, i);
   }
 
-  // Handle the rightmost pixels, if the width is not a multiple of 32.
-  int nBytesLeft = (w % 32) * m_bytesPerPixel;
-  if (nBytesLeft != 0) {
-    if (memcmp(ptr_old, ptr_new, nBytesLeft)) {
-      *pChangeFlags = true;
-      nTilesChanged++;
-    }
+  int nTilesChanged = compareTiles((const rdr::U8*)ptr_old,
+                                   (const rdr::U8*)ptr_new,
+                                   w, m_bytesPerPixel, 32, m_rowMask);
+  if (nTilesChanged == 0)
+    return 0;
+
+  for (int i = 0; i < nTiles; i++) {
+    if (tileMaskTest(m_rowMask, i) && !(pSkipFlags && pSkipFlags[i]))
+      pChangeFlags[i] = true;
   }
 
   return nTilesChanged;
@@ -234,19 +352,23 @@ int PollingManager::checkColumn(int x, int y, int h, bool *pChangeFlags)
 {
   getColumn(x, y, h);
 
+  int oldStride = m_image->xim->bytes_per_line;
+  int newStride = m_columnImage->xim->bytes_per_line;
+
   int nTilesChanged = 0;
   for (int nTile = 0; nTile < (h + 31) / 32; nTile++) {
     if (!*pChangeFlags) {
       int tile_h = (h - nTile * 32 >= 32) ? 32 : h - nTile * 32;
+      const char *ptr_old = m_image->locatePixel(x, y + nTile * 32);
+      const char *ptr_new = m_columnImage->locatePixel(0, nTile * 32);
       for (int i = 0; i < tile_h; i++) {
-        // FIXME: Do not compute these pointers in the inner cycle.
-        char *ptr_old = m_image->locatePixel(x, y + nTile * 32 + i);
-        char *ptr_new = m_columnImage->locatePixel(0, nTile * 32 + i);
-        if (memcmp(ptr_old, ptr_new, m_bytesPerPixel)) {
+        if (pixelDiffers(ptr_old, ptr_new)) {
           *pChangeFlags = true;
           nTilesChanged++;
           break;
         }
+        ptr_old += oldStride;
+        ptr_new += newStride;
       }
     }
     pChangeFlags += m_widthTiles;
@@ -344,6 +466,99 @@ PollingManager::checkNeighbors()
   }
 }
 
+void
+PollingManager::updateSchedule()
+{
+  for (int i = 0; i < m_numTiles; i++) {
+    TileState *tile = &m_tileState[i];
+
+    if (m_changeFlags[i]) {
+      tile->lastChange = m_pass;
+      tile->changes++;
+      tile->backoff = 0;
+      tile->idleChecks = 0;
+      tile->nextPass = m_pass + 1;
+      // Get back in step with the other busy tiles so that they can
+      // share scan lines
+      tile->scanStep = m_pollingStep;
+    } else if (m_tileDue[i]) {
+      tile->scanStep++;
+      // Back off once every line of the tile has been checked without
+      // finding anything
+      tile->idleChecks++;
+      if ((tile->idleChecks >= 32) && (tile->backoff < m_backoffLimit)) {
+        tile->backoff++;
+        tile->idleChecks = 0;
+      }
+      tile->nextPass = m_pass + (1 << tile->backoff);
+    }
+
+    if (m_tileDue[i])
+      tile->checks++;
+  }
+
+  m_pass++;
+  m_statsPasses++;
+}
+
+void
+PollingManager::logStats()
+{
+  rdr::U64 checks, changes;
+  int hot, levels[m_maxBackoff + 1];
+  int hottest[5];
+
+  m_statsStart = time(NULL);
+
+  if (m_statsPasses == 0)
+    return;
+
+  checks = changes = 0;
+  hot = 0;
+  for (int i = 0; i <= m_maxBackoff; i++)
+    levels[i] = 0;
+  for (int i = 0; i < 5; i++)
+    hottest[i] = -1;
+
+  for (int i = 0; i < m_numTiles; i++) {
+    checks += m_tileState[i].checks;
+    changes += m_tileState[i].changes;
+    if (isHot(i))
+      hot++;
+    levels[m_tileState[i].backoff]++;
+
+    // Keep a short list of the tiles that changed the most
+    for (int j = 0; j < 5; j++) {
+      if ((hottest[j] == -1) ||
+          (m_tileState[i].changes > m_tileState[hottest[j]].changes)) {
+        memmove(&hottest[j + 1], &hottest[j], (4 - j) * sizeof(int));
+        hottest[j] = i;
+        break;
+      }
+    }
+  }
+
+  vlog.info("Polling: %u passes, %.1f%% of tiles checked per pass",
+            m_statsPasses, 100.0 * checks / m_statsPasses / m_numTiles);
+  vlog.info("  %llu tile changes, %d tiles currently hot",
+            (unsigned long long)changes, hot);
+  vlog.info("  Tiles checked every 1/2/4/8 passes: %d/%d/%d/%d",
+            levels[0], levels[1], levels[2], levels[3]);
+
+  for (int j = 0; j < 5; j++) {
+    if ((hottest[j] == -1) || (m_tileState[hottest[j]].changes == 0))
+      break;
+    vlog.info("  Tile (%d,%d) changed in %u of %u checks",
+              hottest[j] % m_widthTiles * 32, hottest[j] / m_widthTiles * 32,
+              m_tileState[hottest[j]].changes,
+              m_tileState[hottest[j]].checks);
+  }
+
+  for (int i = 0; i < m_numTiles; i++)
+    m_tileState[i].changes = m_tileState[i].checks = 0;
+  m_statsPasses = 0;
+}
+
 void
 PollingManager::printChanges(const char *header) const
 {
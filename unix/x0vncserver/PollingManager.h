@@ -23,7 +23,10 @@
 #ifndef __POLLINGMANAGER_H__
 #define __POLLINGMANAGER_H__
 
+#include <string.h>
+#include <time.h>
 #include <X11/Xlib.h>
+#include <rdr/types.h>
 #include <rfb/VNCServer.h>
 
 #include <x0vncserver/Image.h>
@@ -42,6 +45,10 @@ public:
 
   void poll(rfb::VNCServer *server);
 
+  // Log how often tiles were checked and how often they changed, then
+  // reset those counters. poll() does this every few minutes.
+  void logStats();
+
 protected:
 
   // Screen polling. Returns true if some changes were detected.
@@ -81,13 +88,53 @@ private:
     return tile_y * m_widthTiles + tile_x;
   }
 
-  int checkRow(int x, int y, int w);
+  // Compare a single pixel, without the overhead of memcmp().
+  inline bool pixelDiffers(const char *a, const char *b) const {
+    switch (m_bytesPerPixel) {
+    case 4:
+      {
+        rdr::U32 pa, pb;
+        memcpy(&pa, a, 4);
+        memcpy(&pb, b, 4);
+        return pa != pb;
+      }
+    case 2:
+      {
+        rdr::U16 pa, pb;
+        memcpy(&pa, a, 2);
+        memcpy(&pb, b, 2);
+        return pa != pb;
+      }
+    case 1:
+      return *a != *b;
+    }
+    return memcmp(a, b, m_bytesPerPixel) != 0;
+  }
+
+  int checkRow(int x, int y, int w, const bool *pSkipFlags = 0);
   int checkColumn(int x, int y, int h, bool *pChangeFlags);
   int sendChanges(rfb::VNCServer *server) const;
 
+  // Check one scan line of the tiles in a row of tiles, except those
+  // tiles that have their element in m_skipFlags[] set.
+  int checkTileRow(int y);
+
   // Check neighboring tiles and update m_changeFlags[].
   void checkNeighbors();
 
+  // Update the schedule of every tile based on the last pass.
+  void updateSchedule();
+
+  inline bool isHot(int tile) const {
+    return m_pass - m_tileState[tile].lastChange < m_hotPasses;
+  }
+
+  // Scan line within the tile to check for the given hot line.
+  inline int scanOffset(int tile, int line) const {
+    return m_pollingOrder[(m_tileState[tile].scanStep +
+                           line * 32 / m_hotLines) % 32];
+  }
+
   // DEBUG: Print the list of changed tiles.
   void printChanges(const char *header) const;
 
@@ -104,9 +151,47 @@ private:
   // in that tile.
   bool *m_changeFlags;
 
+  // Scratch bit mask used by checkRow(), one bit per tile in a row.
+  rdr::U32 *m_rowMask;
+
+  // m_skipFlags[] holds one row of tiles that should not be checked in
+  // the current scan line.
+  bool *m_skipFlags;
+
+  // m_pendingFlags[] holds one row of tiles that still need to have a
+  // scan line checked.
+  bool *m_pendingFlags;
+
+  // Tiles that haven't changed for a while are checked less and less
+  // often, and tiles that have changed recently get extra scan lines
+  // in each pass.
+  struct TileState {
+    unsigned nextPass;          // first pass to check this tile again
+    unsigned lastChange;        // pass when a change was last seen
+    unsigned changes;           // number of passes with changes
+    unsigned checks;            // number of passes checking it
+    int backoff;                // checked every (1 << backoff) passes
+    int idleChecks;             // checks without change at this backoff
+    unsigned scanStep;          // position in m_pollingOrder[]
+  };
+  TileState *m_tileState;
+  bool *m_tileDue;
+
+  // Highest backoff allowed, from the PollingBackoff parameter
+  const int m_backoffLimit;
+
+  unsigned m_pass;
+  unsigned m_statsPasses;
+  time_t m_statsStart;
+
   unsigned int m_pollingStep;
   static const int m_pollingOrder[];
 
+  static const int m_maxBackoff;
+  static const unsigned m_hotPasses;
+  static const int m_hotLines;
+  static const int m_statsInterval;
+
 #ifdef DEBUG
 private:
 
@@ -0,0 +1,192 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *    
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// SocketMonitor.cxx
+//
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <rdr/Exception.h>
+
+#include <x0vncserver/SocketMonitor.h>
+
+#ifdef HAVE_EPOLL
+
+SocketMonitor::SocketMonitor()
+{
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd < 0)
+    throw rdr::SystemException("epoll_create1", errno);
+}
+
+SocketMonitor::~SocketMonitor()
+{
+  close(epollFd);
+}
+
+void SocketMonitor::update(int op, int fd, bool wantWrite)
+{
+  struct epoll_event ev;
+
+  ev.events = EPOLLIN;
+  if (wantWrite)
+    ev.events |= EPOLLOUT;
+  ev.data.fd = fd;
+
+  if (epoll_ctl(epollFd, op, fd, &ev) < 0)
+    throw rdr::SystemException("epoll_ctl", errno);
+}
+
+void SocketMonitor::add(int fd)
+{
+  update(EPOLL_CTL_ADD, fd, false);
+  watched[fd] = false;
+}
+
+void SocketMonitor::remove(int fd)
+{
+  if (watched.erase(fd) == 0)
+    return;
+
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+void SocketMonitor::setWantWrite(int fd, bool enable)
+{
+  std::map<int, bool>::iterator iter;
+
+  iter = watched.find(fd);
+  if ((iter == watched.end()) || (iter->second == enable))
+    return;
+
+  update(EPOLL_CTL_MOD, fd, enable);
+  iter->second = enable;
+}
+
+int SocketMonitor::wait(int timeout)
+{
+  int n;
+
+  ready.clear();
+
+  if (events.size() < watched.size())
+    events.resize(watched.size());
+  if (events.empty())
+    events.resize(1);
+
+  n = epoll_wait(epollFd, &events[0], events.size(), timeout);
+  if (n < 0) {
+    if (errno == EINTR)
+      return -1;
+    throw rdr::SystemException("epoll_wait", errno);
+  }
+
+  ready.resize(n);
+  for (int i = 0; i < n; i++) {
+    ready[i].fd = events[i].data.fd;
+    // Errors and hang ups are found out by trying to read
+    ready[i].readable = events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP);
+    ready[i].writable = events[i].events & EPOLLOUT;
+  }
+
+  return n;
+}
+
+#else
+
+SocketMonitor::SocketMonitor() : dirty(false)
+{
+}
+
+SocketMonitor::~SocketMonitor()
+{
+}
+
+void SocketMonitor::add(int fd)
+{
+  watched[fd] = false;
+  dirty = true;
+}
+
+void SocketMonitor::remove(int fd)
+{
+  if (watched.erase(fd) != 0)
+    dirty = true;
+}
+
+void SocketMonitor::setWantWrite(int fd, bool enable)
+{
+  std::map<int, bool>::iterator iter;
+
+  iter = watched.find(fd);
+  if ((iter == watched.end()) || (iter->second == enable))
+    return;
+
+  iter->second = enable;
+  dirty = true;
+}
+
+int SocketMonitor::wait(int timeout)
+{
+  int n;
+
+  ready.clear();
+
+  if (dirty) {
+    std::map<int, bool>::const_iterator iter;
+
+    pollFds.clear();
+    for (iter = watched.begin(); iter != watched.end(); ++iter) {
+      struct pollfd pfd;
+      pfd.fd = iter->first;
+      pfd.events = POLLIN;
+      if (iter->second)
+        pfd.events |= POLLOUT;
+      pfd.revents = 0;
+      pollFds.push_back(pfd);
+    }
+
+    dirty = false;
+  }
+
+  n = poll(pollFds.empty() ? NULL : &pollFds[0], pollFds.size(), timeout);
+  if (n < 0) {
+    if (errno == EINTR)
+      return -1;
+    throw rdr::SystemException("poll", errno);
+  }
+
+  for (size_t i = 0; i < pollFds.size(); i++) {
+    ReadyFd rfd;
+
+    if (pollFds[i].revents == 0)
+      continue;
+
+    rfd.fd = pollFds[i].fd;
+    // Errors and hang ups are found out by trying to read
+    rfd.readable = pollFds[i].revents & (POLLIN | POLLERR | POLLHUP | POLLNVAL);
+    rfd.writable = pollFds[i].revents & POLLOUT;
+    ready.push_back(rfd);
+  }
+
+  return ready.size();
+}
+
+#endif
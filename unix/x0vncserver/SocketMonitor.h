@@ -0,0 +1,89 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *    
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// SocketMonitor class. It keeps a set of file descriptors that the
+// main loop is interested in and waits for any of them to become
+// ready. Descriptors are registered once rather than on every pass,
+// and only the ready ones are reported back. epoll is used where
+// available, with poll() as the fallback, so there is no limit on the
+// descriptor numbers in either case.
+//
+
+#ifndef __SOCKETMONITOR_H__
+#define __SOCKETMONITOR_H__
+
+#include <map>
+#include <vector>
+
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+class SocketMonitor {
+
+public:
+
+  SocketMonitor();
+  virtual ~SocketMonitor();
+
+  // Start watching the descriptor for incoming data.
+  void add(int fd);
+
+  // Stop watching the descriptor. Must be done before it is closed.
+  void remove(int fd);
+
+  // Also watch the descriptor for room to write. Nothing is changed
+  // unless the state differs from before.
+  void setWantWrite(int fd, bool enable);
+
+  // Wait at most timeout milliseconds, or forever if it is negative.
+  // Returns the number of ready descriptors, or -1 if interrupted by
+  // a signal.
+  int wait(int timeout);
+
+  // Results from the last call to wait().
+  int getFd(int index) const { return ready[index].fd; }
+  bool isReadable(int index) const { return ready[index].readable; }
+  bool isWritable(int index) const { return ready[index].writable; }
+
+protected:
+
+  struct ReadyFd {
+    int fd;
+    bool readable;
+    bool writable;
+  };
+
+  // Descriptors being watched, and whether writing is of interest
+  std::map<int, bool> watched;
+  std::vector<ReadyFd> ready;
+
+#ifdef HAVE_EPOLL
+  int epollFd;
+  std::vector<struct epoll_event> events;
+  void update(int op, int fd, bool wantWrite);
+#else
+  bool dirty;
+  std::vector<struct pollfd> pollFds;
+#endif
+};
+
+#endif // __SOCKETMONITOR_H__
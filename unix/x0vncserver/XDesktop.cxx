@@ -30,6 +30,9 @@
 #ifdef HAVE_XFIXES
 #include <X11/extensions/Xfixes.h>
 #endif
+#ifdef HAVE_XI2
+#include <X11/extensions/XInput2.h>
+#endif
 #ifdef HAVE_XRANDR
 #include <X11/extensions/Xrandr.h>
 #include <RandrGlue.h>
@@ -37,6 +40,8 @@ extern "C" {
 void vncSetGlueContext(Display *dpy, void *res);
 }
 #endif
+#include <rfb/util.h>
+#include <x0vncserver/DamageCoalescer.h>
 #include <x0vncserver/Geometry.h>
 #include <x0vncserver/XPixelBuffer.h>
 
@@ -56,6 +61,18 @@ BoolParameter rawKeyboard("RawKeyboard",
 
 static rfb::LogWriter vlog("XDesktop");
 
+#ifdef HAVE_XDAMAGE
+// Above this many damage events per second we only ask for the
+// bounding box of the damage, and we stay that way for a while
+static const unsigned damageRateLimit = 2000;
+static const unsigned damageBoundingBoxTime = 5000;
+#endif
+
+#ifdef HAVE_XFIXES
+// Applications usually switch between a handful of cursors
+static const size_t maxCachedCursors = 32;
+#endif
+
 // order is important as it must match RFB extension
 static const char * ledNames[XDESKTOP_N_LEDS] = {
   "Scroll Lock", "Num Lock", "Caps Lock"
@@ -144,6 +161,9 @@ XDesktop::XDesktop(Display* dpy_, Geometry *geometry_)
 #ifdef HAVE_XDAMAGE
   int xdamageErrorBase;
 
+  damageLevel = XDamageReportRawRectangles;
+  damageCoalescer = 0;
+
   if (XDamageQueryExtension(dpy, &xdamageEventBase, &xdamageErrorBase)) {
     haveDamage = true;
   } else {
@@ -168,6 +188,39 @@ XDesktop::XDesktop(Display* dpy_, Geometry *geometry_)
   }
 #endif
 
+#ifdef HAVE_XI2
+  int xiEventBase, xiErrorBase;
+
+  haveXI2 = false;
+  pointerMoved = true;
+
+  // Raw events are only sent to the root window since 2.1
+  major = 2;
+  minor = 1;
+  if (XQueryExtension(dpy, "XInputExtension", &xiOpcode,
+                      &xiEventBase, &xiErrorBase) &&
+      (XIQueryVersion(dpy, &major, &minor) == Success) &&
+      ((major > 2) || (minor >= 1))) {
+    XIEventMask evmask;
+    unsigned char mask[XIMaskLen(XI_LASTEVENT)] = { 0 };
+
+    XISetMask(mask, XI_Motion);
+    XISetMask(mask, XI_RawMotion);
+
+    evmask.deviceid = XIAllMasterDevices;
+    evmask.mask_len = sizeof(mask);
+    evmask.mask = mask;
+    XISelectEvents(dpy, DefaultRootWindow(dpy), &evmask, 1);
+
+    haveXI2 = true;
+  } else {
+#endif
+    vlog.info("XInput 2.1 extension not present");
+    vlog.info("Will have to query the pointer position on every poll");
+#ifdef HAVE_XI2
+  }
+#endif
+
 #ifdef HAVE_XRANDR
   int xrandrErrorBase;
 
@@ -192,24 +245,52 @@ XDesktop::XDesktop(Display* dpy_, Geometry *geometry_)
 XDesktop::~XDesktop() {
   if (running)
     stop();
+
+#ifdef HAVE_XFIXES
+  std::map<unsigned long, rfb::Cursor*>::iterator iter;
+  for (iter = cursorCache.begin(); iter != cursorCache.end(); ++iter)
+    delete iter->second;
+#endif
 }
 
 
 void XDesktop::poll() {
-  if (pb and not haveDamage)
-    pb->poll(server);
+#ifdef HAVE_XDAMAGE
+  // Damage is held back if other events arrived after it
+  if (running && haveDamage && !damageCoalescer->isEmpty())
+    flushDamage();
+#endif
   if (running) {
-    Window root, child;
-    int x, y, wx, wy;
-    unsigned int mask;
-    XQueryPointer(dpy, DefaultRootWindow(dpy), &root, &child,
-                  &x, &y, &wx, &wy, &mask);
-    x -= geometry->offsetLeft();
-    y -= geometry->offsetTop();
-    server->setCursorPos(rfb::Point(x, y));
+#ifdef HAVE_XI2
+    // The position normally comes with the motion events
+    if (haveXI2 && !pointerMoved)
+      return;
+#endif
+    queryPointer();
   }
 }
 
+void XDesktop::pollScreen() {
+  if (pb and not haveDamage)
+    pb->poll(server);
+}
+
+void XDesktop::queryPointer() {
+  Window root, child;
+  int x, y, wx, wy;
+  unsigned int mask;
+
+#ifdef HAVE_XI2
+  pointerMoved = false;
+#endif
+
+  XQueryPointer(dpy, DefaultRootWindow(dpy), &root, &child,
+                &x, &y, &wx, &wy, &mask);
+  x -= geometry->offsetLeft();
+  y -= geometry->offsetTop();
+  server->setCursorPos(rfb::Point(x, y));
+}
+
 
 void XDesktop::start(VNCServer* vs) {
 
@@ -232,8 +313,11 @@ void XDesktop::start(VNCServer* vs) {
 
 #ifdef HAVE_XDAMAGE
   if (haveDamage) {
-    damage = XDamageCreate(dpy, DefaultRootWindow(dpy),
-                           XDamageReportRawRectangles);
+    damageLevel = XDamageReportRawRectangles;
+    damage = XDamageCreate(dpy, DefaultRootWindow(dpy), damageLevel);
+    damageCoalescer = new DamageCoalescer(pb->width(), pb->height());
+    damageEvents = 0;
+    gettimeofday(&damageRateStart, NULL);
   }
 #endif
 
@@ -241,6 +325,11 @@ void XDesktop::start(VNCServer* vs) {
   setCursor();
 #endif
 
+#ifdef HAVE_XI2
+  // Events only tell us about changes, so we need a starting point
+  pointerMoved = true;
+#endif
+
   server->setLEDState(ledState);
 
   running = true;
@@ -250,8 +339,11 @@ void XDesktop::stop() {
   running = false;
 
 #ifdef HAVE_XDAMAGE
-  if (haveDamage)
+  if (haveDamage) {
     XDamageDestroy(dpy, damage);
+    delete damageCoalescer;
+    damageCoalescer = 0;
+  }
 #endif
 
   server->setPixelBuffer(0);
@@ -261,6 +353,61 @@ void XDesktop::stop() {
   pb = 0;
 }
 
+#ifdef HAVE_XDAMAGE
+void XDesktop::flushDamage() {
+  rfb::Region changed;
+
+  damageCoalescer->flush(&changed);
+  if (!changed.is_empty())
+    server->add_changed(changed);
+
+  // The bounding box is only reported again once it grows, so start
+  // over with an empty one
+  if (damageLevel == XDamageReportBoundingBox)
+    XDamageSubtract(dpy, damage, None, None);
+
+  updateDamageLevel();
+}
+
+void XDesktop::updateDamageLevel() {
+  unsigned elapsed;
+
+  if (damageLevel == XDamageReportRawRectangles) {
+    elapsed = msSince(&damageRateStart);
+    if (damageEvents > damageRateLimit) {
+      if (elapsed < 1000) {
+        vlog.debug("%u damage events in %u ms, only tracking bounding box",
+                   damageEvents, elapsed);
+        setDamageLevel(XDamageReportBoundingBox);
+      }
+    } else if (elapsed < 1000)
+      return;
+  } else {
+    // There is no way of telling how many events we would have gotten,
+    // so just try again after a while
+    if (msSince(&damageLevelChange) < damageBoundingBoxTime)
+      return;
+    vlog.debug("Tracking all damage again");
+    setDamageLevel(XDamageReportRawRectangles);
+  }
+
+  damageEvents = 0;
+  gettimeofday(&damageRateStart, NULL);
+}
+
+void XDesktop::setDamageLevel(int level) {
+  Damage newDamage;
+
+  // Create the new object first so that nothing is missed in between
+  newDamage = XDamageCreate(dpy, DefaultRootWindow(dpy), level);
+  XDamageDestroy(dpy, damage);
+
+  damage = newDamage;
+  damageLevel = level;
+  gettimeofday(&damageLevelChange, NULL);
+}
+#endif
+
 bool XDesktop::isRunning() {
   return running;
 }
@@ -610,8 +757,16 @@ bool XDesktop::handleGlobalEvent(XEvent* ev) {
       return true;
 
     dev = (XDamageNotifyEvent*)ev;
-    rect.setXYWH(dev->area.x, dev->area.y, dev->area.width, dev->area.height);
-    server->add_changed(rect);
+    rect.setXYWH(dev->area.x - geometry->offsetLeft(),
+                 dev->area.y - geometry->offsetTop(),
+                 dev->area.width, dev->area.height);
+    damageCoalescer->add(rect);
+    damageEvents++;
+
+    // Only pass on the damage once we've gone through everything
+    // that has already arrived
+    if (XEventsQueued(dpy, QueuedAlready) == 0)
+      flushDamage();
 
     return true;
 #endif
@@ -627,8 +782,47 @@ bool XDesktop::handleGlobalEvent(XEvent* ev) {
     if (cev->subtype != XFixesDisplayCursorNotify)
       return false;
 
+    if (setCachedCursor(cev->cursor_serial))
+      return true;
+
     return setCursor();
 #endif
+#ifdef HAVE_XI2
+  } else if ((ev->type == GenericEvent) &&
+             (ev->xcookie.extension == xiOpcode)) {
+    XIDeviceEvent* dev;
+    int x, y;
+
+    if (ev->xcookie.evtype == XI_RawMotion) {
+      // Normal motion events stop at the first window that wants them,
+      // and go only to the grabbing client during grabs, but raw events
+      // always reach us. They carry no position though, so look at the
+      // pointer on the next poll unless a normal event shows up first.
+      pointerMoved = true;
+      return true;
+    }
+
+    if (ev->xcookie.evtype != XI_Motion)
+      return false;
+
+    if (!running)
+      return true;
+
+    if (!XGetEventData(dpy, &ev->xcookie))
+      return true;
+
+    dev = (XIDeviceEvent*)ev->xcookie.data;
+    x = (int)dev->root_x - geometry->offsetLeft();
+    y = (int)dev->root_y - geometry->offsetTop();
+
+    XFreeEventData(dpy, &ev->xcookie);
+
+    // This also covers warps, which give no raw events
+    pointerMoved = false;
+    server->setCursorPos(rfb::Point(x, y));
+
+    return true;
+#endif
 #ifdef HAVE_XRANDR
   } else if (ev->type == Expose) {
     XExposeEvent* eev = (XExposeEvent*)ev;
@@ -657,6 +851,14 @@ bool XDesktop::handleGlobalEvent(XEvent* ev) {
       pb = new XPixelBuffer(dpy, factory, geometry->getRect());
       server->setPixelBuffer(pb, computeScreenLayout());
 
+#ifdef HAVE_XDAMAGE
+      // Pending damage is covered by the full update below
+      if (haveDamage) {
+        delete damageCoalescer;
+        damageCoalescer = new DamageCoalescer(pb->width(), pb->height());
+      }
+#endif
+
       // Mark entire screen as changed
       server->add_changed(rfb::Region(Rect(0, 0, cev->width, cev->height)));
     }
@@ -727,7 +929,47 @@ bool XDesktop::setCursor()
     vlog.error("XserverDesktop::setCursor: %s",e.str());
   }
 
+  // Keep the converted image in case the cursor comes back
+  if (cursorCache.count(cim->cursor_serial) == 0) {
+    if (cursorCache.size() >= maxCachedCursors) {
+      delete cursorCache[cursorCacheOrder.front()];
+      cursorCache.erase(cursorCacheOrder.front());
+      cursorCacheOrder.pop_front();
+    }
+
+    cursorCache[cim->cursor_serial] =
+      new rfb::Cursor(cim->width, cim->height,
+                      Point(cim->xhot, cim->yhot), cursorData);
+    cursorCacheOrder.push_back(cim->cursor_serial);
+  }
+
   delete [] cursorData;
   XFree(cim);
   return true;
 }
+
+bool XDesktop::setCachedCursor(unsigned long serial)
+{
+  std::map<unsigned long, rfb::Cursor*>::const_iterator iter;
+  const rfb::Cursor* cursor;
+
+  iter = cursorCache.find(serial);
+  if (iter == cursorCache.end())
+    return false;
+
+  cursor = iter->second;
+
+  // Keep the cursors that are in use, and evict the one that has gone
+  // unused for the longest time
+  cursorCacheOrder.remove(serial);
+  cursorCacheOrder.push_back(serial);
+
+  try {
+    server->setCursor(cursor->width(), cursor->height(),
+                      cursor->hotspot(), cursor->getBuffer());
+  } catch (rdr::Exception& e) {
+    vlog.error("XserverDesktop::setCursor: %s",e.str());
+  }
+
+  return true;
+}
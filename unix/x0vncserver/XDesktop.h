@@ -21,6 +21,11 @@
 #ifndef __XDESKTOP_H__
 #define __XDESKTOP_H__
 
+#include <sys/time.h>
+
+#include <list>
+#include <map>
+
 #include <rfb/VNCServerST.h>
 #include <tx/TXWindow.h>
 #include <unixcommon.h>
@@ -32,6 +37,7 @@
 
 class Geometry;
 class XPixelBuffer;
+class DamageCoalescer;
 
 // number of XKb indicator leds to handle
 #define XDESKTOP_N_LEDS 3
@@ -41,7 +47,10 @@ class XDesktop : public rfb::SDesktop, public TXGlobalEventHandler
 public:
   XDesktop(Display* dpy_, Geometry *geometry);
   virtual ~XDesktop();
+  // Deal with damage and pointer movement that has been seen
   void poll();
+  // Look for changes on the screen when there is no DAMAGE extension
+  void pollScreen();
   // -=- SDesktop interface
   virtual void start(rfb::VNCServer* vs);
   virtual void stop();
@@ -69,11 +78,30 @@ protected:
   bool running;
 #ifdef HAVE_XDAMAGE
   Damage damage;
+  int damageLevel;
   int xdamageEventBase;
+  DamageCoalescer* damageCoalescer;
+  unsigned damageEvents;
+  struct timeval damageRateStart;
+  struct timeval damageLevelChange;
+  void flushDamage();
+  void updateDamageLevel();
+  void setDamageLevel(int level);
 #endif
   int xkbEventBase;
 #ifdef HAVE_XFIXES
   int xfixesEventBase;
+  // Converted cursor images, by XFixes cursor serial
+  std::map<unsigned long, rfb::Cursor*> cursorCache;
+  // Least recently used first
+  std::list<unsigned long> cursorCacheOrder;
+  bool setCachedCursor(unsigned long serial);
+#endif
+#ifdef HAVE_XI2
+  int xiOpcode;
+  bool haveXI2;
+  // Moved without an event telling us where to
+  bool pointerMoved;
 #endif
 #ifdef HAVE_XRANDR
   int xrandrEventBase;
@@ -85,6 +113,7 @@ protected:
   const unsigned short *codeMap;
   unsigned codeMapLen;
   bool setCursor();
+  void queryPointer();
   rfb::ScreenSet computeScreenLayout();
 };
 
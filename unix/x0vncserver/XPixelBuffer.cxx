@@ -21,6 +21,8 @@
 // XPixelBuffer.cxx
 //
 
+#include <sys/time.h>
+
 #include <vector>
 #include <rfb/Region.h>
 #include <X11/Xlib.h>
@@ -35,7 +37,11 @@ XPixelBuffer::XPixelBuffer(Display *dpy, ImageFactory &factory,
     m_dpy(dpy),
     m_image(factory.newImage(dpy, rect.width(), rect.height())),
     m_offsetLeft(rect.tl.x),
-    m_offsetTop(rect.tl.y)
+    m_offsetTop(rect.tl.y),
+    m_callCost(100.0),
+    m_pixelCost(0.005),
+    m_samples(0), m_sumPixels(0), m_sumTime(0),
+    m_sumPixels2(0), m_sumPixelsTime(0)
 {
   // Fill in the PixelFormat structure of the parent class.
   format = PixelFormat(m_image->xim->bits_per_pixel,
@@ -75,11 +81,63 @@ XPixelBuffer::~XPixelBuffer()
 void
 XPixelBuffer::grabRegion(const rfb::Region& region)
 {
-  std::vector<Rect> rects;
+  std::vector<Rect> rects, grabs;
   std::vector<Rect>::const_iterator i;
   region.get_rects(&rects);
+
+  // Neighbouring rectangles are grabbed together if fetching the pixels
+  // in between costs less than another call to the X server. With a
+  // region of many small rectangles this ends up grabbing the bounding
+  // box, and with a few large ones far apart they stay separate.
   for (i = rects.begin(); i != rects.end(); i++) {
+    if (!grabs.empty()) {
+      Rect merged = grabs.back().union_boundary(*i);
+      double extra = merged.area() - grabs.back().area() - i->area();
+      if (extra * m_pixelCost < m_callCost) {
+        grabs.back() = merged;
+        continue;
+      }
+    }
+    grabs.push_back(*i);
+  }
+
+  for (i = grabs.begin(); i != grabs.end(); i++) {
+    struct timeval start, end;
+
+    gettimeofday(&start, NULL);
     grabRect(*i);
+    gettimeofday(&end, NULL);
+
+    updateGrabCost(i->area(), (end.tv_sec - start.tv_sec) * 1000000.0 +
+                              (end.tv_usec - start.tv_usec));
   }
 }
 
+void
+XPixelBuffer::updateGrabCost(int pixels, double usec)
+{
+  // Older samples gradually lose their weight
+  const double decay = 0.98;
+
+  double denom;
+
+  m_samples = m_samples * decay + 1;
+  m_sumPixels = m_sumPixels * decay + pixels;
+  m_sumTime = m_sumTime * decay + usec;
+  m_sumPixels2 = m_sumPixels2 * decay + (double)pixels * pixels;
+  m_sumPixelsTime = m_sumPixelsTime * decay + pixels * usec;
+
+  // Without enough variation in size we can only say something about
+  // the fixed cost
+  denom = m_samples * m_sumPixels2 - m_sumPixels * m_sumPixels;
+  if (denom > m_sumPixels2) {
+    double slope = (m_samples * m_sumPixelsTime -
+                    m_sumPixels * m_sumTime) / denom;
+    if (slope > 0)
+      m_pixelCost = slope;
+  }
+
+  m_callCost = (m_sumTime - m_pixelCost * m_sumPixels) / m_samples;
+  if (m_callCost < 0)
+    m_callCost = 0;
+}
@@ -55,6 +55,20 @@ protected:
   int m_offsetLeft;
   int m_offsetTop;
 
+  // Estimated cost of grabbing, in microseconds. Every call has a
+  // fixed cost for the round trip to the X server, and then a cost
+  // for every pixel.
+  double m_callCost;
+  double m_pixelCost;
+
+  // Decaying sums for the least squares fit of the above
+  double m_samples;
+  double m_sumPixels, m_sumTime;
+  double m_sumPixels2, m_sumPixelsTime;
+
+  // Update the estimates with the time it took to grab some pixels.
+  void updateGrabCost(int pixels, double usec);
+
   // Copy pixels from the screen to the pixel buffer,
   // for the specified rectangular area of the buffer.
   inline void grabRect(const rfb::Rect &r) {
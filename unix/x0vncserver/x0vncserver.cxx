@@ -46,6 +46,7 @@
 #include <x0vncserver/Geometry.h>
 #include <x0vncserver/Image.h>
 #include <x0vncserver/PollingScheduler.h>
+#include <x0vncserver/SocketMonitor.h>
 
 extern char buildtime[];
 
@@ -432,40 +433,42 @@ int main(int argc, char** argv)
 
     PollingScheduler sched((int)pollingCycle, (int)maxProcessorUsage);
 
+    // Descriptors are registered once and only the ready ones are
+    // looked at on each pass
+    SocketMonitor monitor;
+    std::map<int, SocketListener*> listenerFds;
+    std::map<int, Socket*> clientFds;
+
+    monitor.add(ConnectionNumber(dpy));
+    for (std::list<SocketListener*>::iterator i = listeners.begin();
+         i != listeners.end();
+         i++) {
+      monitor.add((*i)->getFd());
+      listenerFds[(*i)->getFd()] = *i;
+    }
+
     while (!caughtSignal) {
       int wait_ms;
-      struct timeval tv;
-      fd_set rfds, wfds;
-      std::list<Socket*> sockets;
-      std::list<Socket*>::iterator i;
+      std::map<int, Socket*>::iterator i;
 
       // Process any incoming X events
       TXWindow::handleXEvents(dpy);
 
-      FD_ZERO(&rfds);
-      FD_ZERO(&wfds);
-
-      FD_SET(ConnectionNumber(dpy), &rfds);
-      for (std::list<SocketListener*>::iterator i = listeners.begin();
-           i != listeners.end();
-           i++)
-        FD_SET((*i)->getFd(), &rfds);
-
-      server.getSockets(&sockets);
-      int clients_connected = 0;
-      for (i = sockets.begin(); i != sockets.end(); i++) {
-        if ((*i)->isShutdown()) {
-          server.removeSocket(*i);
-          delete (*i);
+      for (i = clientFds.begin(); i != clientFds.end();) {
+        Socket* sock = i->second;
+        if (sock->isShutdown()) {
+          monitor.remove(i->first);
+          server.removeSocket(sock);
+          delete sock;
+          clientFds.erase(i++);
         } else {
-          FD_SET((*i)->getFd(), &rfds);
-          if ((*i)->outStream().bufferUsage() > 0)
-            FD_SET((*i)->getFd(), &wfds);
-          clients_connected++;
+          monitor.setWantWrite(i->first,
+                               sock->outStream().bufferUsage() > 0);
+          i++;
         }
       }
 
-      if (!clients_connected)
+      if (clientFds.empty())
         sched.reset();
 
       wait_ms = 0;
@@ -479,59 +482,54 @@ int main(int argc, char** argv)
 
       soonestTimeout(&wait_ms, server.checkTimeouts());
 
-      tv.tv_sec = wait_ms / 1000;
-      tv.tv_usec = (wait_ms % 1000) * 1000;
-
       // Do the wait...
       sched.sleepStarted();
-      int n = select(FD_SETSIZE, &rfds, &wfds, 0,
-                     wait_ms ? &tv : NULL);
+      int n = monitor.wait(wait_ms ? wait_ms : -1);
       sched.sleepFinished();
 
       if (n < 0) {
-        if (errno == EINTR) {
-          vlog.debug("Interrupted select() system call");
-          continue;
-        } else {
-          throw rdr::SystemException("select", errno);
-        }
+        vlog.debug("Interrupted wait for events");
+        continue;
       }
 
-      // Accept new VNC connections
-      for (std::list<SocketListener*>::iterator i = listeners.begin();
-           i != listeners.end();
-           i++) {
-        if (FD_ISSET((*i)->getFd(), &rfds)) {
-          Socket* sock = (*i)->accept();
+      for (int j = 0; j < n; j++) {
+        int fd = monitor.getFd(j);
+        std::map<int, SocketListener*>::iterator listener;
+
+        // Accept new VNC connections
+        listener = listenerFds.find(fd);
+        if (listener != listenerFds.end()) {
+          Socket* sock = listener->second->accept();
           if (sock) {
             sock->outStream().setBlocking(false);
             server.addSocket(sock);
+            monitor.add(sock->getFd());
+            clientFds[sock->getFd()] = sock;
           } else {
             vlog.status("Client connection rejected");
           }
+          continue;
         }
-      }
-
-      server.checkTimeouts();
-
-      // Client list could have been changed.
-      server.getSockets(&sockets);
 
-      // Nothing more to do if there are no client connections.
-      if (sockets.empty())
-        continue;
+        // Process events on existing VNC connections
+        i = clientFds.find(fd);
+        if (i == clientFds.end())
+          continue;
 
-      // Process events on existing VNC connections
-      for (i = sockets.begin(); i != sockets.end(); i++) {
-        if (FD_ISSET((*i)->getFd(), &rfds))
-          server.processSocketReadEvent(*i);
-        if (FD_ISSET((*i)->getFd(), &wfds))
-          server.processSocketWriteEvent(*i);
+        if (monitor.isReadable(j))
+          server.processSocketReadEvent(i->second);
+        if (monitor.isWritable(j))
+          server.processSocketWriteEvent(i->second);
       }
 
+      server.checkTimeouts();
+
       if (desktop.isRunning() && sched.goodTimeToPoll()) {
         sched.newPass();
         desktop.poll();
+        // Don't bother looking for changes until someone wants them
+        if (server.updatesRequested())
+          desktop.pollScreen();
       }
     }
 
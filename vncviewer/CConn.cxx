@@ -23,11 +23,15 @@
 #endif
 
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
 #ifndef _WIN32
 #include <unistd.h>
 #endif
 
 #include <rfb/CMsgWriter.h>
+#include <rfb/Decoder.h>
 #include <rfb/CSecurity.h>
 #include <rfb/Hostname.h>
 #include <rfb/LogWriter.h>
@@ -80,7 +84,8 @@ CConn::CConn(const char* vncServerName, network::Socket* socket=NULL)
     currentEncoding(encodingTight), lastServerEncoding((unsigned int)-1),
     formatChange(false), encodingChange(false),
     firstUpdate(true), pendingUpdate(false), continuousUpdates(false),
-    forceNonincremental(true), supportsSyncFence(false)
+    forceNonincremental(true), supportsSyncFence(false),
+    latencyProbes(false), pendingProbe(false), probeId(0)
 {
   setShared(::shared);
   sock = socket;
@@ -90,6 +95,7 @@ CConn::CConn(const char* vncServerName, network::Socket* socket=NULL)
     currentEncoding = encNum;
 
   cp.supportsLocalCursor = true;
+  cp.supportsCursorCache = true;
 
   cp.supportsDesktopResize = true;
   cp.supportsExtendedDesktopSize = true;
@@ -97,6 +103,12 @@ CConn::CConn(const char* vncServerName, network::Socket* socket=NULL)
 
   cp.supportsLEDState = true;
 
+  cp.supportsTileCache = tileCache;
+
+  gettimeofday(&probeSent, NULL);
+  if (strlen(latencyLog) > 0)
+    enableLatencyProbes();
+
   if (customCompressLevel)
     cp.compressLevel = compressLevel;
   else
@@ -131,6 +143,14 @@ CConn::CConn(const char* vncServerName, network::Socket* socket=NULL)
     }
   }
 
+#ifndef WIN32
+  // Shared memory only makes sense if the server is on this host, which
+  // can only be the case for a direct Unix socket connection
+  if (sharedMemory && (strlen(via) == 0) &&
+      (dynamic_cast<network::UnixSocket*>(sock) != NULL))
+    cp.supportsSharedMemory = true;
+#endif
+
   Fl::add_fd(sock->getFd(), FL_READ | FL_EXCEPT, socketEvent, this);
 
   // See callback below
@@ -149,6 +169,8 @@ CConn::~CConn()
   OptionsDialog::removeCallback(handleOptions);
   Fl::remove_timeout(handleUpdateTimeout, this);
 
+  writeLatencyLog();
+
   if (desktop)
     delete desktop;
 
@@ -253,6 +275,36 @@ unsigned CConn::getPosition()
   return sock->inStream().pos();
 }
 
+void CConn::enableLatencyProbes()
+{
+  if (latencyProbes)
+    return;
+
+  vlog.debug("Measuring latency of pointer events");
+  latencyProbes = true;
+}
+
+void CConn::sendLatencyProbe()
+{
+  LatencyProbe probe;
+  char data[LatencyProbe::payloadSize];
+
+  if (!latencyProbes || !cp.supportsFence)
+    return;
+
+  // One at a time, and not so often that it disturbs anything
+  if (pendingProbe || (msSince(&probeSent) < 100))
+    return;
+
+  probe.id = ++probeId;
+  probe.write(data);
+
+  writer()->writeFence(fenceFlagRequest, sizeof(data), data);
+
+  pendingProbe = true;
+  gettimeofday(&probeSent, NULL);
+}
+
 // The RFB core is not properly asynchronous, so it calls this callback
 // whenever it needs to block to wait for more data. Since FLTK is
 // monitoring the socket, we just make sure FLTK gets to run.
@@ -378,6 +430,8 @@ void CConn::framebufferUpdateStart()
 {
   CConnection::framebufferUpdateStart();
 
+  gettimeofday(&updateStart, NULL);
+
   // Note: This might not be true if sync fences are supported
   pendingUpdate = false;
 
@@ -395,11 +449,16 @@ void CConn::framebufferUpdateEnd()
 {
   CConnection::framebufferUpdateEnd();
 
+  gettimeofday(&updateDecoded, NULL);
+
   updateCount++;
 
   Fl::remove_timeout(handleUpdateTimeout, this);
   desktop->updateWindow();
 
+  // The changes have now been handed to the window system
+  gettimeofday(&updatePresented, NULL);
+
   if (firstUpdate) {
     // We need fences to make extra update requests and continuous
     // updates "safe". See fence() for the next step.
@@ -470,7 +529,12 @@ void CConn::fence(rdr::U32 flags, unsigned len, const char data[])
     return;
   }
 
-  if (len == 0) {
+  if (LatencyProbe::isProbe(len, data)) {
+    LatencyProbe probe;
+
+    probe.read(data);
+    handleLatencyProbe(probe);
+  } else if (len == 0) {
     // Initial probe
     if (flags & fenceFlagSyncNext) {
       supportsSyncFence = true;
@@ -502,6 +566,77 @@ void CConn::setLEDState(unsigned int state)
 
 ////////////////////// Internal methods //////////////////////
 
+// handleLatencyProbe() is called when the server responds to a probe.
+// A server that measured it sends the response right after the update
+// with the results of the pointer event, so that is the update that was
+// just decoded and presented.
+void CConn::handleLatencyProbe(const LatencyProbe& probe)
+{
+  unsigned times[latencyStageCount];
+  unsigned serverTotal, untilUpdate;
+
+  if (!pendingProbe || (probe.id != probeId))
+    return;
+
+  pendingProbe = false;
+
+  if (!probe.measured)
+    return;
+
+  if (isBefore(&updateStart, &probeSent))
+    return;
+
+  serverTotal = 0;
+  for (int i = 0; i < latencyServerStages; i++) {
+    times[i] = probe.serverTime[i];
+    serverTotal += times[i];
+  }
+
+  // Whatever the server cannot account for was spent in transit
+  untilUpdate = usBetween(&probeSent, &updateStart);
+  if (untilUpdate > serverTotal)
+    times[latencyStageNetwork] = untilUpdate - serverTotal;
+  else
+    times[latencyStageNetwork] = 0;
+
+  times[latencyStageDecode] = usBetween(&updateStart, &updateDecoded);
+  times[latencyStagePresent] = usBetween(&updateDecoded, &updatePresented);
+  times[latencyStageTotal] = usBetween(&probeSent, &updatePresented);
+
+  latency.add(times);
+}
+
+void CConn::writeLatencyLog()
+{
+  FILE* f;
+
+  if (latency.getCount() == 0)
+    return;
+
+  vlog.info(_("Latency measured for %u pointer events:"),
+            latency.getCount());
+  for (int stage = 0; stage < latencyStageCount; stage++) {
+    vlog.info(_("  %s: %g ms median, %g ms 95th percentile"),
+              latencyStageName(stage),
+              latency.percentile(stage, 50) / 1000.0,
+              latency.percentile(stage, 95) / 1000.0);
+  }
+
+  if (strlen(latencyLog) == 0)
+    return;
+
+  f = fopen(latencyLog, "w");
+  if (f == NULL) {
+    vlog.error(_("Could not open \"%s\": %s"),
+               (const char*)latencyLog, strerror(errno));
+    return;
+  }
+
+  latency.write(f);
+
+  fclose(f);
+}
+
 void CConn::resizeFramebuffer()
 {
   if (!desktop)
@@ -534,10 +669,15 @@ void CConn::autoSelectFormatAndEncoding()
   unsigned int timeWaited = sock->inStream().timeWaited();
   bool newFullColour = fullColour;
   int newQualityLevel = qualityLevel;
+  int newEncoding;
+
+  // Always use Tight, with Zstandard if we have it
+  newEncoding = encodingTight;
+  if (Decoder::supported(encodingTightZstd))
+    newEncoding = encodingTightZstd;
 
-  // Always use Tight
-  if (currentEncoding != encodingTight) {
-    currentEncoding = encodingTight;
+  if (currentEncoding != newEncoding) {
+    currentEncoding = newEncoding;
     encodingChange = true;
   }
 
@@ -20,9 +20,12 @@
 #ifndef __CCONN_H__
 #define __CCONN_H__
 
+#include <sys/time.h>
+
 #include <FL/Fl.H>
 
 #include <rfb/CConnection.h>
+#include <rfb/LatencyProbe.h>
 #include <rdr/FdInStream.h>
 
 namespace network { class Socket; }
@@ -44,6 +47,13 @@ public:
   unsigned getPixelCount();
   unsigned getPosition();
 
+  // Latency measurements start when either the statistics overlay or
+  // LatencyLog asks for them. sendLatencyProbe() should be called
+  // right after every pointer event.
+  void enableLatencyProbes();
+  void sendLatencyProbe();
+  const rfb::LatencyHistogram& getLatency() { return latency; }
+
   // FdInStreamBlockCallback methods
   void blockCallback();
 
@@ -84,6 +94,9 @@ private:
   void checkEncodings();
   void requestNewUpdate();
 
+  void handleLatencyProbe(const rfb::LatencyProbe& probe);
+  void writeLatencyLog();
+
   static void handleOptions(void *data);
 
   static void handleUpdateTimeout(void *data);
@@ -116,6 +129,13 @@ private:
   bool forceNonincremental;
 
   bool supportsSyncFence;
+
+  bool latencyProbes;
+  bool pendingProbe;
+  rdr::U32 probeId;
+  struct timeval probeSent;
+  struct timeval updateStart, updateDecoded, updatePresented;
+  rfb::LatencyHistogram latency;
 };
 
 #endif
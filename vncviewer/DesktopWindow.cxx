@@ -181,6 +181,7 @@ DesktopWindow::DesktopWindow(int w, int h, const char *name,
   if (vlog.getLevel() >= LogWriter::LEVEL_DEBUG) {
     memset(&stats, 0, sizeof(stats));
     Fl::add_timeout(0, handleStatsTimeout, this);
+    cc->enableLatencyProbes();
   }
 
   // Show hint about menu key
@@ -1345,9 +1346,13 @@ void DesktopWindow::handleStatsTimeout(void *data)
   unsigned elapsed;
 
   const unsigned statsWidth = 200;
-  const unsigned statsHeight = 100;
+  const unsigned throughputHeight = 100;
   const unsigned graphWidth = statsWidth - 10;
-  const unsigned graphHeight = statsHeight - 25;
+  const unsigned graphHeight = throughputHeight - 25;
+
+  const rfb::LatencyHistogram& latency = self->cc->getLatency();
+  const unsigned latencyRow = 11;
+  unsigned statsHeight;
 
   Fl_Image_Surface *surface;
   Fl_RGB_Image *image;
@@ -1381,6 +1386,11 @@ void DesktopWindow::handleStatsTimeout(void *data)
     fl_gc = XDefaultGC(fl_display, 0);
 #endif
 
+  // Latency histograms are added below the graph once there are any
+  statsHeight = throughputHeight;
+  if (latency.getCount() > 0)
+    statsHeight += latencyRow * (rfb::latencyStageCount + 1);
+
   surface = new Fl_Image_Surface(statsWidth, statsHeight);
   surface->set_current();
 
@@ -1432,17 +1442,69 @@ void DesktopWindow::handleStatsTimeout(void *data)
 
   fl_color(FL_GREEN);
   snprintf(buffer, sizeof(buffer), "%u upd/s", self->stats[statsCount-1].ups);
-  fl_draw(buffer, 5, statsHeight - 5);
+  fl_draw(buffer, 5, throughputHeight - 5);
 
   fl_color(FL_YELLOW);
   siPrefix(self->stats[statsCount-1].pps, "pix/s",
            buffer, sizeof(buffer), 3);
-  fl_draw(buffer, 5 + (statsWidth-10)/3, statsHeight - 5);
+  fl_draw(buffer, 5 + (statsWidth-10)/3, throughputHeight - 5);
 
   fl_color(FL_RED);
   siPrefix(self->stats[statsCount-1].bps * 8, "bps",
            buffer, sizeof(buffer), 3);
-  fl_draw(buffer, 5 + (statsWidth-10)*2/3, statsHeight - 5);
+  fl_draw(buffer, 5 + (statsWidth-10)*2/3, throughputHeight - 5);
+
+  if (latency.getCount() > 0) {
+    const int bucketCount = rfb::LatencyHistogram::bucketCount;
+    const int histX = 50;
+    const int histBar = 3;
+    unsigned y;
+
+    y = throughputHeight + latencyRow;
+
+    fl_color(FL_WHITE);
+    snprintf(buffer, sizeof(buffer), "Latency, %u events (median/95%%)",
+             latency.getCount());
+    fl_draw(buffer, 5, y - 2);
+
+    for (int stage = 0; stage < rfb::latencyStageCount; stage++) {
+      unsigned maxCount;
+
+      y += latencyRow;
+
+      fl_color(FL_WHITE);
+      fl_draw(rfb::latencyStageName(stage), 5, y - 2);
+
+      // A small histogram with one bar per bucket
+      maxCount = 0;
+      for (int bucket = 0; bucket < bucketCount; bucket++) {
+        if (latency.bucketSamples(stage, bucket) > maxCount)
+          maxCount = latency.bucketSamples(stage, bucket);
+      }
+
+      if (stage == rfb::latencyStageTotal)
+        fl_color(FL_RED);
+      else if (stage < rfb::latencyServerStages)
+        fl_color(FL_CYAN);
+      else
+        fl_color(FL_GREEN);
+      for (int bucket = 0; bucket < bucketCount; bucket++) {
+        unsigned h;
+
+        h = (latencyRow - 2) * latency.bucketSamples(stage, bucket) / maxCount;
+        if (h == 0)
+          continue;
+
+        fl_rectf(histX + bucket * histBar, y - 1 - h, histBar - 1, h);
+      }
+
+      fl_color(FL_WHITE);
+      snprintf(buffer, sizeof(buffer), "%g/%g ms",
+               latency.percentile(stage, 50) / 1000.0,
+               latency.percentile(stage, 95) / 1000.0);
+      fl_draw(buffer, histX + bucketCount * histBar + 5, y - 2);
+    }
+  }
 
   image = surface->image();
   delete surface;
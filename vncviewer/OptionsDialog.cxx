@@ -26,6 +26,7 @@
 
 #include <rdr/types.h>
 #include <rfb/encodings.h>
+#include <rfb/Decoder.h>
 
 #ifdef HAVE_GNUTLS
 #include <rfb/Security.h>
@@ -143,6 +144,9 @@ void OptionsDialog::loadOptions(void)
   int encNum = encodingNum(preferredEncoding);
 
   switch (encNum) {
+  case encodingTightZstd:
+    tightZstdButton->setonly();
+    break;
   case encodingTight:
     tightButton->setonly();
     break;
@@ -311,7 +315,9 @@ void OptionsDialog::storeOptions(void)
   /* Compression */
   autoSelect.setParam(autoselectCheckbox->value());
 
-  if (tightButton->value())
+  if (tightZstdButton->value())
+    preferredEncoding.setParam(encodingName(encodingTightZstd));
+  else if (tightButton->value())
     preferredEncoding.setParam(encodingName(encodingTight));
   else if (zrleButton->value())
     preferredEncoding.setParam(encodingName(encodingZRLE));
@@ -446,7 +452,7 @@ void OptionsDialog::createCompressionPage(int tx, int ty, int tw, int th)
 
   /* VNC encoding box */
   ty += GROUP_LABEL_OFFSET;
-  height = GROUP_MARGIN * 2 + TIGHT_MARGIN * 3 + RADIO_HEIGHT * 4;
+  height = GROUP_MARGIN * 2 + TIGHT_MARGIN * 4 + RADIO_HEIGHT * 5;
   encodingGroup = new Fl_Group(tx, ty, half_width, height,
                                 _("Preferred encoding"));
   encodingGroup->box(FL_ENGRAVED_BOX);
@@ -456,6 +462,15 @@ void OptionsDialog::createCompressionPage(int tx, int ty, int tw, int th)
     tx += GROUP_MARGIN;
     ty += GROUP_MARGIN;
 
+    tightZstdButton = new Fl_Round_Button(LBLRIGHT(tx, ty,
+                                                   RADIO_MIN_WIDTH,
+                                                   RADIO_HEIGHT,
+                                                   "TightZstd"));
+    tightZstdButton->type(FL_RADIO_BUTTON);
+    if (!Decoder::supported(encodingTightZstd))
+      tightZstdButton->deactivate();
+    ty += RADIO_HEIGHT + TIGHT_MARGIN;
+
     tightButton = new Fl_Round_Button(LBLRIGHT(tx, ty,
                                                RADIO_MIN_WIDTH,
                                                RADIO_HEIGHT,
@@ -537,9 +552,9 @@ void OptionsDialog::createCompressionPage(int tx, int ty, int tw, int th)
 
   colorlevelGroup->end();
 
-  /* Back to normal */
+  /* Back to normal, below the taller of the two boxes */
   tx = orig_tx;
-  ty += INNER_MARGIN;
+  ty = encodingGroup->y() + encodingGroup->h() + INNER_MARGIN;
 
   /* Checkboxes */
   compressionCheckbox = new Fl_Check_Button(LBLRIGHT(tx, ty,
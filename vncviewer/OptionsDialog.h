@@ -76,6 +76,7 @@ protected:
   Fl_Check_Button *autoselectCheckbox;
 
   Fl_Group *encodingGroup;
+  Fl_Round_Button *tightZstdButton;
   Fl_Round_Button *tightButton;
   Fl_Round_Button *zrleButton;
   Fl_Round_Button *hextileButton;
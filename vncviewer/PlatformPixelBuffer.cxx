@@ -17,6 +17,9 @@
  */
 
 #include <assert.h>
+#include <string.h>
+
+#include <vector>
 
 #if !defined(WIN32) && !defined(__APPLE__)
 #include <sys/ipc.h>
@@ -33,6 +36,12 @@
 
 static rfb::LogWriter vlog("PlatformPixelBuffer");
 
+#if !defined(WIN32) && !defined(__APPLE__)
+// Buffers using shared memory. There can briefly be more than one when
+// the framebuffer is resized.
+static std::list<PlatformPixelBuffer*> shmBuffers;
+#endif
+
 PlatformPixelBuffer::PlatformPixelBuffer(int width, int height) :
   FullFramePixelBuffer(rfb::PixelFormat(32, 24,
 #if !defined(WIN32) && !defined(__APPLE__)
@@ -44,19 +53,37 @@ PlatformPixelBuffer::PlatformPixelBuffer(int width, int height) :
                        width, height, 0, stride),
   Surface(width, height)
 #if !defined(WIN32) && !defined(__APPLE__)
-  , shminfo(NULL), xim(NULL)
+  , xim(NULL), haveShm(false), nextShmImage(0), shmEventBase(0)
 #endif
 {
 #if !defined(WIN32) && !defined(__APPLE__)
-  if (!setupShm()) {
-    xim = XCreateImage(fl_display, CopyFromParent, 32,
-                       ZPixmap, 0, 0, width, height, 32, 0);
-    if (!xim)
-      throw rdr::Exception("XCreateImage");
+  xim = XCreateImage(fl_display, CopyFromParent, 32,
+                     ZPixmap, 0, 0, width, height, 32, 0);
+  if (!xim)
+    throw rdr::Exception("XCreateImage");
+
+  xim->data = (char*)malloc(xim->bytes_per_line * xim->height);
+  if (!xim->data)
+    throw rdr::Exception("malloc");
 
-    xim->data = (char*)malloc(xim->bytes_per_line * xim->height);
-    if (!xim->data)
-      throw rdr::Exception("malloc");
+  for (int i = 0; i < 2; i++) {
+    shmImages[i].shminfo = NULL;
+    shmImages[i].xim = NULL;
+    shmImages[i].serial = 0;
+  }
+
+  if (setupShm(&shmImages[0]) && setupShm(&shmImages[1])) {
+    haveShm = true;
+
+    shmEventBase = XShmGetEventBase(fl_display);
+    if (shmBuffers.empty())
+      Fl::add_system_handler(handleSystemEvent, NULL);
+    shmBuffers.push_back(this);
+
+    vlog.debug("Using shared memory XImages");
+  } else {
+    freeShm(&shmImages[0]);
+    freeShm(&shmImages[1]);
 
     vlog.debug("Using standard XImage");
   }
@@ -72,13 +99,17 @@ PlatformPixelBuffer::PlatformPixelBuffer(int width, int height) :
 PlatformPixelBuffer::~PlatformPixelBuffer()
 {
 #if !defined(WIN32) && !defined(__APPLE__)
-  if (shminfo) {
-    vlog.debug("Freeing shared memory XImage");
-    XShmDetach(fl_display, shminfo);
-    shmdt(shminfo->shmaddr);
-    shmctl(shminfo->shmid, IPC_RMID, 0);
-    delete shminfo;
-    shminfo = NULL;
+  if (haveShm) {
+    shmBuffers.remove(this);
+    if (shmBuffers.empty())
+      Fl::remove_system_handler(handleSystemEvent);
+
+    // The X server might still be reading from the segments
+    if (isBusy(&shmImages[0]) || isBusy(&shmImages[1]))
+      XSync(fl_display, False);
+
+    freeShm(&shmImages[0]);
+    freeShm(&shmImages[1]);
   }
 
   // XDestroyImage() will free(xim->data) if appropriate
@@ -96,37 +127,127 @@ void PlatformPixelBuffer::commitBufferRW(const rfb::Rect& r)
   mutex.unlock();
 }
 
-rfb::Rect PlatformPixelBuffer::getDamage(void)
+rfb::Region PlatformPixelBuffer::getDamage(void)
 {
-  rfb::Rect r;
+  rfb::Region region;
 
   mutex.lock();
-  r = damage.get_bounding_rect();
+  region = damage;
   damage.clear();
   mutex.unlock();
 
 #if !defined(WIN32) && !defined(__APPLE__)
+  std::vector<rfb::Rect> rects;
+  std::vector<rfb::Rect>::const_iterator iter;
+  rfb::Rect pending;
+  int overhead;
+  ShmImage* image;
   GC gc;
 
+  // Every request has a cost of its own, roughly the same as this many
+  // pixels. Shared memory makes the pixels themselves cheap, so there
+  // it pays to send fewer, larger, requests.
+  overhead = haveShm ? 16384 : 4096;
+
+  image = NULL;
+  if (haveShm) {
+    image = &shmImages[nextShmImage];
+    if (isBusy(image)) {
+      // The X server is behind, so we have to wait for it
+      vlog.debug("Waiting for X server to finish reading shared memory");
+      XSync(fl_display, False);
+    }
+    nextShmImage = (nextShmImage + 1) % 2;
+  }
+
+  region.get_rects(&rects);
+
   gc = XCreateGC(fl_display, pixmap, 0, NULL);
-  if (shminfo) {
-    XShmPutImage(fl_display, pixmap, gc, xim,
+  for (iter = rects.begin(); iter != rects.end(); ++iter) {
+    if (!pending.is_empty()) {
+      rfb::Rect merged;
+      merged = pending.union_boundary(*iter);
+      if (merged.area() - pending.area() - iter->area() < overhead) {
+        pending = merged;
+        continue;
+      }
+      putImage(gc, pending, image);
+    }
+    pending = *iter;
+  }
+  if (!pending.is_empty())
+    putImage(gc, pending, image);
+  XFreeGC(fl_display, gc);
+
+  // Let the X server get going while we do other things
+  XFlush(fl_display);
+#endif
+
+  return region;
+}
+
+#if !defined(WIN32) && !defined(__APPLE__)
+
+void PlatformPixelBuffer::putImage(GC gc, const rfb::Rect& r,
+                                   ShmImage* image)
+{
+  if (image) {
+    int bytesPerPixel, srcStride, dstStride;
+    const char *src;
+    char *dst;
+
+    // Take a copy so that decoding can continue while the X server
+    // reads the pixels
+    bytesPerPixel = xim->bits_per_pixel / 8;
+    srcStride = xim->bytes_per_line;
+    dstStride = image->xim->bytes_per_line;
+    src = xim->data + r.tl.y * srcStride + r.tl.x * bytesPerPixel;
+    dst = image->xim->data + r.tl.y * dstStride + r.tl.x * bytesPerPixel;
+    for (int y = 0; y < r.height(); y++) {
+      memcpy(dst, src, r.width() * bytesPerPixel);
+      src += srcStride;
+      dst += dstStride;
+    }
+
+    // We'll get an event once the X server is done with the shared
+    // memory, rather than waiting for it here
+    image->serial = NextRequest(fl_display);
+    XShmPutImage(fl_display, pixmap, gc, image->xim,
                  r.tl.x, r.tl.y, r.tl.x, r.tl.y,
-                 r.width(), r.height(), False);
-    // Need to make sure the X server has finished reading the
-    // shared memory before we return
-    XSync(fl_display, False);
+                 r.width(), r.height(), True);
   } else {
     XPutImage(fl_display, pixmap, gc, xim,
               r.tl.x, r.tl.y, r.tl.x, r.tl.y, r.width(), r.height());
   }
-  XFreeGC(fl_display, gc);
-#endif
+}
 
-  return r;
+bool PlatformPixelBuffer::isBusy(const ShmImage* image)
+{
+  // Every event, including the completion event, tells Xlib how far
+  // the X server has come
+  return (long)(LastKnownRequestProcessed(fl_display) - image->serial) < 0;
 }
 
-#if !defined(WIN32) && !defined(__APPLE__)
+int PlatformPixelBuffer::handleSystemEvent(void *event, void *data)
+{
+  XShmCompletionEvent *ev = (XShmCompletionEvent*)event;
+  std::list<PlatformPixelBuffer*>::iterator iter;
+
+  // Nothing to do, as Xlib has already noted the sequence number, but
+  // FLTK shouldn't have to deal with the event
+  for (iter = shmBuffers.begin(); iter != shmBuffers.end(); ++iter) {
+    PlatformPixelBuffer *self = *iter;
+
+    if (ev->type != self->shmEventBase + ShmCompletion)
+      continue;
+    if (ev->drawable != self->pixmap)
+      continue;
+
+    return 1;
+  }
+
+  return 0;
+}
 
 static bool caughtError;
 
@@ -136,8 +257,10 @@ static int XShmAttachErrorHandler(Display *dpy, XErrorEvent *error)
   return 0;
 }
 
-bool PlatformPixelBuffer::setupShm()
+bool PlatformPixelBuffer::setupShm(ShmImage* image)
 {
+  XShmSegmentInfo *shminfo;
+  XImage *xim;
   int major, minor;
   Bool pixmaps;
   XErrorHandler old_handler;
@@ -187,7 +310,9 @@ bool PlatformPixelBuffer::setupShm()
   if (caughtError)
     goto free_shmaddr;
 
-  vlog.debug("Using shared memory XImage");
+  image->shminfo = shminfo;
+  image->xim = xim;
+  image->serial = 0;
 
   return true;
 
@@ -196,13 +321,28 @@ free_shmaddr:
 
 free_xim:
   XDestroyImage(xim);
-  xim = NULL;
 
 free_shminfo:
   delete shminfo;
-  shminfo = NULL;
 
   return 0;
 }
 
+void PlatformPixelBuffer::freeShm(ShmImage* image)
+{
+  if (!image->shminfo)
+    return;
+
+  vlog.debug("Freeing shared memory XImage");
+  XShmDetach(fl_display, image->shminfo);
+  shmdt(image->shminfo->shmaddr);
+  shmctl(image->shminfo->shmid, IPC_RMID, 0);
+  delete image->shminfo;
+  image->shminfo = NULL;
+
+  // XDestroyImage() will not free the shared memory
+  XDestroyImage(image->xim);
+  image->xim = NULL;
+}
+
 #endif
@@ -42,7 +42,9 @@ public:
 
   virtual void commitBufferRW(const rfb::Rect& r);
 
-  rfb::Rect getDamage(void);
+  // Upload everything that has changed since the last call to the
+  // window system, and return the region that was uploaded.
+  rfb::Region getDamage(void);
 
   using rfb::FullFramePixelBuffer::width;
   using rfb::FullFramePixelBuffer::height;
@@ -53,11 +55,31 @@ protected:
 
 #if !defined(WIN32) && !defined(__APPLE__)
 protected:
-  bool setupShm();
+  // The X server reads pixels from shared memory at its own pace, so
+  // decoding is done in a separate image. Changed areas are copied to
+  // one of two shared images, alternating between them so that there
+  // is always one that isn't in use by the X server.
+  struct ShmImage {
+    XShmSegmentInfo *shminfo;
+    XImage *xim;
+    // Sequence number of the last request using this image
+    unsigned long serial;
+  };
+
+  bool setupShm(ShmImage* image);
+  void freeShm(ShmImage* image);
+  bool isBusy(const ShmImage* image);
+  void putImage(GC gc, const rfb::Rect& r, ShmImage* image);
+
+  static int handleSystemEvent(void *event, void *data);
 
 protected:
-  XShmSegmentInfo *shminfo;
   XImage *xim;
+
+  bool haveShm;
+  ShmImage shmImages[2];
+  int nextShmImage;
+  int shmEventBase;
 #endif
 };
 
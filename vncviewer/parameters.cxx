@@ -80,8 +80,8 @@ IntParameter lowColourLevel("LowColorLevel",
                             "2 = Medium (256 colors)", 2);
 AliasParameter lowColourLevelAlias("LowColourLevel", "Alias for LowColorLevel", &lowColourLevel);
 StringParameter preferredEncoding("PreferredEncoding",
-                                  "Preferred encoding to use (Tight, ZRLE, Hextile or"
-                                  " Raw)", "Tight");
+                                  "Preferred encoding to use (TightZstd, Tight, LZ4, "
+                                  "ZRLE, Hextile or Raw)", "Tight");
 BoolParameter customCompressLevel("CustomCompressLevel",
                                   "Use custom compression level. "
                                   "Default if CompressLevel is specified.", false);
@@ -94,6 +94,10 @@ BoolParameter noJpeg("NoJPEG",
 IntParameter qualityLevel("QualityLevel",
                           "JPEG quality level. 0 = Low, 9 = High",
                           8);
+BoolParameter tileCache("TileCache",
+                        "Keep a cache of recently seen parts of the "
+                        "screen that the server can refer to",
+                        true);
 
 BoolParameter maximize("Maximize", "Maximize viewer window", false);
 BoolParameter fullScreen("FullScreen", "Full screen mode", false);
@@ -142,6 +146,11 @@ StringParameter display("display",
 StringParameter menuKey("MenuKey", "The key which brings up the popup menu",
                         "F8");
 
+StringParameter latencyLog("LatencyLog",
+                           "Measure the latency from pointer events to "
+                           "the screen and write a histogram of it to "
+                           "this file when disconnecting", "");
+
 BoolParameter fullscreenSystemKeys("FullscreenSystemKeys",
                                    "Pass special keys (like Alt+Tab) directly "
                                    "to the server when in full screen mode.",
@@ -149,6 +158,10 @@ BoolParameter fullscreenSystemKeys("FullscreenSystemKeys",
 
 #ifndef WIN32
 StringParameter via("via", "Gateway to tunnel via", "");
+BoolParameter sharedMemory("SharedMemory",
+                           "Use shared memory to receive framebuffer "
+                           "updates when the server is on the same host",
+                           true);
 #endif
 
 static const char* IDENTIFIER_STRING = "TigerVNC Configuration file Version 1.0";
@@ -168,6 +181,7 @@ static VoidParameter* parameterArray[] = {
   &compressLevel,
   &noJpeg,
   &qualityLevel,
+  &tileCache,
   &fullScreen,
   &fullScreenAllMonitors,
   &desktopSize,
@@ -37,6 +37,7 @@ extern rfb::BoolParameter customCompressLevel;
 extern rfb::IntParameter compressLevel;
 extern rfb::BoolParameter noJpeg;
 extern rfb::IntParameter qualityLevel;
+extern rfb::BoolParameter tileCache;
 
 extern rfb::BoolParameter maximize;
 extern rfb::BoolParameter fullScreen;
@@ -60,11 +61,14 @@ extern rfb::StringParameter display;
 
 extern rfb::StringParameter menuKey;
 
+extern rfb::StringParameter latencyLog;
+
 extern rfb::BoolParameter fullscreenSystemKeys;
 extern rfb::BoolParameter alertOnFatalError;
 
 #ifndef WIN32
 extern rfb::StringParameter via;
+extern rfb::BoolParameter sharedMemory;
 #endif
 
 void saveViewerParameters(const char *filename, const char *servername=NULL);
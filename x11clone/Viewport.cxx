@@ -226,10 +226,17 @@ const rfb::PixelFormat &Viewport::getPreferredPF()
 
 void Viewport::updateWindow()
 {
-  Rect r;
+  rfb::Region changed;
+  std::vector<Rect> rects;
+  std::vector<Rect>::const_iterator iter;
 
-  r = frameBuffer->getDamage();
-  damage(FL_DAMAGE_USER1, r.tl.x + x(), r.tl.y + y(), r.width(), r.height());
+  changed = frameBuffer->getDamage();
+
+  changed.get_rects(&rects);
+  for (iter = rects.begin(); iter != rects.end(); ++iter) {
+    damage(FL_DAMAGE_USER1, iter->tl.x + x(), iter->tl.y + y(),
+           iter->width(), iter->height());
+  }
 }
 
 void Viewport::serverCutText(const char* str, rdr::U32 len)
@@ -775,6 +782,7 @@ void Viewport::handlePointerEvent(const rfb::Point& pos, int buttonMask)
     if (pointerEventInterval == 0 || buttonMask != lastButtonMask) {
       try {
         cc->writer()->writePointerEvent(pos, buttonMask);
+        cc->sendLatencyProbe();
       } catch (rdr::Exception& e) {
         vlog.error("%s", e.str());
         exit_vncviewer(e.str());
@@ -799,6 +807,7 @@ void Viewport::handlePointerTimeout(void *data)
   try {
     self->cc->writer()->writePointerEvent(self->lastPointerPos,
                                           self->lastButtonMask);
+    self->cc->sendLatencyProbe();
   } catch (rdr::Exception& e) {
     vlog.error("%s", e.str());
     exit_vncviewer(e.str());